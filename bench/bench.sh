@@ -0,0 +1,148 @@
+#!/bin/sh
+#
+# Run the benchmark ROMs headless with both CPU backends, and compare the
+# results with the stored baseline.
+#
+# usage: bench.sh [-u] [-f frames] [-r seed] [-t tolerance] <nes-bench> [rom...]
+#
+#   -u              replace the baseline with the current results
+#   -f frames       number of emulated frames per run (default 1800)
+#   -r seed         seed of the scripted input (default 1)
+#   -t tolerance    accepted slowdown, in percent (default 10)
+#
+# The generated ROMs (see genrom.cc) are always included. The exit status is
+# non-zero if a run is slower than the baseline by more than the tolerance,
+# if its final state hash differs from the baseline (the emulation is
+# expected to be deterministic), or if the two backends end a ROM with
+# different hashes (the recompiler must match the interpreter). The speeds are only compared when the
+# baseline was recorded on the same host CPU: the committed baseline checks
+# the hashes everywhere, 'make bench-baseline' records local speeds.
+
+BENCHDIR=$(dirname "$0")
+BASELINE=$BENCHDIR/baseline.txt
+UPDATE=
+FRAMES=1800
+SEED=1
+TOLERANCE=10
+
+while getopts "uf:r:t:" opt; do
+    case $opt in
+        u) UPDATE=1 ;;
+        f) FRAMES=$OPTARG ;;
+        r) SEED=$OPTARG ;;
+        t) TOLERANCE=$OPTARG ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 [-u] [-f frames] [-r seed] [-t tolerance]" \
+         "<nes-bench> [rom...]" >&2
+    exit 2
+fi
+EMU=$1
+shift
+
+mkdir -p "$BENCHDIR/roms"
+"$BENCHDIR/genrom" "$BENCHDIR/roms" || exit 1
+
+# Extract a field from the JSON line printed by 'nes -b'.
+field() {
+    echo "$1" | sed -n "s/.*\"$2\":\"\{0,1\}\([^,\"}]*\).*/\1/p"
+}
+
+# Identify the host CPU, recorded with the baseline.
+HOST=$(sed -n 's/^model name[^:]*: *//p' /proc/cpuinfo 2>/dev/null | head -n 1)
+[ -n "$HOST" ] || HOST=$(uname -m)
+
+RESULTS=$(mktemp)
+trap 'rm -f "$RESULTS"' EXIT
+
+for rom in "$BENCHDIR"/roms/*.nes "$@"; do
+    name=$(basename "$rom" .nes)
+    for backend in jit interpreter; do
+        flags=
+        [ $backend = interpreter ] && flags=-i
+        out=$("$EMU" -b $flags -r "$SEED" "$rom" "$FRAMES" 2>/dev/null)
+        if [ -z "$(field "$out" hash)" ]; then
+            echo "$name $backend: run failed" >&2
+            echo "$name $backend 0 0 0 failed" >> "$RESULTS"
+            continue
+        fi
+        echo "$name $backend $(field "$out" frames_per_second)" \
+             "$(field "$out" cycles_per_second)" \
+             "$(field "$out" peak_rss_kb) $(field "$out" hash)" >> "$RESULTS"
+    done
+done
+
+if [ -n "$UPDATE" ]; then
+    {
+        echo "# frames=$FRAMES seed=$SEED"
+        echo "# host=$HOST"
+        echo "# rom backend frames/s cycles/s peak_rss_kb hash"
+        cat "$RESULTS"
+    } > "$BASELINE"
+    echo "Baseline written to $BASELINE"
+fi
+
+SPEED=1
+if [ ! -f "$BASELINE" ]; then
+    echo "warning: no baseline, run 'make bench-baseline'" >&2
+elif ! grep -q "^# frames=$FRAMES seed=$SEED\$" "$BASELINE"; then
+    echo "warning: the baseline was recorded with other settings" >&2
+elif ! grep -qxF "# host=$HOST" "$BASELINE"; then
+    echo "note: the baseline was recorded on another host, only the" \
+         "hashes are compared; run 'make bench-baseline' for the speeds" >&2
+    SPEED=
+fi
+
+awk -v tolerance="$TOLERANCE" -v baselineFile="$BASELINE" -v speed="$SPEED" '
+    BEGIN {
+        while ((getline line < baselineFile) > 0) {
+            split(line, base, " ");
+            if (base[1] !~ /^#/)
+                baseline[base[1] " " base[2]] = line;
+        }
+        printf "%-12s %-12s %10s %14s %10s %9s  %s\n", "rom", "backend",
+            "frames/s", "cycles/s", "rss (kB)", "vs base", "status";
+    }
+    {
+        key = $1 " " $2;
+        delta = "-";
+        status = "new";
+        if (key in baseline) {
+            split(baseline[key], base, " ");
+            status = "ok";
+            if (speed && base[3] > 0) {
+                d = 100 * ($3 - base[3]) / base[3];
+                delta = sprintf("%+.1f%%", d);
+                if (d < -tolerance)
+                    status = "SLOWER";
+            }
+            if ($6 != base[6])
+                status = "DIVERGED";
+        }
+        if ($6 == "failed")
+            status = "FAILED";
+        else
+            hash[$1, $2] = $6;
+        if (status != "ok" && status != "new")
+            failed = 1;
+        printf "%-12s %-12s %10.2f %14.0f %10d %9s  %s\n",
+            $1, $2, $3, $4, $5, delta, status;
+    }
+    END {
+        for (key in hash) {
+            split(key, run, SUBSEP);
+            if (run[2] != "jit" || !((run[1], "interpreter") in hash))
+                continue;
+            if (hash[key] != hash[run[1], "interpreter"]) {
+                printf "%-12s backends DIVERGED (jit %s, interpreter %s)\n",
+                    run[1], hash[key], hash[run[1], "interpreter"];
+                failed = 1;
+            }
+        }
+        exit failed
+    }
+' "$RESULTS"
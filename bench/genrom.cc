@@ -0,0 +1,534 @@
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "type.h"
+#include "M6502Asm.h"
+
+/**
+ * Generator of the benchmark ROMs: small NROM programs, each stressing
+ * a different part of the emulator, so that the benchmark runs without any
+ * external ROM. All programs enable the rendering and the vblank NMI.
+ *
+ *  - alu.nes       arithmetic and branches, mostly recompiled code
+ *  - memory.nes    indexed and indirect memory copies
+ *  - input.nes     game-like frame loop: joypad polling, sprites and OAM
+ *                  DMA, nametable updates during the vblank
+ *  - calls.nes     subroutine calls and indirect jumps, which exit the
+ *                  recompiled code
+ */
+
+/**
+ * Minimal 6502 assembler, with forward references to labels.
+ */
+class Assembler
+{
+public:
+    enum FixupType { ABSOLUTE, RELATIVE, LOW, HIGH };
+
+    Assembler(u16 origin) : _origin(origin) {}
+    ~Assembler() {}
+
+    void label(const std::string &name) {
+        if (_labels.count(name))
+            throw std::runtime_error("duplicate label " + name);
+        _labels[name] = _origin + _code.size();
+    }
+
+    void byte(u8 val) {
+        _code.push_back(val);
+    }
+
+    /** Implied and accumulator addressing. */
+    void op(u8 opcode) {
+        byte(opcode);
+    }
+
+    /** Immediate, zero page and indirect addressing. */
+    void op(u8 opcode, u8 operand) {
+        byte(opcode);
+        byte(operand);
+    }
+
+    /** Absolute addressing. */
+    void op16(u8 opcode, u16 addr) {
+        byte(opcode);
+        byte(addr & 0xff);
+        byte(addr >> 8);
+    }
+
+    void op16(u8 opcode, const std::string &target) {
+        byte(opcode);
+        fixup(ABSOLUTE, target);
+        byte(0);
+        byte(0);
+    }
+
+    void branch(u8 opcode, const std::string &target) {
+        byte(opcode);
+        fixup(RELATIVE, target);
+        byte(0);
+    }
+
+    /** Immediate load of the low or high byte of a label address. */
+    void low(u8 opcode, const std::string &target) {
+        byte(opcode);
+        fixup(LOW, target);
+        byte(0);
+    }
+
+    void high(u8 opcode, const std::string &target) {
+        byte(opcode);
+        fixup(HIGH, target);
+        byte(0);
+    }
+
+    u16 address(const std::string &name) const {
+        std::map<std::string, u16>::const_iterator it = _labels.find(name);
+        if (it == _labels.end())
+            throw std::runtime_error("undefined label " + name);
+        return it->second;
+    }
+
+    /**
+     * @brief Resolve the label references.
+     */
+    const std::vector<u8> &link() {
+        for (size_t i = 0; i < _fixups.size(); i++) {
+            Fixup &f = _fixups[i];
+            u16 addr = address(f.target);
+            int offset;
+
+            switch (f.type) {
+                case ABSOLUTE:
+                    _code[f.offset] = addr & 0xff;
+                    _code[f.offset + 1] = addr >> 8;
+                    break;
+                case RELATIVE:
+                    offset = (int)addr - (int)(_origin + f.offset + 1);
+                    if (offset < -128 || offset > 127)
+                        throw std::runtime_error("branch out of range to " +
+                                                 f.target);
+                    _code[f.offset] = (u8)offset;
+                    break;
+                case LOW:
+                    _code[f.offset] = addr & 0xff;
+                    break;
+                case HIGH:
+                    _code[f.offset] = addr >> 8;
+                    break;
+            }
+        }
+        return _code;
+    }
+
+private:
+    struct Fixup {
+        FixupType type;
+        size_t offset;
+        std::string target;
+    };
+
+    void fixup(FixupType type, const std::string &target) {
+        Fixup f = { type, _code.size(), target };
+        _fixups.push_back(f);
+    }
+
+    u16 _origin;
+    std::vector<u8> _code;
+    std::map<std::string, u16> _labels;
+    std::vector<Fixup> _fixups;
+};
+
+/* Zero page variables shared by all programs. */
+#define FRAME       0x00    /* Incremented by the NMI handler. */
+#define LAST_FRAME  0x01    /* Last frame handled by the main loop. */
+#define SRC         0x02    /* Source pointer. */
+#define DST         0x04    /* Destination pointer. */
+#define VECTOR      0x06    /* Indirect jump vector. */
+#define VAR         0x10    /* Program variables. */
+
+/**
+ * @brief Emit the reset handler: clear the RAM, load the palette and fill
+ *  the first nametables, enable NMI and rendering, then jump to 'init'.
+ */
+static void emitReset(Assembler &a)
+{
+    a.label("reset");
+    a.op(SEI_IMP);
+    a.op(CLD_IMP);
+    a.op(LDX_IMM, 0xff);
+    a.op(TXS_IMP);
+    a.op(INX_IMP);
+    a.op16(STX_ABS, 0x2000);
+    a.op16(STX_ABS, 0x2001);
+
+    a.label("vblank0");
+    a.op16(BIT_ABS, 0x2002);
+    a.branch(BPL_REL, "vblank0");
+
+    a.op(LDA_IMM, 0x00);
+    a.label("clear");
+    a.op(STA_ZPX, 0x00);
+    for (u16 page = 0x0100; page < 0x0800; page += 0x100)
+        a.op16(STA_ABX, page);
+    a.op(INX_IMP);
+    a.branch(BNE_REL, "clear");
+
+    a.label("vblank1");
+    a.op16(BIT_ABS, 0x2002);
+    a.branch(BPL_REL, "vblank1");
+
+    /* Palette. */
+    a.op(LDA_IMM, 0x3f);
+    a.op16(STA_ABS, 0x2006);
+    a.op(LDA_IMM, 0x00);
+    a.op16(STA_ABS, 0x2006);
+    a.op(LDX_IMM, 0x00);
+    a.label("palette_loop");
+    a.op16(LDA_ABX, "palette");
+    a.op16(STA_ABS, 0x2007);
+    a.op(INX_IMP);
+    a.op(CPX_IMM, 0x20);
+    a.branch(BNE_REL, "palette_loop");
+
+    /* Nametables 0 and 1, including the attribute tables. */
+    a.op(LDA_IMM, 0x20);
+    a.op16(STA_ABS, 0x2006);
+    a.op(LDA_IMM, 0x00);
+    a.op16(STA_ABS, 0x2006);
+    a.op(LDX_IMM, 0x00);
+    a.op(LDY_IMM, 0x08);
+    a.label("nametable_loop");
+    a.op(TXA_IMP);
+    a.op(EOR_ZPG, VAR);
+    a.op16(STA_ABS, 0x2007);
+    a.op(INX_IMP);
+    a.branch(BNE_REL, "nametable_loop");
+    a.op(INC_ZPG, VAR);
+    a.op(DEY_IMP);
+    a.branch(BNE_REL, "nametable_loop");
+
+    a.op(LDA_IMM, 0x00);
+    a.op(STA_ZPG, VAR);
+    a.op16(STA_ABS, 0x2005);
+    a.op16(STA_ABS, 0x2005);
+    a.op(LDA_IMM, 0x80);
+    a.op16(STA_ABS, 0x2000);
+    a.op(LDA_IMM, 0x1e);
+    a.op16(STA_ABS, 0x2001);
+    a.op16(JMP_ABS, "init");
+}
+
+/**
+ * @brief Emit the NMI handler, which calls the program's 'vblank' routine.
+ */
+static void emitNMI(Assembler &a)
+{
+    a.label("nmi");
+    a.op(PHA_IMP);
+    a.op(TXA_IMP);
+    a.op(PHA_IMP);
+    a.op(TYA_IMP);
+    a.op(PHA_IMP);
+    a.op(INC_ZPG, FRAME);
+    a.op16(JSR_ABS, "vblank");
+    a.op(LDA_IMM, 0x00);
+    a.op16(STA_ABS, 0x2005);
+    a.op16(STA_ABS, 0x2005);
+    a.op(LDA_IMM, 0x80);
+    a.op16(STA_ABS, 0x2000);
+    a.op(PLA_IMP);
+    a.op(TAY_IMP);
+    a.op(PLA_IMP);
+    a.op(TAX_IMP);
+    a.op(PLA_IMP);
+    a.op(RTI_IMP);
+
+    a.label("irq");
+    a.op(RTI_IMP);
+
+    a.label("palette");
+    static const u8 palette[32] = {
+        0x0f, 0x01, 0x11, 0x21, 0x0f, 0x06, 0x16, 0x26,
+        0x0f, 0x09, 0x19, 0x29, 0x0f, 0x04, 0x14, 0x24,
+        0x0f, 0x02, 0x12, 0x22, 0x0f, 0x07, 0x17, 0x27,
+        0x0f, 0x0a, 0x1a, 0x2a, 0x0f, 0x05, 0x15, 0x25,
+    };
+    for (size_t i = 0; i < sizeof(palette); i++)
+        a.byte(palette[i]);
+}
+
+static void emitAlu(Assembler &a)
+{
+    a.label("init");
+    a.op(LDA_IMM, 0x35);
+    a.op(STA_ZPG, VAR + 2);
+    a.op(LDA_IMM, 0x9c);
+    a.op(STA_ZPG, VAR + 3);
+
+    a.label("main");
+    a.op(LDX_IMM, 0x00);
+    a.label("alu");
+    /* 16-bit addition. */
+    a.op(CLC_IMP);
+    a.op(LDA_ZPG, VAR);
+    a.op(ADC_ZPG, VAR + 2);
+    a.op(STA_ZPG, VAR);
+    a.op(LDA_ZPG, VAR + 1);
+    a.op(ADC_ZPG, VAR + 3);
+    a.op(STA_ZPG, VAR + 1);
+    /* 16-bit rotation. */
+    a.op(ASL_ZPG, VAR + 2);
+    a.op(ROL_ZPG, VAR + 3);
+    a.branch(BCC_REL, "no_carry");
+    a.op(INC_ZPG, VAR + 2);
+    a.label("no_carry");
+    a.op(LDA_ZPG, VAR);
+    a.op(EOR_ZPG, VAR + 3);
+    a.op(AND_IMM, 0x7f);
+    a.op(ORA_ZPX, VAR + 4);
+    a.op16(STA_ABX, 0x0300);
+    a.op(INX_IMP);
+    a.branch(BNE_REL, "alu");
+
+    /* Fold the table. */
+    a.op(LDY_IMM, 0x00);
+    a.op(LDA_IMM, 0x00);
+    a.op(CLC_IMP);
+    a.label("sum");
+    a.op16(ADC_ABY, 0x0300);
+    a.op(INY_IMP);
+    a.branch(BNE_REL, "sum");
+    a.op(STA_ZPG, VAR + 4);
+    a.op16(JMP_ABS, "main");
+
+    a.label("vblank");
+    a.op(RTS_IMP);
+}
+
+static void emitMemory(Assembler &a)
+{
+    a.label("init");
+    a.label("main");
+    /* Copy pages 3-6 to the next page through indirect pointers. */
+    a.op(LDX_IMM, 0x03);
+    a.label("copy_page");
+    a.op(LDA_IMM, 0x00);
+    a.op(STA_ZPG, SRC);
+    a.op(STA_ZPG, DST);
+    a.op(STX_ZPG, SRC + 1);
+    a.op(INX_IMP);
+    a.op(STX_ZPG, DST + 1);
+    a.op(LDY_IMM, 0x00);
+    a.label("copy");
+    a.op(LDA_INY, SRC);
+    a.op(CLC_IMP);
+    a.op(ADC_IMM, 0x01);
+    a.op(STA_INY, DST);
+    a.op(INY_IMP);
+    a.branch(BNE_REL, "copy");
+    a.op(CPX_IMM, 0x07);
+    a.branch(BNE_REL, "copy_page");
+
+    /* Copy page 7 back to page 3, with absolute indexed accesses. */
+    a.op(LDX_IMM, 0x00);
+    a.label("copy_back");
+    a.op16(LDA_ABX, 0x0700);
+    a.op(EOR_ZPG, FRAME);
+    a.op16(STA_ABX, 0x0300);
+    a.op(DEX_IMP);
+    a.branch(BNE_REL, "copy_back");
+    a.op16(JMP_ABS, "main");
+
+    a.label("vblank");
+    a.op(RTS_IMP);
+}
+
+static void emitInput(Assembler &a)
+{
+    a.label("init");
+    a.op(LDA_IMM, 0x70);
+    a.op16(STA_ABS, 0x0200);
+    a.op16(STA_ABS, 0x0203);
+
+    /* Wait for the next frame. */
+    a.label("main");
+    a.op(LDA_ZPG, FRAME);
+    a.op(CMP_ZPG, LAST_FRAME);
+    a.branch(BEQ_REL, "main");
+    a.op(STA_ZPG, LAST_FRAME);
+
+    /* Read the joypad into VAR. */
+    a.op(LDA_IMM, 0x01);
+    a.op16(STA_ABS, 0x4016);
+    a.op(LDA_IMM, 0x00);
+    a.op16(STA_ABS, 0x4016);
+    a.op(LDX_IMM, 0x08);
+    a.label("read_joypad");
+    a.op16(LDA_ABS, 0x4016);
+    a.op(LSR_ACC);
+    a.op(ROL_ZPG, VAR);
+    a.op(DEX_IMP);
+    a.branch(BNE_REL, "read_joypad");
+
+    /* Move the first sprite: bits are A B Select Start Up Down Left Right. */
+    a.op(LDA_ZPG, VAR);
+    a.op(AND_IMM, 0x08);
+    a.branch(BEQ_REL, "no_up");
+    a.op16(INC_ABS, 0x0200);
+    a.label("no_up");
+    a.op(LDA_ZPG, VAR);
+    a.op(AND_IMM, 0x01);
+    a.branch(BEQ_REL, "no_right");
+    a.op16(INC_ABS, 0x0203);
+    a.label("no_right");
+
+    /* Animate the other sprites. */
+    a.op(LDX_IMM, 0x04);
+    a.label("sprites");
+    a.op(TXA_IMP);
+    a.op(ADC_ZPG, FRAME);
+    a.op16(STA_ABX, 0x0200);
+    a.op(EOR_ZPG, VAR);
+    a.op16(STA_ABX, 0x0203);
+    a.op(TXA_IMP);
+    a.op(LSR_ACC);
+    a.op(LSR_ACC);
+    a.op16(STA_ABX, 0x0201);
+    a.op(INX_IMP);
+    a.op(INX_IMP);
+    a.op(INX_IMP);
+    a.op(INX_IMP);
+    a.branch(BNE_REL, "sprites");
+    a.op16(JMP_ABS, "main");
+
+    /* OAM DMA, and update of one nametable row per frame. */
+    a.label("vblank");
+    a.op(LDA_IMM, 0x02);
+    a.op16(STA_ABS, 0x4014);
+    a.op(LDA_ZPG, FRAME);
+    a.op(AND_IMM, 0x0f);
+    a.op(LSR_ACC);
+    a.op(LSR_ACC);
+    a.op(LSR_ACC);
+    a.op(ORA_IMM, 0x20);
+    a.op16(STA_ABS, 0x2006);
+    a.op(LDA_ZPG, FRAME);
+    a.op(AND_IMM, 0x07);
+    a.op(ASL_ACC);
+    a.op(ASL_ACC);
+    a.op(ASL_ACC);
+    a.op(ASL_ACC);
+    a.op(ASL_ACC);
+    a.op16(STA_ABS, 0x2006);
+    a.op(LDX_IMM, 0x20);
+    a.op(LDA_ZPG, VAR);
+    a.label("row");
+    a.op16(STA_ABS, 0x2007);
+    a.op(ADC_ZPG, FRAME);
+    a.op(DEX_IMP);
+    a.branch(BNE_REL, "row");
+    a.op(RTS_IMP);
+}
+
+static void emitCalls(Assembler &a)
+{
+    a.label("init");
+    a.low(LDA_IMM, "indirect");
+    a.op(STA_ZPG, VECTOR);
+    a.high(LDA_IMM, "indirect");
+    a.op(STA_ZPG, VECTOR + 1);
+
+    a.label("main");
+    a.op(LDX_IMM, 0x00);
+    a.label("calls");
+    a.op16(JSR_ABS, "accumulate");
+    a.op16(JSR_ABS, "dispatch");
+    a.op(INX_IMP);
+    a.branch(BNE_REL, "calls");
+    a.op16(JMP_ABS, "main");
+
+    a.label("accumulate");
+    a.op(TXA_IMP);
+    a.op(CLC_IMP);
+    a.op(ADC_ZPG, VAR);
+    a.op(STA_ZPG, VAR);
+    a.op(RTS_IMP);
+
+    a.label("dispatch");
+    a.op16(JMP_IND, VECTOR);
+    a.label("indirect");
+    a.op(LDA_ZPG, VAR);
+    a.op(EOR_ZPG, FRAME);
+    a.op(STA_ZPX, VAR + 1);
+    a.op(RTS_IMP);
+
+    a.label("vblank");
+    a.op(RTS_IMP);
+}
+
+/**
+ * @brief Assemble a program and write the iNES image: one 16K PRG-ROM bank
+ *  (mirrored at 0x8000 and 0xc000), one 8K CHR-ROM bank of generated
+ *  tiles, vertical mirroring.
+ */
+static void writeRom(const std::string &path, void (*emit)(Assembler &))
+{
+    Assembler a(0xc000);
+    emitReset(a);
+    emitNMI(a);
+    emit(a);
+    std::vector<u8> code = a.link();
+
+    std::vector<u8> prg(0x4000, 0xea);
+    if (code.size() > prg.size() - 6)
+        throw std::runtime_error("program too large");
+    memcpy(&prg[0], &code[0], code.size());
+
+    u16 vectors[3] = { a.address("nmi"), a.address("reset"), a.address("irq") };
+    for (int i = 0; i < 3; i++) {
+        prg[0x3ffa + 2 * i] = vectors[i] & 0xff;
+        prg[0x3ffb + 2 * i] = vectors[i] >> 8;
+    }
+
+    std::vector<u8> chr(0x2000);
+    for (size_t i = 0; i < chr.size(); i++) {
+        u32 tile = i >> 4, row = i & 0x7, plane = (i >> 3) & 0x1;
+        chr[i] = (u8)((tile * 0x1d + row * 0x47) ^ (plane ? tile << 3 : row));
+    }
+
+    u8 header[16] = { 'N', 'E', 'S', 0x1a, 1, 1, 0x01, 0x00 };
+    FILE *fd = fopen(path.c_str(), "wb");
+    if (fd == NULL)
+        throw std::runtime_error("cannot write " + path);
+    fwrite(header, sizeof(header), 1, fd);
+    fwrite(&prg[0], prg.size(), 1, fd);
+    fwrite(&chr[0], chr.size(), 1, fd);
+    fclose(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        std::cerr << "usage: genrom <directory>" << std::endl;
+        return 1;
+    }
+
+    std::string dir(argv[1]);
+    try {
+        writeRom(dir + "/alu.nes", emitAlu);
+        writeRom(dir + "/memory.nes", emitMemory);
+        writeRom(dir + "/input.nes", emitInput);
+        writeRom(dir + "/calls.nes", emitCalls);
+    } catch (const std::exception &exc) {
+        std::cerr << "genrom: " << exc.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,203 @@
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "Audio.h"
+#include "RP2A03State.h"
+
+/* Maximum relative change of the sample rate by the rate control. */
+#define MAX_RATE_DELTA          0.005
+/* Maximum time the writer waits for the device, in milliseconds. */
+#define MAX_WRITE_WAIT          100
+
+using namespace Audio;
+
+namespace Audio {
+
+static NullSink defaultBackend;
+static Backend *currentBackend = &defaultBackend;
+static unsigned int sampleRate = 44100;
+
+};
+
+/**
+ * @brief Write \p val as \p size little-endian bytes.
+ */
+static void writeLE(FILE *fd, u32 val, int size)
+{
+    for (int i = 0; i < size; i++)
+        fputc((val >> (8 * i)) & 0xff, fd);
+}
+
+FileSink::FileSink(const char *file)
+    : _file(file), _fd(NULL), _rate(0), _count(0)
+{
+}
+
+FileSink::~FileSink()
+{
+    quit();
+}
+
+int FileSink::init(unsigned int rate)
+{
+    _fd = fopen(_file, "wb");
+    if (_fd == NULL) {
+        std::cerr << "failed to open audio file " << _file << std::endl;
+        return -1;
+    }
+    _rate = rate;
+    _count = 0;
+    writeHeader();
+    return 0;
+}
+
+/**
+ * @brief Complete the header with the data size, and close the file.
+ */
+void FileSink::quit()
+{
+    if (_fd == NULL)
+        return;
+    fseek(_fd, 0, SEEK_SET);
+    writeHeader();
+    fclose(_fd);
+    _fd = NULL;
+}
+
+void FileSink::write(const i16 *samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        writeLE(_fd, (u16)samples[i], 2);
+    _count += count;
+}
+
+/**
+ * @brief Write the RIFF header of a mono 16-bit PCM file.
+ */
+void FileSink::writeHeader()
+{
+    u32 size = _count * 2;
+    fwrite("RIFF", 4, 1, _fd);
+    writeLE(_fd, 36 + size, 4);
+    fwrite("WAVEfmt ", 8, 1, _fd);
+    writeLE(_fd, 16, 4);
+    writeLE(_fd, 1, 2);             /* PCM */
+    writeLE(_fd, 1, 2);             /* Channels. */
+    writeLE(_fd, _rate, 4);
+    writeLE(_fd, _rate * 2, 4);     /* Byte rate. */
+    writeLE(_fd, 2, 2);             /* Block alignment. */
+    writeLE(_fd, 16, 2);            /* Bits per sample. */
+    fwrite("data", 4, 1, _fd);
+    writeLE(_fd, size, 4);
+}
+
+Device::Device(unsigned int latency)
+    : _latency(latency), _target(0), _last(0)
+{
+}
+
+Device::~Device()
+{
+}
+
+void Device::open(unsigned int rate)
+{
+    _target = (size_t)rate * _latency / 1000;
+    _queue.resize(2 * _target);
+    _last = 0;
+}
+
+/**
+ * @brief Wait until the queue is back to the target latency, then append
+ *  the samples. Samples that do not fit are dropped.
+ */
+void Device::write(const i16 *samples, size_t count)
+{
+    std::chrono::steady_clock::time_point limit =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(MAX_WRITE_WAIT);
+    while (_queue.getFill() > _target &&
+           std::chrono::steady_clock::now() < limit)
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    _queue.push(samples, count);
+}
+
+/**
+ * @brief Return the queue length relative to twice the target latency:
+ *  0.5 when the queue is at the target.
+ */
+double Device::getFill() const
+{
+    if (_target == 0)
+        return 0.;
+    double fill = (double)_queue.getFill() / (2 * _target);
+    return fill > 1. ? 1. : fill;
+}
+
+/**
+ * @brief Pop the queued samples ; on underrun, the last sample is repeated
+ *  to avoid a click.
+ */
+void Device::pull(i16 *out, size_t count)
+{
+    size_t n = _queue.pop(out, count);
+    if (n > 0)
+        _last = out[n - 1];
+    for (size_t i = n; i < count; i++)
+        out[i] = _last;
+}
+
+namespace Audio {
+
+/**
+ * @brief Replace the audio backend. Must be called before \ref init.
+ * @param backend       new backend, or NULL to restore the default one
+ */
+void setBackend(Backend *backend)
+{
+    currentBackend = backend ? backend : &defaultBackend;
+}
+
+Backend *getBackend()
+{
+    return currentBackend;
+}
+
+int init(unsigned int rate)
+{
+    int status = currentBackend->init(rate);
+    if (status < 0) {
+        std::cerr << "audio output disabled" << std::endl;
+        currentBackend = &defaultBackend;
+    }
+    sampleRate = rate;
+    RP2A03::setSampleRate(rate);
+    return status;
+}
+
+void quit()
+{
+    currentBackend->quit();
+}
+
+void endFrame()
+{
+    double fill = currentBackend->getFill();
+    if (fill >= 0.)
+        RP2A03::adjustSampleRate(
+            sampleRate * (1. + MAX_RATE_DELTA * (1. - 2. * fill)));
+
+    i16 samples[1024];
+    size_t count;
+    while ((count = RP2A03::readSamples(samples, 1024)) > 0)
+        currentBackend->write(samples, count);
+}
+
+bool isSynchronized()
+{
+    return currentBackend->getFill() >= 0.;
+}
+
+};
@@ -0,0 +1,147 @@
+
+#ifndef _AUDIO_H_INCLUDED_
+#define _AUDIO_H_INCLUDED_
+
+#include <cstddef>
+#include <cstdio>
+
+#include "SampleQueue.h"
+#include "type.h"
+
+namespace Audio {
+
+/**
+ * Audio output backend. At the end of every frame, the samples generated
+ * by the APU are written to the installed backend.
+ */
+class Backend
+{
+public:
+    Backend() {}
+    virtual ~Backend() {}
+
+    /**
+     * @brief Prepare the backend for signed 16-bit mono samples.
+     * @param rate          sample rate, in Hz
+     * @return              0 on success, -1 on failure
+     */
+    virtual int init(unsigned int rate) = 0;
+    virtual void quit() = 0;
+
+    /**
+     * @brief Output the samples of a frame.
+     */
+    virtual void write(const i16 *samples, size_t count) = 0;
+
+    /**
+     * @brief Return the fill level of the output queue, between 0 and 1,
+     *  or a negative value if the backend does not play the samples in
+     *  real time.
+     */
+    virtual double getFill() const { return -1.; }
+};
+
+/**
+ * Default backend: the samples are discarded.
+ */
+class NullSink : public Backend
+{
+public:
+    NullSink() {}
+    ~NullSink() {}
+
+    int init(unsigned int rate) { (void)rate; return 0; }
+    void quit() {}
+    void write(const i16 *samples, size_t count) {
+        (void)samples; (void)count;
+    }
+};
+
+/**
+ * Backend writing the samples to a WAV file.
+ */
+class FileSink : public Backend
+{
+public:
+    FileSink(const char *file);
+    ~FileSink();
+
+    int init(unsigned int rate);
+    void quit();
+    void write(const i16 *samples, size_t count);
+
+private:
+    void writeHeader();
+
+    const char *_file;
+    FILE *_fd;
+    unsigned int _rate;
+    size_t _count;
+};
+
+/**
+ * @brief Base of the backends playing the samples in real time.
+ *
+ *  The samples are handed to the device thread through a \ref SampleQueue.
+ *  The writer waits while the queue holds more than the target latency:
+ *  the device consumption paces the emulation. The device thread calls
+ *  \ref pull, which pads underruns by repeating the last sample.
+ */
+class Device : public Backend
+{
+public:
+    /**
+     * @param latency       target queue length, in milliseconds
+     */
+    Device(unsigned int latency = 50);
+    ~Device();
+
+    void write(const i16 *samples, size_t count);
+    double getFill() const;
+
+protected:
+    /**
+     * @brief Allocate the queue for the sample rate \p rate.
+     */
+    void open(unsigned int rate);
+
+    /**
+     * @brief Called from the device thread: fill \p out with the next
+     *  \p count samples.
+     */
+    void pull(i16 *out, size_t count);
+
+private:
+    SampleQueue _queue;
+    unsigned int _latency;
+    size_t _target;
+    i16 _last;
+};
+
+void setBackend(Backend *backend);
+Backend *getBackend();
+
+/**
+ * @brief Initialise the backend, and set the sample rate of the current
+ *  instance. Falls back to the default backend on failure.
+ */
+int init(unsigned int rate = 44100);
+void quit();
+
+/**
+ * @brief Write the samples of the completed frame to the backend. When the
+ *  backend plays in real time, the resampling ratio of the current
+ *  instance is adjusted to keep the output queue at its target fill
+ *  level (dynamic rate control).
+ */
+void endFrame();
+
+/**
+ * @brief Check whether the audio backend paces the emulation, in which
+ *  case the frame timer is not used.
+ */
+bool isSynchronized();
+
+};
+
+#endif /* _AUDIO_H_INCLUDED_ */
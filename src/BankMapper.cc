@@ -0,0 +1,101 @@
+
+#include <cstring>
+
+#include "BankMapper.h"
+#include "Memory.h"
+#include "N2C02State.h"
+#include "Stats.h"
+
+BankMapper::BankMapper(Rom *rom, MapperType type, const std::string name,
+                       void *regs, size_t regsSize)
+    : Mapper(rom, type, name), _regs(regs), _regsSize(regsSize)
+{
+    memset(_regs, 0, _regsSize);
+
+    /* Allocate the CHR-RAM, released with the cartridge. */
+    if (rom->chrRom == NULL) {
+        size_t size = rom->config.chrRamSize + rom->config.chrNvramSize;
+        _chrSize = size ? size : 0x2000;
+        rom->chrRom = new u8[_chrSize]();
+        _chrRam = true;
+    } else {
+        _chrSize = rom->config.chrRomSize;
+        _chrRam = false;
+    }
+    _chr = rom->chrRom;
+
+    /* Hardwired mirroring, overridden by the mappers which control it. */
+    if (rom->config.fourScreen)
+        N2C02::set4ScreenMirroring();
+    else if (rom->config.verticalMirroring)
+        N2C02::setVerticalMirroring();
+    else
+        N2C02::setHorizontalMirroring();
+}
+
+void BankMapper::mapPages(u8 **pages, size_t pageSize, size_t size,
+                          const u8 *mem, size_t memSize, int bank)
+{
+    long offset = ((long)bank * (long)size) % (long)memSize;
+    if (offset < 0)
+        offset += memSize;
+
+    bool switched = false;
+    for (size_t p = 0; p < size / pageSize; p++) {
+        u8 *page = const_cast<u8 *>(mem) + (offset + p * pageSize) % memSize;
+        switched |= pages[p] != page;
+        pages[p] = page;
+    }
+    if (switched)
+        Stats::counters.bankSwitches++;
+}
+
+void BankMapper::mapPrg(u16 addr, size_t size, int bank)
+{
+    mapPages(&Memory::state->prgBank[(addr >> 13) & 0x3], 0x2000, size,
+             rom->prgRom, rom->config.prgRomSize, bank);
+}
+
+void BankMapper::mapChr(u16 addr, size_t size, int bank)
+{
+    mapChrBackground(addr, size, bank);
+    mapChrSprites(addr, size, bank);
+}
+
+void BankMapper::mapChrBackground(u16 addr, size_t size, int bank)
+{
+    mapPages(&Memory::state->chrBank[(addr >> 10) & 0x7], 0x400, size,
+             _chr, _chrSize, bank);
+}
+
+void BankMapper::mapChrSprites(u16 addr, size_t size, int bank)
+{
+    mapPages(&Memory::state->chrSpriteBank[(addr >> 10) & 0x7], 0x400, size,
+             _chr, _chrSize, bank);
+}
+
+void BankMapper::storeChr(u16 addr, u8 val)
+{
+    if (_chrRam)
+        Memory::state->chrBank[addr >> 10][addr & 0x3ff] = val;
+}
+
+size_t BankMapper::getStateSize() const
+{
+    return _regsSize + (_chrRam ? _chrSize : 0);
+}
+
+void BankMapper::saveState(u8 *buf) const
+{
+    memcpy(buf, _regs, _regsSize);
+    if (_chrRam)
+        memcpy(buf + _regsSize, _chr, _chrSize);
+}
+
+void BankMapper::loadState(const u8 *buf)
+{
+    memcpy(_regs, buf, _regsSize);
+    if (_chrRam)
+        memcpy(_chr, buf + _regsSize, _chrSize);
+    remap();
+}
@@ -0,0 +1,93 @@
+
+#ifndef _BANKMAPPER_H_INCLUDED_
+#define _BANKMAPPER_H_INCLUDED_
+
+#include <cstddef>
+#include <string>
+
+#include "Mapper.h"
+#include "Rom.h"
+#include "type.h"
+
+/**
+ * @brief Base of the banked mappers: maps windows of the PRG-ROM and of the
+ *  CHR memory into the 8K PRG pages and 1K CHR pages of the instance (see
+ *  Memory::State), and saves the mapper registers.
+ *
+ *  The subclasses keep their registers in one structure, handed to the
+ *  constructor, and rebuild the whole mapping from it in \ref remap, called
+ *  after each register write changing the banks and on state restore.
+ *  The bank numbers are counted in units of the window size, and wrap
+ *  around the memory size; negative numbers count from the end of the
+ *  memory (-1 is the last bank).
+ */
+class BankMapper : public Mapper
+{
+public:
+    virtual ~BankMapper() {}
+
+    /**
+     * @brief Write to the CHR-RAM through the background pages. Writes to
+     *  the CHR-ROM are ignored.
+     */
+    void storeChr(u16 addr, u8 val);
+
+    size_t getStateSize() const;
+    void saveState(u8 *buf) const;
+    void loadState(const u8 *buf);
+
+protected:
+    /**
+     * @brief Install the mapper on the current instance: allocate the
+     *  CHR-RAM if the cartridge has no CHR-ROM, and apply the nametable
+     *  mirroring of the header.
+     * @param regs          register structure of the subclass, saved with
+     *                      the mapper state
+     * @param regsSize      size of the structure \p regs
+     */
+    BankMapper(Rom *rom, MapperType type, const std::string name,
+               void *regs, size_t regsSize);
+
+    /**
+     * @brief Map all the PRG and CHR windows from the current registers.
+     */
+    virtual void remap() = 0;
+
+    /**
+     * @brief Map the \p size bytes of PRG-ROM bank \p bank at the CPU
+     *  address \p addr (0x8000-0xffff). \p size is a multiple of 8K.
+     */
+    void mapPrg(u16 addr, size_t size, int bank);
+
+    /**
+     * @brief Map the \p size bytes of CHR bank \p bank at the PPU address
+     *  \p addr (0x0000-0x1fff), for the background and the sprites, or
+     *  for only one of them. \p size is a multiple of 1K.
+     */
+    void mapChr(u16 addr, size_t size, int bank);
+    void mapChrBackground(u16 addr, size_t size, int bank);
+    void mapChrSprites(u16 addr, size_t size, int bank);
+
+    /**
+     * @brief Size of the CHR memory, ROM or RAM.
+     */
+    size_t getChrSize() const { return _chrSize; }
+
+    /** CHR-ROM, or CHR-RAM allocated by the mapper. */
+    u8 *_chr;
+    size_t _chrSize;
+    bool _chrRam;
+
+private:
+    /**
+     * @brief Point the pages \p pages, of \p pageSize bytes, to the bank
+     *  \p bank of \p size bytes of the memory \p mem.
+     */
+    static void mapPages(u8 **pages, size_t pageSize, size_t size,
+                         const u8 *mem, size_t memSize, int bank);
+
+    void *_regs;
+    size_t _regsSize;
+};
+
+#endif /* _BANKMAPPER_H_INCLUDED_ */
@@ -0,0 +1,81 @@
+
+#include <cstring>
+#include <iostream>
+
+#include "Batch.h"
+#include "Core.h"
+#include "exception.h"
+#include "Memory.h"
+#include "N2C02State.h"
+
+Batch::Batch(const std::vector<std::string> &files, unsigned int threads)
+    : _pool(threads)
+{
+    Emulator *previous = Emulator::getCurrent();
+
+    try {
+        for (const std::string &file : files) {
+            _emulators.push_back(new Emulator(file.c_str()));
+            Core::reset();
+        }
+    } catch (...) {
+        for (Emulator *emulator : _emulators)
+            delete emulator;
+        if (previous != NULL)
+            previous->makeCurrent();
+        throw;
+    }
+    if (previous != NULL)
+        previous->makeCurrent();
+
+    _running.assign(_emulators.size(), true);
+    _frameSize = N2C02::getScreenWidth() * N2C02::getScreenHeight() *
+        sizeof(u32);
+    _stride = _frameSize + sizeof(Memory::State::ram);
+    _buffer.assign(_emulators.size() * _stride, 0);
+}
+
+Batch::~Batch()
+{
+    for (Emulator *emulator : _emulators)
+        delete emulator;
+}
+
+void Batch::runFrame(const u8 *inputs)
+{
+    _pool.run(_emulators.size(),
+        [this, inputs] (size_t i) { step(i, inputs); });
+}
+
+/**
+ * @brief Advance the instance \p i by one frame, on a worker thread.
+ */
+void Batch::step(size_t i, const u8 *inputs)
+{
+    if (!_running[i])
+        return;
+
+    Emulator *emulator = _emulators[i];
+    emulator->makeCurrent();
+    if (inputs != NULL)
+        emulator->joypad.setButtons(inputs[i]);
+    try {
+        Core::runFrame();
+    } catch (const std::exception &exc) {
+        std::cerr << "Fatal error (batch " << i << "): " << exc.what();
+        std::cerr << std::endl;
+        _running[i] = false;
+        return;
+    } catch (const char *msg) {
+        std::cerr << "Fatal error (batch " << i << "): " << msg << std::endl;
+        _running[i] = false;
+        return;
+    }
+
+    u8 *slot = &_buffer[i * _stride];
+    const u32 *frame = N2C02::getFramebuffer();
+    if (frame != NULL)
+        memcpy(slot, frame, _frameSize);
+    memcpy(slot + _frameSize, emulator->memory.ram,
+           sizeof(emulator->memory.ram));
+}
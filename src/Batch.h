@@ -0,0 +1,72 @@
+
+#ifndef _BATCH_H_INCLUDED_
+#define _BATCH_H_INCLUDED_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "type.h"
+#include "Emulator.h"
+#include "ThreadPool.h"
+
+/**
+ * @brief Set of emulator instances advanced in lockstep, one frame at a
+ *  time, on a pool of worker threads.
+ *
+ *  After each frame, the frame buffer and the CPU ram of every instance are
+ *  copied to a single contiguous buffer, made of one slot per instance:
+ *
+ *      slot i: pixels (getScreenWidth() x getScreenHeight() u32)
+ *              ram (0x800 bytes)
+ *
+ *  An instance stops at its first emulation error; its slot keeps the last
+ *  completed frame.
+ */
+class Batch
+{
+public:
+    /**
+     * @brief Load one instance per cartridge file in \p files, the same
+     *  file can be listed several times.
+     * @param threads       number of worker threads, 0 for one per
+     *                      hardware thread
+     * @throw InvalidRom    if one of the cartridges cannot be loaded
+     */
+    Batch(const std::vector<std::string> &files, unsigned int threads = 0);
+    ~Batch();
+
+    size_t getSize() const { return _emulators.size(); }
+    Emulator *getEmulator(size_t i) { return _emulators[i]; }
+    bool isRunning(size_t i) const { return _running[i]; }
+
+    /**
+     * @brief Run all the instances until their next frame, and copy their
+     *  outputs to the batch buffer.
+     * @param inputs        joypad buttons of each instance (see
+     *                      \ref Joypad::Joypad::setButtons), or NULL to
+     *                      keep the current buttons
+     */
+    void runFrame(const u8 *inputs = NULL);
+
+    const u8 *getBuffer() const { return _buffer.data(); }
+    size_t getStride() const { return _stride; }
+    const u32 *getFrame(size_t i) const {
+        return (const u32 *)&_buffer[i * _stride];
+    }
+    const u8 *getRam(size_t i) const {
+        return &_buffer[i * _stride + _frameSize];
+    }
+
+private:
+    void step(size_t i, const u8 *inputs);
+
+    std::vector<Emulator *> _emulators;
+    std::vector<char> _running;
+    std::vector<u8> _buffer;
+    size_t _frameSize;
+    size_t _stride;
+    ThreadPool _pool;
+};
+
+#endif /* _BATCH_H_INCLUDED_ */
@@ -15,6 +15,7 @@ public:
     u8 *getPtr() { return _data + _length; }
     const u8 *getPtr() const { return _data + _length; }
     size_t getLength() const { return _length; }
+    size_t getCapacity() const { return _capacity; }
 
     CodeBuffer &writeb(u8 byte);
     CodeBuffer &writeh(u16 half);
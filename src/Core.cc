@@ -2,14 +2,24 @@
 #include "type.h"
 #include "exception.h"
 #include "Core.h"
+#include "Audio.h"
+#include "Emulator.h"
 #include "Memory.h"
+#include "Mapper.h"
 #include "M6502State.h"
 #include "M6502Eval.h"
 #include "M6502Jit.h"
 #include "N2C02State.h"
+#include "RP2A03State.h"
 #include "Events.h"
+#include "Joypad.h"
+#include "Snapshot.h"
+#include "Timer.h"
+#include "Stats.h"
 
+#include <algorithm>
 #include <iostream>
+#include <cstring>
 #include <ctime>
 #include <chrono>
 #include <thread>
@@ -19,34 +29,221 @@ using namespace std;
 namespace Core
 {
 
+static bool jitEnabled = true;
+static Rewind *rewindBuffer = NULL;
+static Movie *movie = NULL;
+static unsigned int runAheadFrames = 0;
+static ulong frameLimit = 0;
+static std::function<void(ulong)> frameCallback;
+
+void setJit(bool enable)
+{
+    jitEnabled = enable;
+}
+
+void setRewind(Rewind *rewind)
+{
+    rewindBuffer = rewind;
+}
+
+void setMovie(Movie *newMovie)
+{
+    movie = newMovie;
+}
+
+void setRunAhead(unsigned int frames)
+{
+    runAheadFrames = frames;
+}
+
+void setFrameLimit(ulong frames)
+{
+    frameLimit = frames;
+}
+
+void setFrameCallback(std::function<void(ulong)> callback)
+{
+    frameCallback = callback;
+}
+
 /**
- * Emulation routine.
+ * @brief Capture the state of the completed frame, or restore the previous
+ *  one if the rewind key is held. The joypad buttons are not rewound.
  */
-void emulate()
+static void rewindFrame()
+{
+    if (!Events::isRewinding()) {
+        rewindBuffer->capture();
+        return;
+    }
+    bool buttons[Joypad::JOYPAD_BUTTON_COUNT];
+    memcpy(buttons, Joypad::currentJoypad->buttons, sizeof(buttons));
+    rewindBuffer->rewind();
+    memcpy(Joypad::currentJoypad->buttons, buttons, sizeof(buttons));
+}
+
+void reset()
 {
     M6502::state->clear();
     M6502::state->reset();
-    N2C02::state.clear();
+    N2C02::state->clear();
+    RP2A03::state->clear();
+}
+
+ulong runFrame()
+{
+    ulong frame = N2C02::state->frame;
+
+    while (N2C02::state->frame == frame) {
+        /* Catch interrupts */
+        if (M6502::state->nmi) {
+            M6502::Eval::triggerNMI();
+        } else
+        if (M6502::state->irq) {
+            M6502::Eval::triggerIRQ();
+        }
+        /* Try jit */
+        uint64_t ticks = Stats::ticks();
+        ulong cycles = M6502::state->cycles;
+        M6502::Instruction *instr = NULL;
+        bool interpret = true;
+        if (jitEnabled) {
+            instr = M6502::cache->cache(M6502::state->regs.pc);
+            ticks = Stats::charge(Stats::SUBSYSTEM_COMPILER, ticks);
+        }
+        if (instr != NULL) {
+            /*
+             * Stop at the next mapper or APU interrupt, or at the start of
+             * the vertical blank, on the instruction boundary where the
+             * interpreter would see it.
+             */
+            ulong deadline = std::min(
+                std::min(currentMapper->irqDeadline, RP2A03::state->deadline),
+                N2C02::predictDot(241, 1));
+            long quantum = 0;
+            if (deadline > cycles)
+                quantum = std::min(deadline - cycles, 1000ul);
+            M6502::state->jitLimit = 0;
+            instr->run(quantum);
+            if (M6502::state->cycles != cycles) {
+                Stats::counters.jitRuns++;
+                Stats::counters.jitCycles += M6502::state->cycles - cycles;
+                interpret = false;
+            }
+            ticks = Stats::charge(Stats::SUBSYSTEM_JIT, ticks);
+        }
+        /* Fallback on interpreter */
+        if (interpret) {
+            M6502::Eval::step();
+            Stats::counters.interpreterInstructions++;
+            Stats::counters.interpreterCycles += M6502::state->cycles - cycles;
+            ticks = Stats::charge(Stats::SUBSYSTEM_INTERPRETER, ticks);
+        }
+        N2C02::sync(0);
+        if (M6502::state->cycles >= currentMapper->irqDeadline)
+            currentMapper->sync();
+        ticks = Stats::charge(Stats::SUBSYSTEM_PPU, ticks);
+        /* The APU is only updated when it may raise an interrupt. */
+        if (M6502::state->cycles >= RP2A03::state->deadline) {
+            RP2A03::sync(0);
+            Stats::charge(Stats::SUBSYSTEM_APU, ticks);
+        }
+    }
+    uint64_t ticks = Stats::ticks();
+    RP2A03::endFrame();
+    Stats::charge(Stats::SUBSYSTEM_APU, ticks);
+    return N2C02::state->frame;
+}
+
+Frame runFrame(u8 inputs)
+{
+    Frame frame;
+    Joypad::currentJoypad->setButtons(inputs);
+    frame.number = runFrame();
+    frame.pixels = N2C02::getFramebuffer();
+    frame.width = N2C02::getScreenWidth();
+    frame.height = N2C02::getScreenHeight();
+    return frame;
+}
+
+/**
+ * @brief Emulate the next \ref runAheadFrames frames with the current
+ *  inputs, present the last one, and return to the state of the completed
+ *  frame.
+ */
+static void runAhead()
+{
+    std::vector<u8> &snapshot = Emulator::getCurrent()->runAheadSnapshot;
+    Snapshot::save(snapshot);
+    /* The predicted frames are not heard. */
+    RP2A03::setOutputEnabled(false);
+    for (unsigned int i = 1; i <= runAheadFrames; i++) {
+        N2C02::setFrameSkip(i < runAheadFrames);
+        runFrame();
+    }
+    RP2A03::setOutputEnabled(true);
+    Snapshot::load(snapshot);
+}
+
+/**
+ * Emulation routine.
+ */
+void emulate()
+{
+    reset();
+    if (rewindBuffer != NULL)
+        rewindBuffer->clear();
+
+#ifndef PPU_MAX_FPS
+    FramePacer pacer(N2C02_FRAME_RATE_NUM, N2C02_FRAME_RATE_DEN);
+#endif
+    Stats::reset();
 
     try {
         while (true) {
-            /* Catch interrupts */
-            if (M6502::state->nmi) {
-                M6502::Eval::triggerNMI();
-            } else
-            if (M6502::state->irq) {
-                M6502::Eval::triggerIRQ();
+            /* Input changes only take effect between two frames. */
+            Events::applyInput(Joypad::currentJoypad);
+            if (movie != NULL)
+                movie->startFrame();
+            /* With run-ahead, only the predicted frame is presented. */
+            N2C02::setFrameSkip(runAheadFrames > 0);
+            ulong frame = runFrame();
+            uint64_t ticks = Stats::ticks();
+            if (movie != NULL) {
+                movie->endFrame();
+                if (movie->isFinished())
+                    Events::quit();
             }
-            /* Try jit */
-            M6502::Instruction *instr = M6502::cache.cache(M6502::state->regs.pc);
-            if (instr != NULL)
-                instr->run(1000);
-            /* Fallback on interpreter */
-            M6502::Eval::step();
-            N2C02::sync(0);
-            while (Events::isPaused() && !Events::isQuit()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (runAheadFrames > 0) {
+                ticks = Stats::charge(Stats::SUBSYSTEM_IDLE, ticks);
+                runAhead();
+                ticks = Stats::charge(Stats::SUBSYSTEM_RUNAHEAD, ticks);
+            }
+            /*
+             * Output the samples of the frame: a real time audio device
+             * paces the emulation, the frame timer is then not used.
+             */
+            Audio::endFrame();
+#ifndef PPU_MAX_FPS
+            /*
+             * Adjust the frame rate once per frame, outside of the PPU
+             * emulation: the frame itself is presented asynchronously.
+             */
+            if (!Audio::isSynchronized())
+                pacer.wait();
+#endif
+            Stats::frame();
+            if (frameCallback)
+                frameCallback(frame);
+            if (rewindBuffer != NULL && movie == NULL) {
+                ticks = Stats::charge(Stats::SUBSYSTEM_IDLE, ticks);
+                rewindFrame();
+                ticks = Stats::charge(Stats::SUBSYSTEM_REWIND, ticks);
             }
+            Events::waitWhilePaused();
+            Stats::charge(Stats::SUBSYSTEM_IDLE, ticks);
+            if (frameLimit && frame >= frameLimit)
+                Events::quit();
             if (Events::isQuit()) {
                 M6502::backtrace();
                 break;
@@ -2,11 +2,95 @@
 #ifndef _CORE_H_INCLUDED_
 #define _CORE_H_INCLUDED_
 
+#include <functional>
+
+#include "type.h"
+#include "Movie.h"
+#include "Rewind.h"
+
 namespace Core
 {
 
 /**
- * Emulation rountine.
+ * @brief Enable or disable the recompiler (enabled by default). When
+ *  disabled, all instructions are executed by the interpreter.
+ */
+void setJit(bool enable);
+
+/**
+ * @brief Install a rewind buffer, which captures the state at the end of
+ *  every frame, and restores the previous states while the rewind event
+ *  is raised. NULL disables the rewind.
+ */
+void setRewind(Rewind *rewind);
+
+/**
+ * @brief Install an input movie, recorded or played back from power on.
+ *  The emulation stops at the end of the playback, or on an audit failure.
+ *  The rewind is disabled while a movie is installed. NULL removes the
+ *  movie.
+ */
+void setMovie(Movie *movie);
+
+/**
+ * @brief Set the number of frames emulated ahead of the current frame
+ *  (0 to disable). After each frame, the following \p frames frames are
+ *  predicted with the current inputs and the last one is presented, then
+ *  the state of the current frame is restored: the input latency is
+ *  reduced by \p frames frames, for \p frames additional frames emulated.
+ */
+void setRunAhead(unsigned int frames);
+
+/**
+ * @brief Stop the emulation after \p frames emulated frames, whether they
+ *  are presented or not (0 for no limit). Run-ahead frames are not
+ *  counted.
+ */
+void setFrameLimit(ulong frames);
+
+/**
+ * @brief Install a callback invoked at the end of every emulated frame,
+ *  with the number of completed frames.
+ */
+void setFrameCallback(std::function<void(ulong)> callback);
+
+/**
+ * @brief Outputs of an emulated frame.
+ */
+struct Frame {
+    /** Number of completed frames. */
+    ulong number;
+    /**
+     * Pixels of the frame, NULL if the instance is attached to the video
+     * backend. Valid until the emulation of the instance is resumed.
+     */
+    const u32 *pixels;
+    size_t width;
+    size_t height;
+};
+
+/**
+ * @brief Reset the CPU and the PPU of the current instance.
+ */
+void reset();
+
+/**
+ * @brief Run the current instance until the start of the next vertical
+ *  blanking interval. Emulation errors are thrown to the caller.
+ * @return              the number of completed frames
+ */
+ulong runFrame();
+
+/**
+ * @brief Set the joypad buttons of the current instance to \p inputs (see
+ *  \ref Joypad::Joypad::setButtons), and run it for one frame. Does not
+ *  wait or poll events: suitable for embedding the emulator.
+ */
+Frame runFrame(u8 inputs);
+
+/**
+ * Emulation rountine, runs the emulator instance current on the calling
+ * thread (see \ref Emulator::makeCurrent).
  */
 void emulate();
 
@@ -0,0 +1,91 @@
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "Emulator.h"
+
+thread_local Emulator *Emulator::_current = NULL;
+
+/**
+ * @brief Install the instance \p emulator (or none if NULL) as the target
+ *  of the emulation functions on the calling thread.
+ */
+static void select(Emulator *emulator)
+{
+    if (emulator == NULL) {
+        Memory::state = NULL;
+        M6502::state = NULL;
+        M6502::cache = NULL;
+        N2C02::makeCurrent(NULL, NULL);
+        RP2A03::makeCurrent(NULL, NULL);
+        Joypad::currentJoypad = NULL;
+        currentRom = NULL;
+        currentMapper = NULL;
+        return;
+    }
+    Memory::state = &emulator->memory;
+    M6502::state = &emulator->cpu;
+    M6502::cache = emulator->cache.get();
+    N2C02::makeCurrent(&emulator->ppu, emulator->ppuContext);
+    RP2A03::makeCurrent(&emulator->apu, emulator->apuContext);
+    Joypad::currentJoypad = &emulator->joypad;
+    currentRom = emulator->rom;
+    currentMapper = emulator->mapper;
+}
+
+Emulator::Emulator(const char *file)
+    : ppuContext(N2C02::createContext()),
+      apuContext(RP2A03::createContext()), rom(NULL), mapper(NULL)
+{
+    memset(&memory, 0, sizeof(memory));
+    makeCurrent();
+
+    /*
+     * The mapper is created with the ROM, and configures the memories and
+     * the nametable mirroring of the current instance.
+     */
+    try {
+        rom = new Rom(file);
+    } catch (...) {
+        N2C02::destroyContext(ppuContext);
+        RP2A03::destroyContext(apuContext);
+        _current = NULL;
+        select(NULL);
+        throw;
+    }
+    mapper = currentMapper;
+    cache = rom->image->getCache();
+    makeCurrent();
+}
+
+Emulator::~Emulator()
+{
+    if (_current == this) {
+        _current = NULL;
+        select(NULL);
+    }
+    delete mapper;
+    delete rom;
+    N2C02::destroyContext(ppuContext);
+    RP2A03::destroyContext(apuContext);
+}
+
+void *Emulator::operator new(size_t size)
+{
+    void *ptr;
+    if (posix_memalign(&ptr, 0x100, size) != 0)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void Emulator::operator delete(void *ptr)
+{
+    free(ptr);
+}
+
+void Emulator::makeCurrent()
+{
+    _current = this;
+    select(this);
+}
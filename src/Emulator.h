@@ -0,0 +1,82 @@
+
+#ifndef _EMULATOR_H_INCLUDED_
+#define _EMULATOR_H_INCLUDED_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "type.h"
+#include "Joypad.h"
+#include "Mapper.h"
+#include "Memory.h"
+#include "Rom.h"
+#include "M6502State.h"
+#include "M6502Jit.h"
+#include "N2C02State.h"
+#include "RP2A03State.h"
+
+/**
+ * @brief Emulator instance: one console with its cartridge, and all the
+ *  state of the emulated machine.
+ *
+ *  The emulation functions (Core, Memory, M6502, N2C02, RP2A03, ...) operate on the
+ *  instance made current on the calling thread with \ref makeCurrent, so that
+ *  independent consoles can run in parallel on separate threads. An instance
+ *  must not be current on two threads at the same time.
+ *
+ *  The recompiled code addresses the instance memories relative to the
+ *  instance base register, loaded with the address of \ref memory ; the
+ *  other members are reached at the same offsets in every instance.
+ */
+class Emulator
+{
+public:
+    /**
+     * @brief Load the cartridge \p file, and make the new instance current
+     *  on the calling thread.
+     * @throw InvalidRom    if the cartridge cannot be loaded
+     */
+    Emulator(const char *file);
+    ~Emulator();
+
+    /* The CPU ram must be aligned on 0x100. */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
+    /**
+     * @brief Select this instance for the emulation functions called from
+     *  the calling thread.
+     */
+    void makeCurrent();
+
+    /**
+     * @brief Return the instance current on the calling thread, or NULL.
+     */
+    static Emulator *getCurrent() { return _current; }
+
+    /** CPU memories, first member: base of the recompiled code. */
+    Memory::State memory;
+    M6502::State cpu;
+    N2C02::State ppu;
+    N2C02::Context *ppuContext;
+    RP2A03::State apu;
+    RP2A03::Context *apuContext;
+    Joypad::Joypad joypad;
+    Rom *rom;
+    Mapper *mapper;
+
+    /**
+     * Recompiled code: shared with the other instances running the same
+     * cartridge.
+     */
+    std::shared_ptr<M6502::InstructionCache> cache;
+
+    /** State restored after the run-ahead frames, see \ref Core::setRunAhead. */
+    std::vector<u8> runAheadSnapshot;
+
+private:
+    static thread_local Emulator *_current;
+};
+
+#endif /* _EMULATOR_H_INCLUDED_ */
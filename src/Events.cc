@@ -1,147 +1,79 @@
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <iostream>
-#include <thread>
-#include <map>
-
-#include <SDL2/SDL.h>
+#include <mutex>
 
 #include "Events.h"
-#include "Joypad.h"
-
-using namespace Joypad;
-using namespace Events;
+#include "InputQueue.h"
 
 namespace Events {
 
-static std::thread *currentThread = NULL;
-static std::map<std::pair<int, int>, EventHandler *> keyboardEventHandlers;
-static bool quitEvent = false;
-static bool pauseEvent = false;
-
-class CallbackEventHandler : public EventHandler
-{
-public:
-    CallbackEventHandler(std::function<void()> &callback)
-        : callback(callback) {}
-    ~CallbackEventHandler() {}
-
-    void operator()(SDL_Event &event) {
-        (void)event;
-        callback();
-    }
-
-    std::function<void()> callback;
-};
-
-class SetterEventHandler : public EventHandler
-{
-public:
-    SetterEventHandler(bool *ptr) : ptr(ptr) {}
-    ~SetterEventHandler() {}
+static Backend *currentBackend = NULL;
+static std::atomic<bool> quitEvent(false);
+static std::atomic<bool> pauseEvent(false);
+static std::atomic<bool> rewindEvent(false);
 
-    void operator()(SDL_Event &event) {
-        *ptr = (event.type == SDL_KEYDOWN);
-    }
+/* Joypad button changes, from the event thread to the emulation thread. */
+static InputQueue inputQueue;
 
-    bool *ptr;
-};
+/* Wakes up the threads waiting for the end of the pause. */
+static std::mutex pauseLock;
+static std::condition_variable pauseCond;
 
-static void bindKeyboardEvent(int type, int sym, EventHandler *handler)
+void setBackend(Backend *backend)
 {
-    std::pair<int, int> key(type, sym);
-    EventHandler *oldHandler = keyboardEventHandlers[key];
-    if (oldHandler != NULL && oldHandler != handler)
-        delete oldHandler;
-    keyboardEventHandlers[key] = handler;
+    currentBackend = backend;
 }
 
 /**
- * @brief Register a callback for the specified keyboard event.
- * @param callback      event callback
+ * @brief Reset the event flags and start the installed backend.
  */
-void bindKeyboardEvent(int type, int sym, std::function<void()> callback)
+void init()
 {
-    bindKeyboardEvent(type, sym, new CallbackEventHandler(callback));
+    quitEvent = false;
+    pauseEvent = false;
+    rewindEvent = false;
+    if (currentBackend != NULL && currentBackend->init() < 0) {
+        std::cerr << "failed to start the event backend" << std::endl;
+        quit();
+    }
 }
 
-/**
- * @brief Register a callback for the specified keyboard event.
- *
- *  The callback will set the status variable
- *  accordingly (1 key down, 0 key up).
- *
- * @param callback      event callback
- */
-void bindKeyboardEvent(int sym, bool *status)
+void shutdown()
 {
-    bindKeyboardEvent(SDL_KEYUP, sym, new SetterEventHandler(status));
-    bindKeyboardEvent(SDL_KEYDOWN, sym, new SetterEventHandler(status));
+    if (currentBackend != NULL)
+        currentBackend->quit();
 }
 
 /**
- * @brief Wait for (and handle) SDL keyboard events.
+ * @brief Indicate an quit condition in one of thr threads was raised.
  */
-static void handleEvents()
+void quit()
 {
-    std::cerr << "Event thread started" << std::endl;
-    /* Check for joypad events. */
-    SDL_Event event;
-    while (true)
-    {
-        int ret = SDL_WaitEvent(&event);
-        if (ret == 0) {
-            if (isQuit())
-                return;
-            std::cerr << "Error waiting for SDL events (";
-            std::cerr << SDL_GetError() << ")" << std::endl;
-            continue;
-        }
-
-        switch (event.type) {
-            case SDL_KEYUP: {
-                std::pair<int, int> key(SDL_KEYUP, event.key.keysym.sym);
-                EventHandler *handler = keyboardEventHandlers[key];
-                if (handler != NULL)
-                    (*handler)(event);
-                break;
-            }
-            case SDL_KEYDOWN: {
-                if (event.key.repeat != 0)
-                    break;
-                std::pair<int, int> key(SDL_KEYDOWN, event.key.keysym.sym);
-                EventHandler *handler = keyboardEventHandlers[key];
-                if (handler != NULL)
-                    (*handler)(event);
-                break;
-            }
-            case SDL_QUIT:
-                std::cerr << "Quitting..." << std::endl;
-                quit();
-                return;
-            default:
-                break;
-        }
-    }
+    std::lock_guard<std::mutex> lock(pauseLock);
+    quitEvent = true;
+    pauseCond.notify_all();
 }
 
 /**
- * @brief Start a thread execlusively to handle events.
+ * @brief Toggle the pause state.
  */
-void init()
+void pause()
 {
-    if (currentThread == NULL)
-        currentThread = new std::thread(handleEvents);
-    quitEvent = false;
-    bindKeyboardEvent(SDL_KEYUP, SDLK_p,
-        [](void) { pauseEvent = !pauseEvent; });
+    std::lock_guard<std::mutex> lock(pauseLock);
+    pauseEvent = !pauseEvent.load();
+    pauseCond.notify_all();
 }
 
 /**
- * @brief Indicate an quit condition in one of thr threads was raised.
+ * @brief Start or stop rewinding the emulation.
  */
-void quit()
+void rewind(bool active)
 {
-    quitEvent = true;
+    rewindEvent = active;
 }
 
 /**
@@ -160,4 +92,48 @@ bool isPaused()
     return pauseEvent;
 }
 
+/**
+ * @brief Check whether the rewind key is held.
+ */
+bool isRewinding()
+{
+    return rewindEvent;
+}
+
+static inline uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void pushButton(Joypad::JoypadButton button, bool pressed)
+{
+    InputEvent event = { now(), (u8)button, pressed };
+    if (!inputQueue.push(event))
+        std::cerr << "input queue overflow, event dropped" << std::endl;
+}
+
+/**
+ * Only the events received before the call are applied: events pushed
+ * concurrently are left for the next frame.
+ */
+void applyInput(Joypad::Joypad *joypad)
+{
+    uint64_t time = now();
+    InputEvent event;
+    while (inputQueue.peek(event) && event.timestamp <= time) {
+        inputQueue.pop(event);
+        if (event.pressed)
+            joypad->buttonDown((Joypad::JoypadButton)event.button);
+        else
+            joypad->buttonUp((Joypad::JoypadButton)event.button);
+    }
+}
+
+void waitWhilePaused()
+{
+    std::unique_lock<std::mutex> lock(pauseLock);
+    pauseCond.wait(lock, [] { return !pauseEvent || quitEvent; });
+}
+
 };
@@ -2,28 +2,75 @@
 #ifndef _EVENTS_H_INCLUDED_
 #define _EVENTS_H_INCLUDED_
 
-#include <functional>
-#include <SDL2/SDL.h>
-
 #include "type.h"
+#include "Joypad.h"
 
 namespace Events {
 
-class EventHandler
+/**
+ * Event source backend (window system, keyboard...). The backend is
+ * expected to push the joypad buttons with \ref pushButton, and raise the
+ * quit and pause events.
+ */
+class Backend
 {
 public:
-    EventHandler() {};
-    virtual ~EventHandler() {};
-    virtual void operator()(SDL_Event &event) {};
+    Backend() {}
+    virtual ~Backend() {}
+
+    /**
+     * @brief Start listening for events.
+     * @return              0 on success, -1 on failure
+     */
+    virtual int init() = 0;
+
+    /**
+     * @brief Stop listening for events, and release the resources of the
+     *  backend.
+     */
+    virtual void quit() {}
 };
 
-void bindKeyboardEvent(int type, int sym, std::function<void()> callback);
-void bindKeyboardEvent(int sym, bool *status);
+/**
+ * @brief Install an event backend. Must be called before \ref init.
+ *  No backend is installed by default: the emulator then only stops on
+ *  an explicit call to \ref quit.
+ */
+void setBackend(Backend *backend);
 
 void init();
+
+/**
+ * @brief Stop the installed backend, once the emulation and the other
+ *  backends have been stopped.
+ */
+void shutdown();
+
 void quit();
+void pause();
+void rewind(bool active);
 bool isQuit();
 bool isPaused();
+bool isRewinding();
+
+/**
+ * @brief Queue a joypad button change, from the event thread. The change
+ *  is applied to the joypad by the emulation thread, at the next frame
+ *  boundary.
+ */
+void pushButton(Joypad::JoypadButton button, bool pressed);
+
+/**
+ * @brief Apply the queued button changes to \p joypad, from the emulation
+ *  thread.
+ */
+void applyInput(Joypad::Joypad *joypad);
+
+/**
+ * @brief Block the calling thread while the emulation is paused, return
+ *  as soon as the pause or quit event is raised.
+ */
+void waitWhilePaused();
 
 };
 
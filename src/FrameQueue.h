@@ -0,0 +1,85 @@
+
+#ifndef _FRAMEQUEUE_H_INCLUDED_
+#define _FRAMEQUEUE_H_INCLUDED_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "type.h"
+
+/**
+ * @brief Triple buffered frame queue, with a single producer (the
+ *  emulation thread) and a single consumer (the presentation thread).
+ *
+ *  Each side owns one buffer ; the third one is exchanged atomically
+ *  on \ref publish and \ref consume, so neither side ever waits for the
+ *  other. The producer overwrites frames the consumer was too slow
+ *  to pick up.
+ */
+class FrameQueue
+{
+public:
+    FrameQueue() : _size(0), _back(0), _front(1), _middle(2) {}
+    ~FrameQueue() {}
+
+    /**
+     * @brief Allocate the three frame buffers.
+     * @param size          number of pixels in a frame
+     */
+    void resize(size_t size) {
+        _size = size;
+        _buffers.assign(3 * size, 0);
+        _back = 0;
+        _front = 1;
+        _middle.store(2);
+    }
+
+    /** @brief Return the number of pixels in a frame. */
+    size_t getSize() const { return _size; }
+
+    /** @brief Return the buffer owned by the producer. */
+    u32 *getBack() { return &_buffers[_back * _size]; }
+
+    /** @brief Return the buffer owned by the consumer. */
+    const u32 *getFront() const { return &_buffers[_front * _size]; }
+
+    /**
+     * @brief Make the producer buffer available to the consumer, and take
+     *  ownership of the previously exchanged buffer.
+     */
+    void publish() {
+        _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel)
+            & INDEX;
+    }
+
+    /** @brief Check whether a frame was published since the last consume. */
+    bool isFresh() const {
+        return (_middle.load(std::memory_order_acquire) & FRESH) != 0;
+    }
+
+    /**
+     * @brief Take ownership of the last published frame.
+     * @return              false if no new frame was published since the
+     *                      last call, in which case the front buffer
+     *                      is unchanged
+     */
+    bool consume() {
+        if (!isFresh())
+            return false;
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+private:
+    static const unsigned int INDEX = 0x3;
+    static const unsigned int FRESH = 0x4;
+
+    std::vector<u32> _buffers;
+    size_t _size;
+    unsigned int _back;
+    unsigned int _front;
+    std::atomic<unsigned int> _middle;
+};
+
+#endif /* _FRAMEQUEUE_H_INCLUDED_ */
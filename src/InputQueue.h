@@ -0,0 +1,80 @@
+
+#ifndef _INPUTQUEUE_H_INCLUDED_
+#define _INPUTQUEUE_H_INCLUDED_
+
+#include <atomic>
+#include <cstddef>
+
+#include "type.h"
+
+/**
+ * Joypad button change, stamped with the time it was received.
+ */
+struct InputEvent {
+    /** Steady clock time, in nanoseconds. */
+    uint64_t timestamp;
+    u8 button;
+    bool pressed;
+};
+
+/**
+ * @brief Lock-free ring of input events, with a single producer (the event
+ *  thread) and a single consumer (the emulation thread).
+ *
+ *  Each side only writes its own index ; the release store of the index
+ *  publishes the events written (resp. frees the slots read) before it.
+ *  Events pushed to a full queue are dropped.
+ */
+class InputQueue
+{
+public:
+    InputQueue() : _head(0), _tail(0) {}
+    ~InputQueue() {}
+
+    /**
+     * @brief Append an event, return false if the queue is full.
+     */
+    bool push(const InputEvent &event) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) >= CAPACITY)
+            return false;
+        _events[tail % CAPACITY] = event;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest event, return false if the queue is empty.
+     */
+    bool pop(InputEvent &event) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+            return false;
+        event = _events[head % CAPACITY];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Return the oldest event without removing it, return false if
+     *  the queue is empty.
+     */
+    bool peek(InputEvent &event) const {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+            return false;
+        event = _events[head % CAPACITY];
+        return true;
+    }
+
+private:
+    static const size_t CAPACITY = 64;
+
+    InputEvent _events[CAPACITY];
+    /** Index of the next event to read, written by the consumer. */
+    alignas(64) std::atomic<size_t> _head;
+    /** Index of the next event to write, written by the producer. */
+    alignas(64) std::atomic<size_t> _tail;
+};
+
+#endif /* _INPUTQUEUE_H_INCLUDED_ */
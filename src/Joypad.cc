@@ -1,10 +1,8 @@
 #include <cstdlib>
 #include <iostream>
-#include <functional>
 #include <string.h>
 
 #include "Joypad.h"
-#include "Events.h"
 
 using namespace Joypad;
 
@@ -13,44 +11,8 @@ namespace Joypad {
 Joypad::Joypad() : strobe(false), reads(0)
 {
     memset(buttons, 0, sizeof(buttons));
-
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_w,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_A));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_w,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_A));
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_x,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_B));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_x,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_B));
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_SPACE,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_SELECT));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_SPACE,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_SELECT));
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_RETURN,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_START));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_RETURN,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_START));
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_UP,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_UP));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_UP,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_UP));
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_DOWN,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_DOWN));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_DOWN,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_DOWN));
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_LEFT,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_LEFT));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_LEFT,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_LEFT));
-    Events::bindKeyboardEvent(SDL_KEYDOWN, SDLK_RIGHT,
-        std::bind(&Joypad::buttonDown, this, JOYPAD_BUTTON_RIGHT));
-    Events::bindKeyboardEvent(SDL_KEYUP, SDLK_RIGHT,
-        std::bind(&Joypad::buttonUp, this, JOYPAD_BUTTON_RIGHT));
 }
 
-Joypad::~Joypad()
-{}
-
 /**
  * @brief Read controller data
  * @return a button status
@@ -90,6 +52,41 @@ void Joypad::buttonDown(JoypadButton button)
         buttons[button] = 1;
 }
 
-Joypad *currentJoypad = NULL;
+u8 Joypad::getButtons() const
+{
+    u8 mask = 0;
+    for (int i = 0; i < JOYPAD_BUTTON_COUNT; i++)
+        mask |= (u8)buttons[i] << i;
+    return mask;
+}
+
+void Joypad::setButtons(u8 mask)
+{
+    for (int i = 0; i < JOYPAD_BUTTON_COUNT; i++)
+        buttons[i] = (mask >> i) & 0x1;
+}
+
+thread_local Joypad *currentJoypad = NULL;
+
+void scriptInput(Joypad *joypad, u32 seed, ulong frame)
+{
+    /* Integer hash of the seed and the input period. */
+    u32 h = seed ^ ((u32)(frame >> 3) * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    joypad->buttons[JOYPAD_BUTTON_A] = h & 0x1;
+    joypad->buttons[JOYPAD_BUTTON_B] = (h >> 1) & 0x1;
+    joypad->buttons[JOYPAD_BUTTON_SELECT] = 0;
+    joypad->buttons[JOYPAD_BUTTON_START] = (frame % 120) < 4;
+    /* At most one direction on each axis. */
+    joypad->buttons[JOYPAD_BUTTON_UP] = (h >> 2 & 0x3) == 1;
+    joypad->buttons[JOYPAD_BUTTON_DOWN] = (h >> 2 & 0x3) == 2;
+    joypad->buttons[JOYPAD_BUTTON_LEFT] = (h >> 4 & 0x3) == 1;
+    joypad->buttons[JOYPAD_BUTTON_RIGHT] = (h >> 4 & 0x3) == 2;
+}
 
 };
@@ -22,20 +22,37 @@ class Joypad
 {
 public:
     Joypad();
-    ~Joypad();
+    /* Trivial destructor: the state is saved and restored by copy. */
+    ~Joypad() = default;
 
     u8 readRegister();
     void writeRegister(u8 val);
     void buttonUp(JoypadButton button);
     void buttonDown(JoypadButton button);
 
+    /**
+     * @brief Return (resp. set) the state of all the buttons, as a mask
+     *  where bit i is set if the button i is pressed.
+     */
+    u8 getButtons() const;
+    void setButtons(u8 mask);
+
     /** Joypad status registers. */
     bool buttons[JOYPAD_BUTTON_COUNT];
     bool strobe;
     unsigned int reads;
 };
 
-extern Joypad *currentJoypad;
+/** Joypad of the instance running on the calling thread. */
+extern thread_local Joypad *currentJoypad;
+
+/**
+ * @brief Set the buttons of \p joypad from a deterministic input script,
+ *  used to benchmark the emulation. Start is pressed for a few frames every
+ *  two seconds to get through the menus ; the other buttons follow
+ *  a pseudo-random sequence derived from \p seed, held for 8 frames.
+ */
+void scriptInput(Joypad *joypad, u32 seed, ulong frame);
 
 };
 
@@ -2,6 +2,8 @@
 #ifndef _MAPPER_H_INCLUDED_
 #define _MAPPER_H_INCLUDED_
 
+#include <climits>
+#include <cstddef>
 #include <string>
 
 #include "Rom.h"
@@ -9,24 +11,117 @@
 
 class Rom;
 
+/**
+ * Concrete mapper classes, for which the emulation hot paths are
+ * instantiated (see mappers/dispatch.h). Mappers of type MAPPER_OTHER are
+ * called through the virtual methods.
+ */
+enum MapperType {
+    MAPPER_OTHER,
+    MAPPER_NROM,
+    MAPPER_MMC1,
+    MAPPER_UXROM,
+    MAPPER_CNROM,
+    MAPPER_MMC3,
+    MAPPER_MMC5,
+    MAPPER_AXROM,
+    MAPPER_MMC2,
+    MAPPER_MMC4,
+    MAPPER_GXROM,
+};
+
 class Mapper
 {
 public:
-    ~Mapper() {}
+    virtual ~Mapper() {}
 
     virtual void storePrg(u16 addr, u8 val) = 0;
     virtual void storeChr(u16 addr, u8 val) = 0;
 
+    /*
+     * Hooks resolved on the concrete class (see mappers/dispatch.h): the
+     * emulation loops of the mappers which do not define them do not
+     * check for them.
+     */
+
+    /**
+     * Set by the mappers watching the PPU address line A12: \ref riseA12
+     * is called on each rise of A12 during rendering, as seen through the
+     * M2 filter of the boards (the short pulses of the nametable fetches
+     * are ignored).
+     */
+    static const bool watchesA12 = false;
+    void riseA12() {}
+
+    /**
+     * Set by the mappers watching the pattern fetches: \ref fetchChr is
+     * called after each background and sprite pattern fetch, with the
+     * address of the high bitplane byte.
+     */
+    static const bool watchesChr = false;
+    void fetchChr(u16 addr) { (void)addr; }
+
+    /**
+     * @brief Called after a write to PPUCTRL or PPUMASK, which may change
+     *  the pattern of A12 rises (see N2C02::getA12RiseDot) and the sprite
+     *  size.
+     */
+    void updatePpu() {}
+
+    /**
+     * @brief Access the expansion area, addresses 0x4020-0x5fff. Unmapped
+     *  on most boards (open bus).
+     */
+    u8 loadExp(u16 addr, long quantum) {
+        (void)addr; (void)quantum;
+        return 0;
+    }
+    void storeExp(u16 addr, u8 val, long quantum) {
+        (void)addr; (void)val; (void)quantum;
+    }
+
+    /**
+     * @brief Called when the CPU reaches \ref irqDeadline: raise the
+     *  interrupt due if any, and schedule the next one.
+     */
+    virtual void sync() {}
+
+    /**
+     * @brief Return the size of the mapper state saved by \ref saveState.
+     *  Mappers without registers have an empty state.
+     */
+    virtual size_t getStateSize() const { return 0; }
+
+    /**
+     * @brief Save the mapper registers, and the CHR-RAM if any.
+     */
+    virtual void saveState(u8 *buf) const { (void)buf; }
+
+    /**
+     * @brief Restore the mapper registers, and reconfigure the memory
+     *  banks and the nametable mirroring accordingly.
+     */
+    virtual void loadState(const u8 *buf) { (void)buf; }
+
     Rom *rom;
+    const MapperType type;
+    /**
+     * CPU cycle at which the mapper asserts its next interrupt, ULONG_MAX
+     * if none is scheduled. The recompiled code does not run past it, and
+     * \ref sync is called when it is reached.
+     */
+    ulong irqDeadline;
     const std::string name;
 
 protected:
-    Mapper(Rom *rom, const std::string name) : rom(rom), name(name) { }
+    Mapper(Rom *rom, MapperType type, const std::string name)
+        : rom(rom), type(type), irqDeadline(ULONG_MAX), name(name) { }
 };
 
 typedef Mapper* (*MapperConstructor)(Rom *rom);
 
 extern MapperConstructor mappers[];
-extern Mapper *currentMapper;
+/** Mapper of the instance running on the calling thread. */
+extern thread_local Mapper *currentMapper;
 
 #endif /* _MAPPER_H_INCLUDED_ */
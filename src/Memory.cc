@@ -3,7 +3,9 @@
 
 #include "Memory.h"
 #include "Mapper.h"
+#include "mappers/dispatch.h"
 #include "N2C02State.h"
+#include "RP2A03State.h"
 #include "M6502State.h"
 #include "Joypad.h"
 
@@ -11,38 +13,33 @@ using namespace Memory;
 
 namespace Memory {
 
-/**
- * Internal CPU ram, of size 2048. Force the alignment to be 0x100, this has
- * consequences on the x86 binary code re-compilation.
- */
-__attribute__((aligned(0x100)))
-u8 ram[0x800];
-
-/**
- * PRG rom banks, addresses 0x8000-0xffff
- */
-size_t prgBankSize;
-uint prgBankShift;
-u16 prgBankMax;
-u16 prgBankMask;
-u8 *prgBank[4];
+thread_local State *state = NULL;
 
 /**
- * CHR rom, addresses 0x0000-0x1fff of the PPU address space
+ * Initiate a DMA tranfer with the 2C02 PPU memory.
  */
-u8 chrRom[0x2000];
+static void writeOAMDMARegister(u8 val, long quantum);
 
 /**
- * PRG ram, addresses 0x6000-0x7fff
+ * Access the cartridge expansion area, with the mapper method inlined.
  */
-bool prgRamEnabled = false;
-bool prgRamWriteProtected = false;
-u8 *prgRam;
+struct LoadExp {
+    u16 addr;
+    long quantum;
+    u8 val;
+    template<class M> void operator()(M *mapper) {
+        val = mapper->loadExp(addr, quantum);
+    }
+};
 
-/**
- * Initiate a DMA tranfer with the 2C02 PPU memory.
- */
-static void writeOAMDMARegister(u8 val, long quantum);
+struct StoreExp {
+    u16 addr;
+    u8 val;
+    long quantum;
+    template<class M> void operator()(M *mapper) {
+        mapper->storeExp(addr, val, quantum);
+    }
+};
 
 /**
  * @brief Load a byte from an address in the CPU memory address space.
@@ -55,13 +52,13 @@ u8 _load(u16 addr, long quantum)
     // std::cerr << std::hex << "LOAD " << (int)addr << std::endl;
 
     if (addr >= 0x8000)
-        return prgBank[(addr >> prgBankShift) & prgBankMax][addr & prgBankMask];
+        return state->prgBank[(addr >> 13) & 0x3][addr & 0x1fff];
     else
     if (addr < 0x2000)
-        return ram[addr & 0x7ff];
+        return state->ram[addr & 0x7ff];
     else
     if (addr < 0x4000)
-        return N2C02::state.readRegister(addr, quantum);
+        return N2C02::state->readRegister(addr, quantum);
     else
     if (addr == JOYPAD1_ADDR)
         return Joypad::currentJoypad->readRegister();
@@ -70,16 +67,18 @@ u8 _load(u16 addr, long quantum)
         return 0x0;
     else
     if (addr < 0x4020)
-        // return readAPURegister(addr);
-        return 0x0;
+        return RP2A03::state->readRegister(addr, quantum);
     else
-    if (addr < 0x6000)
-        return 0x0; /* open bus */
+    if (addr < 0x6000) {
+        LoadExp load = { addr, quantum, 0 };
+        dispatchMapper(currentMapper, load);
+        return load.val;
+    }
     else
-    if (prgRamEnabled)
+    if (state->prgRamEnabled && state->prgRam != NULL)
         /* Read from cartridge space */
         // return rom.prg.load(addr);
-        return prgRam[addr & 0x1fff];
+        return state->prgRam[addr & state->prgRamMask];
     else
         return 0x0;
 }
@@ -94,6 +93,21 @@ u8 load0(u16 addr)
     return _load(addr, 0);
 }
 
+/**
+ * Write to the cartridge registers, with the mapper method inlined. The
+ * mappers watching A12 see the rises preceding the write.
+ */
+struct StorePrg {
+    u16 addr;
+    u8 val;
+    long quantum;
+    template<class M> void operator()(M *mapper) {
+        if (M::watchesA12)
+            N2C02::sync(quantum);
+        mapper->storePrg(addr, val);
+    }
+};
+
 /**
  * @brief Store a byte at an address in the CPU memory address space.
  * @param addr          absolute memory address
@@ -106,13 +120,15 @@ void _store(u16 addr, u8 val, long quantum)
     // std::cerr << (int)addr << " " << (int)val << std::endl;
 
     if (addr < 0x2000)
-        ram[addr & 0x7ff] = val;
+        state->ram[addr & 0x7ff] = val;
     else
-    if (addr >= 0x8000)
-        currentMapper->storePrg(addr, val);
+    if (addr >= 0x8000) {
+        StorePrg store = { addr, val, quantum };
+        dispatchMapper(currentMapper, store);
+    }
     else
     if (addr < 0x4000)
-        N2C02::state.writeRegister(addr, val, quantum);
+        N2C02::state->writeRegister(addr, val, quantum);
     else
     if (addr == JOYPAD1_ADDR)
         Joypad::currentJoypad->writeRegister(val);
@@ -121,14 +137,16 @@ void _store(u16 addr, u8 val, long quantum)
         writeOAMDMARegister(val, quantum);
     else
     if (addr < 0x4020)
-        // writeAPURegister(addr, val);
-        return;
+        RP2A03::state->writeRegister(addr, val, quantum);
     else
-    if (addr < 0x6000)
-        return; /* open bus */
+    if (addr < 0x6000) {
+        StoreExp store = { addr, val, quantum };
+        dispatchMapper(currentMapper, store);
+    }
     else
-    if (prgRamEnabled && !prgRamWriteProtected)
-        prgRam[addr & 0x1fff] = val;
+    if (state->prgRamEnabled && !state->prgRamWriteProtected &&
+        state->prgRam != NULL)
+        state->prgRam[addr & state->prgRamMask] = val;
 }
 
 void store(u16 addr, u8 val, long quantum)
@@ -141,13 +159,45 @@ void store0(u16 addr, u8 val)
     _store(addr, val, 0);
 }
 
+void configPrgRam(u8 *ram, size_t size)
+{
+    state->prgRam = ram;
+    state->prgRamMask = ram == NULL ? 0 : size > 0x2000 ? 0x1fff : size - 1;
+}
+
+size_t getStateSize()
+{
+    return sizeof(state->ram) + 2 +
+        (state->prgRam ? state->prgRamMask + 1 : 0);
+}
+
+void saveState(u8 *buf)
+{
+    memcpy(buf, state->ram, sizeof(state->ram));
+    buf += sizeof(state->ram);
+    buf[0] = state->prgRamEnabled;
+    buf[1] = state->prgRamWriteProtected;
+    if (state->prgRam)
+        memcpy(buf + 2, state->prgRam, state->prgRamMask + 1);
+}
+
+void loadState(const u8 *buf)
+{
+    memcpy(state->ram, buf, sizeof(state->ram));
+    buf += sizeof(state->ram);
+    state->prgRamEnabled = buf[0];
+    state->prgRamWriteProtected = buf[1];
+    if (state->prgRam)
+        memcpy(state->prgRam, buf + 2, state->prgRamMask + 1);
+}
+
 static inline void writeOAMDMARegister(u8 val, long quantum)
 {
     u16 dmaoffset, dmapage = (u16)val << 8;
     N2C02::sync(quantum);
     for (dmaoffset = 0; dmaoffset < 0x100; dmaoffset++) {
         val = load(dmapage + dmaoffset);
-        N2C02::state.dmaTransfer(val);
+        N2C02::state->dmaTransfer(val);
     }
     M6502::state->cycles += 514; /* Technically 513 OR 514. */
 }
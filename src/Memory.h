@@ -7,40 +7,59 @@
 #include <cstring>
 
 #include "type.h"
+#include "Stats.h"
 
 namespace Memory
 {
 
 /**
- * Internal CPU ram, of size 2048.
+ * CPU side memories of an emulator instance.
  */
-extern u8 ram[];
+struct State
+{
+    /**
+     * Internal CPU ram, of size 2048. Force the alignment to be 0x100, this
+     * has consequences on the x86 binary code re-compilation.
+     */
+    __attribute__((aligned(0x100)))
+    u8 ram[0x800];
 
-/**
- * PRG rom banks, addresses 0x8000-0xffff
- */
-extern size_t prgBankSize;
-extern uint prgBankShift;
-extern u16 prgBankMax;
-extern u16 prgBankMask;
-extern u8 *prgBank[];
+    /**
+     * PRG-ROM pages of 8K, addresses 0x8000-0xffff. The pages point into
+     * the cartridge memories, see \ref BankMapper.
+     */
+    u8 *prgBank[4];
 
-/**
- * CHR rom, addresses 0x0000-0x1fff of the PPU address space
- */
-extern u8 chrRom[];
+    /**
+     * PPU pages of 1K, addresses 0x0000-0x3eff of the PPU address space,
+     * all routed through the cartridge: the pattern tables (pages 0-7),
+     * and the nametables (pages 8-11, mirrored in the pages 12-15), see
+     * N2C02::mapNametable. The sprite patterns are fetched through
+     * \ref chrSpriteBank, which only differs from the pages 0-7 of
+     * \ref chrBank for the mappers banking the sprites apart (MMC5).
+     */
+    u8 *chrBank[16];
+    u8 *chrSpriteBank[8];
+
+    /**
+     * PRG ram, addresses 0x6000-0x7fff, mirrored if smaller than 8K
+     */
+    bool prgRamEnabled;
+    bool prgRamWriteProtected;
+    u8 *prgRam;
+    u16 prgRamMask;
+};
 
 /**
- * PRG ram, addresses 0x6000-0x7fff
+ * @brief Memories of the instance running on the calling thread.
  */
-extern bool prgRamEnabled;
-extern bool prgRamWriteProtected;
-extern u8 *prgRam;
+extern thread_local State *state;
 
 /**
- * Configure the PRG-ROM banks.
+ * @brief Map the PRG-RAM \p ram of \p size bytes (a power of two) at the
+ *  addresses 0x6000-0x7fff. Only the first 8K are mapped.
  */
-void configPrg(size_t bankSize);
+void configPrgRam(u8 *ram, size_t size);
 
 /**
  * @brief Load a byte from an address in the CPU memory address space.
@@ -71,7 +90,7 @@ inline u16 loadw(u16 addr) {
  *                      and \p addr+1
  */
 inline u16 loadzw(u8 addr) {
-    return WORD(ram[(addr + 1) & 0xff], ram[addr]);
+    return WORD(state->ram[(addr + 1) & 0xff], state->ram[addr]);
 }
 
 /**
@@ -83,6 +102,20 @@ inline u16 loadzw(u8 addr) {
 void store(u16 addr, u8 val, long quantum = 0);
 void store0(u16 addr, u8 val);
 
+/**
+ * @brief Return the size of the state saved by \ref saveState: the CPU ram,
+ *  and the PRG-RAM if present.
+ */
+size_t getStateSize();
+
+/**
+ * @brief Save the CPU side memories to \p buf, which must have room for
+ *  \ref getStateSize bytes. The PRG and CHR pages are not saved, they are
+ *  restored by the mapper with the CHR-RAM.
+ */
+void saveState(u8 *buf);
+void loadState(const u8 *buf);
+
 enum {
     OAMDMA_ADDR = 0x4014,
     JOYPAD1_ADDR = 0x4016,
@@ -93,60 +126,4 @@ enum {
 
 };
 
-/**
- * @brief Implementation of a fixed size memory with switachable banks.
- * @param memoryOrder       order of the mapped memory size
- *                          (the memory size is 1 << \p memoryOrder)
- * @param bankOrer          order of a bank size
- *                          (the bank size is 1 << \p bankOrder)
- */
-template<int memoryOrder, int bankOrder>
-class BankMemory
-{
-public:
-    BankMemory() : readOnly(true) {}
-    ~BankMemory() {}
-
-    /**
-     * @brief Set the bank \p bankNr to the bank \p bankSel of the source
-     *  memory.
-     */
-    void swapBank(int bankNr, int bankSel) {
-        assert(source != NULL);
-        assert(bankNr < (1 << (memoryOrder - bankOrder)));
-        u8 *ptr = &source[bankSel << bankOrder];
-        if (squash && banks[bankNr] != ptr) {
-            memcpy(&squash[bankNr << bankOrder], ptr, 1 << bankOrder);
-        }
-        banks[bankNr] = ptr;
-    }
-
-    /**
-     * @brief Set the bank \p bankNr to the provided bank buffer.
-     */
-    void swapBank(int bankNr, u8 *ptr) {
-        assert(source == NULL);
-        assert(bankNr < (1 << (memoryOrder - bankOrder)));
-        if (squash && banks[bankNr] != ptr) {
-            memcpy(&squash[bankNr << bankOrder], ptr, 1 << bankOrder);
-        }
-        banks[bankNr] = ptr;
-    }
-
-    void store(u16 addr, u8 val) {
-        if (!readOnly) {
-            const u16 mask = (1 << bankOrder) - 1;
-            banks[addr >> bankOrder][addr & mask] = val;
-            if (squash)
-                squash[addr] = val;
-            /// TODO handle mirroring.
-        }
-    }
-
-    bool readOnly;
-    u8 *banks[1 << (memoryOrder - bankOrder)];
-    u8 *source;
-    u8 *squash;
-};
-
 #endif /* _MEMORY_H_INCLUDED_ */
@@ -0,0 +1,113 @@
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "Movie.h"
+#include "Memory.h"
+#include "Joypad.h"
+#include "exception.h"
+
+Movie::Movie(const char *file, Mode mode, bool jit)
+    : _file(file), _mode(mode), _rom(currentRom->header),
+      _backend(jit ? BACKEND_JIT : BACKEND_INTERPRETER), _frame(0),
+      _desync(-1)
+{
+    if (_mode == MOVIE_RECORD)
+        return;
+
+    FILE *fd = fopen(file, "rb");
+    if (fd == NULL)
+        throw InvalidMovie();
+
+    Header header;
+    if (fread(&header, sizeof(header), 1, fd) != 1 ||
+        memcmp(header.magic, "NESM", 4) != 0 ||
+        header.version != MOVIE_VERSION ||
+        memcmp(&header.rom, &_rom, sizeof(::Header)) != 0) {
+        fclose(fd);
+        throw InvalidMovie();
+    }
+    if (header.backend != (u32)_backend) {
+        bool recorded = header.backend == BACKEND_JIT;
+        if (_mode == MOVIE_AUDIT) {
+            fclose(fd);
+            throw MovieBackendMismatch(recorded);
+        }
+        std::cerr << "Warning: " << MovieBackendMismatch(recorded).what();
+        std::cerr << std::endl;
+    }
+
+    _records.resize(header.frames);
+    size_t n = fread(_records.data(), sizeof(Record), header.frames, fd);
+    fclose(fd);
+    if (n != header.frames)
+        throw InvalidMovie();
+}
+
+Movie::~Movie()
+{
+    if (_mode == MOVIE_RECORD && !save())
+        std::cerr << "Cannot write movie to " << _file << std::endl;
+}
+
+void Movie::startFrame()
+{
+    Joypad::Joypad *joypad = Joypad::currentJoypad;
+    if (_mode == MOVIE_RECORD) {
+        Record record = { joypad->getButtons(), 0 };
+        _records.push_back(record);
+    } else if (_frame < _records.size())
+        joypad->setButtons(_records[_frame].buttons);
+}
+
+void Movie::endFrame()
+{
+    if (_frame >= _records.size())
+        return;
+
+    u32 hash = hashRam();
+    if (_mode == MOVIE_RECORD)
+        _records[_frame].hash = hash;
+    else if (_mode == MOVIE_AUDIT && _desync < 0 &&
+             _records[_frame].hash != hash) {
+        std::cerr << "Movie desynchronized at frame " << std::dec << _frame;
+        std::cerr << std::endl;
+        _desync = _frame;
+    }
+    _frame++;
+}
+
+bool Movie::isFinished() const
+{
+    if (_mode == MOVIE_RECORD)
+        return false;
+    return _frame >= _records.size() || _desync >= 0;
+}
+
+bool Movie::save()
+{
+    FILE *fd = fopen(_file.c_str(), "wb");
+    if (fd == NULL)
+        return false;
+
+    Header header;
+    memcpy(header.magic, "NESM", 4);
+    header.version = MOVIE_VERSION;
+    header.frames = _records.size();
+    header.backend = _backend;
+    header.rom = _rom;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fd) == 1 &&
+        fwrite(_records.data(), sizeof(Record), _records.size(), fd) ==
+            _records.size();
+    return fclose(fd) == 0 && ok;
+}
+
+u32 Movie::hashRam()
+{
+    u32 h = 2166136261u;
+    for (size_t i = 0; i < sizeof(Memory::state->ram); i++)
+        h = (h ^ Memory::state->ram[i]) * 16777619u;
+    return h;
+}
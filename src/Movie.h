@@ -0,0 +1,115 @@
+
+#ifndef _MOVIE_H_INCLUDED_
+#define _MOVIE_H_INCLUDED_
+
+#include <string>
+#include <vector>
+
+#include "Rom.h"
+#include "type.h"
+
+/**
+ * Version of the movie format, to be incremented with any change of the
+ * saved structures.
+ */
+#define MOVIE_VERSION           2
+
+/**
+ * @brief Input movie: the joypad buttons of every frame since power on,
+ *  with a hash of the CPU ram at the end of the frame.
+ *
+ *  In playback, the buttons are applied at the start of each frame, which
+ *  makes the emulation deterministic ; the audit mode additionally checks
+ *  the ram hashes against the recording, and stops on the first difference.
+ *  The hashes are only checked with the CPU backend of the recording.
+ */
+class Movie
+{
+public:
+    enum Mode {
+        MOVIE_RECORD,
+        MOVIE_PLAYBACK,
+        MOVIE_AUDIT,
+    };
+
+    /** CPU backend of the recording, see \ref Core::setJit. */
+    enum Backend {
+        BACKEND_INTERPRETER,
+        BACKEND_JIT,
+    };
+
+    /**
+     * Movie header, followed by one \ref Record per frame.
+     */
+    struct Header {
+        u8 magic[4];        /* Should contain the string 'NESM'. */
+        u32 version;        /* Movie format version. */
+        u32 frames;         /* Number of records. */
+        u32 backend;        /* CPU backend of the recording. */
+        ::Header rom;       /* Header of the recorded ROM. */
+    };
+
+    struct Record {
+        u8 buttons;         /* Joypad button mask. */
+        u32 hash;           /* Hash of the CPU ram after the frame. */
+    } __attribute__((packed));
+
+    /**
+     * @brief Open the movie \p file. In playback and audit modes, the movie
+     *  is loaded immediately ; in record mode, it is written when the movie
+     *  is destroyed.
+     * @param jit           true if the movie is run with the recompiler
+     * @throw InvalidMovie  if the movie cannot be loaded, or was recorded
+     *                      with another ROM
+     * @throw MovieBackendMismatch  in audit mode, if the movie was recorded
+     *                      with the other CPU backend
+     */
+    Movie(const char *file, Mode mode, bool jit);
+    ~Movie();
+
+    /**
+     * @brief Apply (playback) or capture (record) the buttons of the
+     *  current instance for the frame about to be emulated.
+     */
+    void startFrame();
+
+    /**
+     * @brief Record or check the ram hash of the completed frame.
+     */
+    void endFrame();
+
+    /**
+     * @brief Return true at the end of the playback, or after an audit
+     *  failure. A recording never finishes.
+     */
+    bool isFinished() const;
+
+    /**
+     * @brief Write the recorded frames to the movie file.
+     * @return              false if the file cannot be written
+     */
+    bool save();
+
+    Mode getMode() const { return _mode; }
+    ulong getFrame() const { return _frame; }
+    ulong getLength() const { return _records.size(); }
+
+    /** Frame of the first audit failure, or -1. */
+    long getDesync() const { return _desync; }
+
+    /**
+     * @brief FNV-1a hash of the CPU ram of the current instance.
+     */
+    static u32 hashRam();
+
+private:
+    std::string _file;
+    Mode _mode;
+    ::Header _rom;
+    Backend _backend;
+    std::vector<Record> _records;
+    ulong _frame;
+    long _desync;
+};
+
+#endif /* _MOVIE_H_INCLUDED_ */
@@ -0,0 +1,275 @@
+
+#include <cstring>
+
+#include "Rewind.h"
+#include "Snapshot.h"
+
+/**
+ * Minimum length of the zero runs encoded separately ; shorter runs are
+ * part of the literal bytes.
+ */
+#define MIN_ZERO_RUN            4
+
+static inline u8 *writeLength(u8 *ptr, size_t len)
+{
+    while (len >= 0x80) {
+        *ptr++ = (len & 0x7f) | 0x80;
+        len >>= 7;
+    }
+    *ptr++ = len;
+    return ptr;
+}
+
+static inline const u8 *readLength(const u8 *ptr, const u8 *end, size_t *len)
+{
+    size_t val = 0;
+    unsigned int shift = 0;
+    while (ptr < end && (*ptr & 0x80)) {
+        val |= (size_t)(*ptr++ & 0x7f) << shift;
+        shift += 7;
+    }
+    if (ptr < end)
+        val |= (size_t)*ptr++ << shift;
+    *len = val;
+    return ptr;
+}
+
+Rewind::Rewind(size_t capacity, unsigned int keyframeInterval)
+    : _ring(capacity), _head(0),
+      _keyframeInterval(keyframeInterval ? keyframeInterval : 1),
+      _groupSize(0)
+{
+}
+
+Rewind::~Rewind()
+{
+}
+
+size_t Rewind::encode(const u8 *src, const u8 *ref, size_t size, u8 *out)
+{
+    u8 *ptr = out;
+    size_t pos = 0;
+
+    while (pos < size) {
+        /* Zero run, skipped by words. */
+        size_t start = pos;
+        if (ref != NULL) {
+            while (pos + 8 <= size) {
+                uint64_t a, b;
+                memcpy(&a, src + pos, 8);
+                memcpy(&b, ref + pos, 8);
+                if (a != b)
+                    break;
+                pos += 8;
+            }
+            while (pos < size && src[pos] == ref[pos])
+                pos++;
+        } else {
+            while (pos < size && src[pos] == 0)
+                pos++;
+        }
+        size_t zeros = pos - start;
+
+        /* Literal bytes, up to the next long enough zero run. */
+        start = pos;
+        size_t run = 0;
+        for (; pos < size; pos++) {
+            u8 val = ref != NULL ? src[pos] ^ ref[pos] : src[pos];
+            if (val != 0)
+                run = 0;
+            else if (++run == MIN_ZERO_RUN)
+                break;
+        }
+        if (run == MIN_ZERO_RUN)
+            pos -= MIN_ZERO_RUN - 1;
+
+        ptr = writeLength(ptr, zeros);
+        ptr = writeLength(ptr, pos - start);
+        if (ref != NULL) {
+            for (size_t i = start; i < pos; i++)
+                *ptr++ = src[i] ^ ref[i];
+        } else {
+            memcpy(ptr, src + start, pos - start);
+            ptr += pos - start;
+        }
+    }
+    return ptr - out;
+}
+
+void Rewind::decode(const u8 *in, size_t inSize, const u8 *ref,
+                    u8 *out, size_t size)
+{
+    const u8 *end = in + inSize;
+    size_t pos = 0;
+
+    while (in < end && pos < size) {
+        size_t zeros, literals;
+        in = readLength(in, end, &zeros);
+        in = readLength(in, end, &literals);
+        if (zeros > size - pos)
+            zeros = size - pos;
+        if (ref != NULL)
+            memcpy(out + pos, ref + pos, zeros);
+        else
+            memset(out + pos, 0, zeros);
+        pos += zeros;
+
+        if (literals > size - pos)
+            literals = size - pos;
+        if (literals > (size_t)(end - in))
+            literals = end - in;
+        if (ref != NULL) {
+            for (size_t i = 0; i < literals; i++, pos++)
+                out[pos] = in[i] ^ ref[pos];
+        } else {
+            memcpy(out + pos, in, literals);
+            pos += literals;
+        }
+        in += literals;
+    }
+    /* Truncated input: leave the remaining bytes unchanged. */
+    if (pos < size) {
+        if (ref != NULL)
+            memcpy(out + pos, ref + pos, size - pos);
+        else
+            memset(out + pos, 0, size - pos);
+    }
+}
+
+size_t Rewind::getSize() const
+{
+    if (_records.empty())
+        return 0;
+    size_t tail = _records.front().offset;
+    if (_head > tail)
+        return _head - tail;
+    /* The records wrap around the end of the ring. */
+    return _ring.size() - tail + _head;
+}
+
+void Rewind::clear()
+{
+    _records.clear();
+    _head = 0;
+    _groupSize = 0;
+}
+
+/**
+ * @brief Drop the oldest group of records: the keyframe and the following
+ *  differences, which cannot be decoded without it.
+ */
+void Rewind::dropGroup()
+{
+    do {
+        _records.pop_front();
+    } while (!_records.empty() && !_records.front().keyframe);
+    if (_records.empty()) {
+        _head = 0;
+        _groupSize = 0;
+    }
+}
+
+/**
+ * @brief Append a record to the ring, dropping the oldest groups until
+ *  there is enough room.
+ */
+void Rewind::store(const u8 *data, size_t size, bool keyframe)
+{
+    if (size > _ring.size()) {
+        clear();
+        return;
+    }
+
+    for (;;) {
+        if (_records.empty()) {
+            _head = 0;
+            break;
+        }
+        size_t tail = _records.front().offset;
+        if (_head > tail) {
+            /* Free space at the end of the ring, else at the start. */
+            if (_ring.size() - _head >= size)
+                break;
+            if (tail >= size) {
+                _head = 0;
+                break;
+            }
+        } else if (tail - _head >= size)
+            break;
+        dropGroup();
+    }
+    /* The keyframe of this record was dropped. */
+    if (!keyframe && _records.empty())
+        return;
+
+    memcpy(&_ring[_head], data, size);
+    Record record = { _head, size, keyframe };
+    _records.push_back(record);
+    _head += size;
+}
+
+void Rewind::capture()
+{
+    Snapshot::save(_snapshot);
+    size_t size = _snapshot.size();
+    _encoded.resize(maxEncodedSize(size));
+
+    bool keyframe = _records.empty() || _groupSize >= _keyframeInterval ||
+        _keyframe.size() != size;
+    if (keyframe) {
+        _keyframe = _snapshot;
+        _groupSize = 0;
+    }
+
+    size_t encoded = encode(_snapshot.data(),
+        keyframe ? NULL : _keyframe.data(), size, _encoded.data());
+    store(_encoded.data(), encoded, keyframe);
+    if (_records.empty()) {
+        _groupSize = 0;
+        return;
+    }
+    _groupSize++;
+}
+
+/**
+ * @brief Decode the keyframe of the last group, after the last record
+ *  was removed.
+ */
+void Rewind::loadKeyframe()
+{
+    _groupSize = 0;
+    for (size_t i = _records.size(); i > 0; i--) {
+        const Record &record = _records[i - 1];
+        _groupSize++;
+        if (record.keyframe) {
+            decode(&_ring[record.offset], record.size, NULL,
+                   _keyframe.data(), _keyframe.size());
+            return;
+        }
+    }
+}
+
+bool Rewind::rewind()
+{
+    if (_records.empty())
+        return false;
+
+    Record record = _records.back();
+    _records.pop_back();
+    _head = record.offset;
+
+    _snapshot.resize(_keyframe.size());
+    decode(&_ring[record.offset], record.size,
+           record.keyframe ? NULL : _keyframe.data(),
+           _snapshot.data(), _snapshot.size());
+
+    if (_records.empty())
+        clear();
+    else if (record.keyframe)
+        loadKeyframe();
+    else
+        _groupSize--;
+
+    Snapshot::load(_snapshot);
+    return true;
+}
@@ -0,0 +1,101 @@
+
+#ifndef _REWIND_H_INCLUDED_
+#define _REWIND_H_INCLUDED_
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "type.h"
+
+/**
+ * @brief Rewind buffer: ring of machine snapshots, one per captured frame.
+ *
+ *  Snapshots are grouped: the first snapshot of a group (the keyframe) is
+ *  stored whole, the following ones as the XOR difference with the
+ *  keyframe. Both are compressed by encoding the runs of zero bytes, which
+ *  make most of a difference (only a few hundred bytes of the ram and PPU
+ *  state change from one frame to the next). The records are stored in a
+ *  single byte ring of fixed capacity ; when it is full, the oldest group is
+ *  dropped.
+ */
+class Rewind
+{
+public:
+    /**
+     * @param capacity          size of the record ring, in bytes
+     * @param keyframeInterval  maximum number of snapshots in a group
+     */
+    Rewind(size_t capacity, unsigned int keyframeInterval = 60);
+    ~Rewind();
+
+    /**
+     * @brief Save the current machine state.
+     */
+    void capture();
+
+    /**
+     * @brief Restore the last captured state, and drop it from the buffer.
+     * @return              false if the buffer is empty
+     */
+    bool rewind();
+
+    /**
+     * @brief Drop all captured states.
+     */
+    void clear();
+
+    /** Number of captured states. */
+    size_t getCount() const { return _records.size(); }
+    /** Number of bytes used in the record ring. */
+    size_t getSize() const;
+    size_t getCapacity() const { return _ring.size(); }
+
+    /**
+     * @brief Encode the XOR difference between \p src and \p ref (or \p src
+     *  itself if \p ref is NULL) as a sequence of zero run lengths and
+     *  literal bytes.
+     * @param out            output buffer, of size at least
+     *                       \ref maxEncodedSize (\p size)
+     * @return               the encoded size
+     */
+    static size_t encode(const u8 *src, const u8 *ref, size_t size, u8 *out);
+
+    /**
+     * @brief Decode an encoded difference, applying it to \p ref (or to
+     *  zeros if \p ref is NULL).
+     */
+    static void decode(const u8 *in, size_t inSize, const u8 *ref,
+                       u8 *out, size_t size);
+
+    static size_t maxEncodedSize(size_t size) {
+        return size + size / 65536 + 16;
+    }
+
+private:
+    struct Record {
+        size_t offset;          /**< Offset in the ring. */
+        size_t size;            /**< Encoded size. */
+        bool keyframe;
+    };
+
+    void store(const u8 *data, size_t size, bool keyframe);
+    void dropGroup();
+    void loadKeyframe();
+
+    std::vector<u8> _ring;
+    std::deque<Record> _records;
+    /** Ring offset of the next record. */
+    size_t _head;
+
+    unsigned int _keyframeInterval;
+    /** Number of records since the last keyframe, included. */
+    unsigned int _groupSize;
+
+    /** Decoded keyframe of the last group. */
+    std::vector<u8> _keyframe;
+    std::vector<u8> _snapshot;
+    std::vector<u8> _encoded;
+};
+
+#endif /* _REWIND_H_INCLUDED_ */
@@ -1,17 +1,25 @@
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <stdexcept>
 #include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <string>
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "Rom.h"
+#include "M6502Jit.h"
+#include "RomDatabase.h"
 #include "exception.h"
 
 /**
  * The iNes file format is organized as follow:
- *  - header: 16 bytes
+ *  - header: 16 bytes (iNES 1.0 or NES 2.0)
  *  - trainer: 0 or 512 bytes
  *  - PRGROM: (16384 . prom) bytes
  *  - CHRROM: (8192 . crom) bytes
@@ -20,12 +28,12 @@
 /**
  * Loaded ROM file.
  */
-Rom *currentRom;
+thread_local Rom *currentRom;
 
 /**
  * Loaded mapper.
  */
-Mapper *currentMapper;
+thread_local Mapper *currentMapper;
 
 /**
  * Array of supported mappers.
@@ -33,116 +41,366 @@ Mapper *currentMapper;
 MapperConstructor mappers[256];
 
 /**
- * Load a game cartridge from the provided path.
- * @param file          path to the nes cartridge file
+ * Images of the loaded cartridges, indexed by canonical path. The images
+ * are released with the last instance using them.
  */
-Rom::Rom(const char *file)
+static std::map<std::string, std::weak_ptr<RomImage>> images;
+static std::mutex imagesLock;
+
+static bool saveFilesEnabled = false;
+
+/* Loader messages, discarded when the loader is quiet. */
+static std::ostream nullStream(NULL);
+static std::ostream *romLog = &std::cerr;
+
+RomImage::RomImage()
+    : crc(0), mapperType(0), prgRom(NULL), prgRomSize(0), chrRom(NULL), chrRomSize(0),
+      _map(NULL), _mapSize(0)
 {
-    FILE *fd = fopen(file, "r");
-    if (fd == NULL)
-        throw std::invalid_argument("Cannot read from file");
+}
+
+RomImage::~RomImage()
+{
+    if (_map != NULL)
+        munmap(_map, _mapSize);
+}
+
+/**
+ * @brief Decode a NES 2.0 ROM size: either a number of banks of \p unit
+ *  bytes, or an exponent-multiplier notation when the MSB nibble is 0xf.
+ * @return              the size in bytes, or (size_t)-1 if too large
+ */
+static size_t decodeRomSize(u8 lsb, u8 msb, size_t unit)
+{
+    if (msb != 0xf)
+        return (((size_t)msb << 8) | lsb) * unit;
+    uint exponent = lsb >> 2;
+    if (exponent >= 8 * sizeof(size_t) - 3)
+        return (size_t)-1;
+    return ((size_t)1 << exponent) * ((lsb & 0x3) * 2 + 1);
+}
+
+/**
+ * @brief Decode a NES 2.0 RAM size, given as a shift count.
+ */
+static size_t decodeRamSize(u8 shift)
+{
+    return shift ? (size_t)64 << shift : 0;
+}
 
-    size_t n;
-    int r = 0;
-    u8 *prom = NULL, *crom = NULL, *pram = NULL;
-    u8 mapperType;
+/**
+ * @brief Decode the cartridge configuration from the iNES 1.0 or NES 2.0
+ *  header \p header.
+ */
+static void decodeHeader(const Header &header, RomConfig &config)
+{
+    const u8 *ext = header.ext;
+
+    config.nes2 = (header.ctrl[1] & NES_CTRL1_NES2_MASK) == NES_CTRL1_NES2;
+    config.battery = header.ctrl[0] & NES_CTRL0_PRAM;
+    config.trainer = header.ctrl[0] & NES_CTRL0_TRAILER;
+    config.verticalMirroring = header.ctrl[0] & NES_CTRL0_MIRROR_V;
+    config.fourScreen = header.ctrl[0] & NES_CTRL0_MIRROR_4SCR;
+    config.mapper = (header.ctrl[1] & 0xf0) | (header.ctrl[0] >> 4);
+
+    if (config.nes2) {
+        config.mapper |= (u16)(ext[0] & 0x0f) << 8;
+        config.submapper = ext[0] >> 4;
+        config.prgRomSize = decodeRomSize(header.prom, ext[1] & 0xf, 0x4000);
+        config.chrRomSize = decodeRomSize(header.crom, ext[1] >> 4, 0x2000);
+        config.prgRamSize = decodeRamSize(ext[2] & 0xf);
+        config.prgNvramSize = decodeRamSize(ext[2] >> 4);
+        config.chrRamSize = decodeRamSize(ext[3] & 0xf);
+        config.chrNvramSize = decodeRamSize(ext[3] >> 4);
+        config.timing = (Timing)(ext[4] & 0x3);
+        return;
+    }
+
+    /*
+     * Old dumps have garbage (e.g. "DiskDude!") in the unused bytes, which
+     * also overwrites the high nibble of the mapper number.
+     */
+    if (ext[4] || ext[5] || ext[6] || ext[7])
+        config.mapper &= 0x0f;
+    config.submapper = 0;
+    config.prgRomSize = header.prom * 0x4000;
+    config.chrRomSize = header.crom * 0x2000;
+    /* The number of RAM banks is often missing: 0 is treated as 1. */
+    size_t prgRam = (ext[0] ? ext[0] : 1) * 0x2000;
+    config.prgRamSize = config.battery ? 0 : prgRam;
+    config.prgNvramSize = config.battery ? prgRam : 0;
+    config.chrRamSize = header.crom ? 0 : 0x2000;
+    config.chrNvramSize = 0;
+    config.timing = TIMING_NTSC;
+}
+
+/**
+ * @brief Override the configuration decoded from an iNES 1.0 header with
+ *  the database entry \p entry.
+ */
+static void applyDatabase(const RomDatabase::Entry *entry, RomConfig &config)
+{
+    config.mapper = entry->mapper;
+    config.submapper = entry->submapper;
+    config.battery = entry->flags & ROMDB_BATTERY;
+    config.verticalMirroring = entry->flags & ROMDB_MIRROR_V;
+    config.fourScreen = entry->flags & ROMDB_MIRROR_4SCR;
+    config.prgRamSize = entry->prgRamSize;
+    config.prgNvramSize = entry->prgNvramSize;
+    config.chrRamSize = entry->chrRamSize;
+}
+
+static const char *timingNames[] = { "NTSC", "PAL", "Multi-region", "Dendy" };
 
-    n = fread((void *)&header, sizeof(struct Header), 1, fd);
-    if (n == 0)
-        goto fail;
+/**
+ * Map the cartridge file read-only, and locate the ROM banks in the mapping.
+ * @return              false if the file is not a valid cartridge
+ * @throw UnsupportedMapper if the mapper is not implemented
+ */
+bool RomImage::map(const char *file)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_size < (off_t)sizeof(struct Header)) {
+        close(fd);
+        return false;
+    }
+    /* The mapping holds its own reference to the file. */
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    _map = addr;
+    _mapSize = st.st_size;
+
+    const u8 *data = (const u8 *)_map;
+    size_t offset = sizeof(struct Header);
+    memcpy(&header, data, sizeof(struct Header));
 
     /* Check file format. */
     if (header.nes[0] != 'N' || header.nes[1] != 'E' ||
         header.nes[2] != 'S' || header.nes[3] != 0x1a)
-        goto fail;
+        return false;
+    decodeHeader(header, config);
 
     /* Dump header. */
-    std::cerr << "Detected iNES ROM" << std::hex << std::endl;
-    std::cerr << "  prom ..... " << std::setfill('0') << std::setw(2);
-    std::cerr << (int)header.prom << std::endl;
-    std::cerr << "  crom ..... " << std::setfill('0') << std::setw(2);
-    std::cerr << (int)header.crom << std::endl;
-    std::cerr << "  ctrl0 .... " << std::setfill('0') << std::setw(2);
-    std::cerr << (int)header.ctrl[0] << std::endl;
-    std::cerr << "  ctrl1 .... "  << std::setfill('0') << std::setw(2);
-    std::cerr << (int)header.ctrl[1] << std::endl;
-    std::cerr << "  pram ..... " << std::setfill('0') << std::setw(2);
-    std::cerr << (int)header.pram << std::endl;
-
-    if (header.pram == 0)
-        header.pram = 1;
+    *romLog << "Detected " << (config.nes2 ? "NES 2.0" : "iNES");
+    *romLog << " ROM" << std::hex << std::endl;
+    *romLog << "  prom ..... " << std::setfill('0') << std::setw(2);
+    *romLog << (int)header.prom << std::endl;
+    *romLog << "  crom ..... " << std::setfill('0') << std::setw(2);
+    *romLog << (int)header.crom << std::endl;
+    *romLog << "  ctrl0 .... " << std::setfill('0') << std::setw(2);
+    *romLog << (int)header.ctrl[0] << std::endl;
+    *romLog << "  ctrl1 .... "  << std::setfill('0') << std::setw(2);
+    *romLog << (int)header.ctrl[1] << std::endl;
+    *romLog << "  pram ..... " << std::setfill('0') << std::setw(2);
+    *romLog << (int)header.ext[0] << std::endl;
 
     /* Skip the trainer if present. */
-    if (header.ctrl[0] & NES_CTRL0_TRAILER) {
-        std::cerr << "Skipping trailer" << std::endl;
-        fseek(fd, 512, SEEK_CUR);
+    if (config.trainer) {
+        *romLog << "Skipping trailer" << std::endl;
+        offset += 512;
+    }
+
+    if (config.prgRomSize == (size_t)-1 || config.chrRomSize == (size_t)-1 ||
+        offset + config.prgRomSize + config.chrRomSize > _mapSize)
+        return false;
+    prgRom = data + offset;
+    prgRomSize = config.prgRomSize;
+    chrRom = config.chrRomSize ? data + offset + prgRomSize : NULL;
+    chrRomSize = config.chrRomSize;
+
+    /*
+     * iNES 1.0 headers cannot describe all the boards: known cartridges are
+     * configured from the database. NES 2.0 headers are trusted, and their
+     * banks are not read here, nor when the database is empty.
+     */
+    crc = 0;
+    if (!config.nes2 && !RomDatabase::isEmpty()) {
+        crc = RomDatabase::crc32(prgRom, prgRomSize);
+        crc = RomDatabase::crc32(chrRom, chrRomSize, crc);
+        const RomDatabase::Entry *entry = RomDatabase::lookup(crc);
+        if (entry != NULL) {
+            *romLog << "Found in ROM database (crc " << std::setw(8);
+            *romLog << crc << ")" << std::endl;
+            applyDatabase(entry, config);
+        }
     }
 
     /* Detect nametable mirroring type. */
-    if (header.ctrl[0] & NES_CTRL0_MIRROR_V) {
-        std::cerr << "Vertical mirroring" << std::endl;
-    } else if (header.ctrl[0] & NES_CTRL0_MIRROR_4SCR) {
-        std::cerr << "4-Screen VRAM" << std::endl;
+    if (config.verticalMirroring) {
+        *romLog << "Vertical mirroring" << std::endl;
+    } else if (config.fourScreen) {
+        *romLog << "4-Screen VRAM" << std::endl;
     } else {
-        std::cerr << "Horizontal mirroring" << std::endl;
+        *romLog << "Horizontal mirroring" << std::endl;
+    }
+    if (config.timing != TIMING_NTSC) {
+        *romLog << timingNames[config.timing];
+        *romLog << " timing, emulated as NTSC" << std::endl;
     }
 
     /* Extract mapper type. */
-    mapperType = (header.ctrl[1] & 0xf0) | (header.ctrl[0] >> 4);
-    if (mappers[mapperType] == NULL) {
-        std::cerr << "Unsupported mapper type " << (int)mapperType << std::endl;
-        goto fail;
-    } else {
-        std::cerr << "Selected mapper " << (int)mapperType << std::endl;
+    if (config.mapper > 0xff || mappers[config.mapper] == NULL) {
+        *romLog << "Unsupported mapper type " << std::dec;
+        *romLog << (int)config.mapper << std::endl;
+        throw UnsupportedMapper(config.mapper);
+    }
+    mapperType = config.mapper;
+    *romLog << "Selected mapper " << std::dec << (int)mapperType;
+    if (config.submapper)
+        *romLog << "." << (int)config.submapper;
+    *romLog << std::endl;
+
+    *romLog << "Loading " << prgRomSize / 0x400 << "Kb of PRG-ROM";
+    if (chrRomSize)
+        *romLog << ", " << chrRomSize / 0x400 << "Kb of CHR-ROM";
+    *romLog << std::endl;
+    if (config.prgRamSize) {
+        *romLog << "PRG-RAM " << config.prgRamSize / 0x400;
+        *romLog << "Kb" << std::endl;
+    }
+    if (config.prgNvramSize) {
+        *romLog << "Battery backed PRG-RAM " << config.prgNvramSize / 0x400;
+        *romLog << "Kb" << std::endl;
     }
+    return true;
+}
+
+std::shared_ptr<RomImage> RomImage::load(const char *file)
+{
+    char *path = realpath(file, NULL);
+    if (path == NULL)
+        throw std::invalid_argument("Cannot read from file");
+    std::string key(path);
+    free(path);
+
+    std::lock_guard<std::mutex> lock(imagesLock);
+    std::shared_ptr<RomImage> image = images[key].lock();
+    if (image)
+        return image;
 
-    /* Allocate space for the cartridge memory. */
-    prom = new u8[header.prom * 0x4000];
-    pram = new u8[header.pram * 0x2000];
-
-    if (prom == NULL || pram == NULL)
-        goto fail;
-
-    if (header.crom > 0) {
-        crom = new u8[header.crom * 0x2000];
-        if (crom == NULL)
-            goto fail;
-    } else
-        crom = NULL;
-
-    /* Load the PRG-ROM bank(s). */
-    std::cerr << "Loading " << (int)header.prom << " PRG-ROM 16Kb bank";
-    if (header.prom > 1)
-        std::cerr << "s";
-    std::cerr << std::endl;
-
-    r = fread(prom, header.prom * 0x4000 * sizeof(u8), 1, fd);
-    if (r == 0)
-        goto fail;
-
-    /* Load the CHR-ROM bank(s). */
-    if (header.crom > 0) {
-        std::cerr << "Loading " << (int)header.crom << " CHR-ROM 8Kb bank";
-        if (header.crom > 1)
-            std::cerr << "s";
-        std::cerr << std::endl;
-
-        r = fread(crom, header.crom * 0x2000 * sizeof(u8), 1, fd);
-        if (r == 0)
-            goto fail;
+    image.reset(new RomImage());
+    bool valid = false;
+    try {
+        valid = image->map(file);
+    } catch (...) {
+        images.erase(key);
+        throw;
     }
+    if (!valid) {
+        images.erase(key);
+        throw InvalidRom();
+    }
+    images[key] = image;
+    return image;
+}
+
+std::shared_ptr<M6502::InstructionCache> RomImage::getCache()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if (!_cache)
+        _cache = std::make_shared<M6502::InstructionCache>(prgRom, prgRomSize);
+    return _cache;
+}
+
+void Rom::setVerbose(bool verbose)
+{
+    romLog = verbose ? &std::cerr : &nullStream;
+}
+
+void Rom::setSaveFiles(bool enable)
+{
+    saveFilesEnabled = enable;
+}
 
-    /* Setup up the ROM object and install the selected mapper. */
-    prgRom = prom;
-    prgRam = pram;
-    chrRom = crom;
-    currentMapper = mappers[mapperType](this);
-    return;
-
-fail:
-    delete prom;
-    delete crom;
-    delete pram;
-    fclose(fd);
-    throw InvalidRom();
+/**
+ * @brief Map the save file of the cartridge \p file, replacing its
+ *  extension with .sav. The file is created, or extended with zeros, to
+ *  \p size bytes.
+ * @return              the shared mapping, or NULL on failure
+ */
+static u8 *mapSaveFile(const char *file, size_t size)
+{
+    std::string path(file);
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        path.erase(dot);
+    path += ".sav";
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        ((size_t)st.st_size < size && ftruncate(fd, size) < 0)) {
+        close(fd);
+        return NULL;
+    }
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return NULL;
+    *romLog << "Battery RAM saved to " << path << std::endl;
+    return (u8 *)addr;
+}
+
+/**
+ * Load a game cartridge from the provided path. The cartridge image is
+ * shared with the other instances running the same file, only the PRG-RAM
+ * (and the CHR-RAM allocated by the mapper) belong to the instance.
+ * @param file          path to the nes cartridge file
+ */
+Rom::Rom(const char *file)
+{
+    image = RomImage::load(file);
+    header = image->header;
+    config = image->config;
+    /* The mapping is read-only: the mappers only write the CHR-RAM. */
+    prgRom = const_cast<u8 *>(image->prgRom);
+    chrRom = const_cast<u8 *>(image->chrRom);
+    prgRamSize = config.prgRamSize + config.prgNvramSize;
+    prgRam = NULL;
+    _saveMapped = false;
+    /* The whole PRG-RAM is saved, including the volatile part if any. */
+    if (saveFilesEnabled && config.prgNvramSize > 0) {
+        prgRam = mapSaveFile(file, prgRamSize);
+        _saveMapped = prgRam != NULL;
+        if (!_saveMapped)
+            *romLog << "Cannot map the save file" << std::endl;
+    }
+    if (prgRam == NULL && prgRamSize > 0)
+        prgRam = new u8[prgRamSize]();
+
+    /* Install the selected mapper. */
+    try {
+        currentMapper = mappers[image->mapperType](this);
+    } catch (...) {
+        releaseMemories();
+        throw;
+    }
+}
+
+Rom::~Rom()
+{
+    releaseMemories();
+}
+
+void Rom::releaseMemories()
+{
+    if (_saveMapped)
+        munmap(prgRam, prgRamSize);
+    else
+        delete[] prgRam;
+    prgRam = NULL;
+    /* CHR-RAM allocated by the mapper. */
+    if (image->chrRom == NULL)
+        delete[] chrRom;
+    chrRom = NULL;
 }
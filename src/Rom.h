@@ -2,21 +2,116 @@
 #ifndef _ROM_H_INCLUDED_
 #define _ROM_H_INCLUDED_
 
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
 #include "Mapper.h"
 #include "type.h"
 
+namespace M6502 {
+class InstructionCache;
+};
+
 #define NES_CTRL0_MIRROR_V      (1 << 0)
 #define NES_CTRL0_PRAM          (1 << 1)
 #define NES_CTRL0_TRAILER       (1 << 2)
 #define NES_CTRL0_MIRROR_4SCR   (1 << 3)
 
+#define NES_CTRL1_NES2_MASK     (3 << 2)
+#define NES_CTRL1_NES2          (2 << 2)
+
+/**
+ * Raw iNES header. The meaning of the extension bytes depends on the
+ * format version, see \ref RomConfig.
+ */
 struct Header {
     u8 nes[4];    /* Should contain the string 'NES\n'. */
-    u8 prom;      /* Number of PRG-ROM banks. */
-    u8 crom;      /* Number of CHR-ROM banks. */
+    u8 prom;      /* Number of PRG-ROM banks (LSB for NES 2.0). */
+    u8 crom;      /* Number of CHR-ROM banks (LSB for NES 2.0). */
     u8 ctrl[2];   /* Two ROM control bytes. */
-    u8 pram;      /* Number of RAM banks (0 is still treated as 1). */
-    u8 unused[7]; /* Unused (all zeros). */
+    u8 ext[8];    /* iNES: number of RAM banks, then zeros. */
+};
+
+enum Timing {
+    TIMING_NTSC = 0,
+    TIMING_PAL = 1,
+    TIMING_MULTI = 2,
+    TIMING_DENDY = 3,
+};
+
+/**
+ * Cartridge configuration, decoded from the iNES 1.0 or NES 2.0 header,
+ * or found in the ROM database. The memory sizes are in bytes.
+ */
+struct RomConfig {
+    bool nes2;
+    u16 mapper;
+    u8 submapper;
+    size_t prgRomSize;
+    size_t chrRomSize;
+    /** Volatile and battery backed PRG-RAM. */
+    size_t prgRamSize;
+    size_t prgNvramSize;
+    /** Volatile and battery backed CHR-RAM. */
+    size_t chrRamSize;
+    size_t chrNvramSize;
+    Timing timing;
+    bool battery;
+    bool trainer;
+    bool verticalMirroring;
+    bool fourScreen;
+};
+
+/**
+ * @brief Immutable contents of a cartridge file, shared by all the instances
+ *  running the same cartridge in the process.
+ *
+ *  The file is mapped read-only: the ROM banks point into the mapping and
+ *  are only paged in when first accessed. Only the CHR-RAM and PRG-RAM of
+ *  each instance are allocated.
+ */
+class RomImage
+{
+public:
+    ~RomImage();
+
+    /**
+     * @brief Return the image of the cartridge \p file, loading it if no
+     *  instance holds it yet.
+     * @throw InvalidRom    if the cartridge cannot be loaded
+     * @throw UnsupportedMapper if the mapper is not implemented
+     */
+    static std::shared_ptr<RomImage> load(const char *file);
+
+    /**
+     * @brief Return the recompiled code of the image, created on first use.
+     */
+    std::shared_ptr<M6502::InstructionCache> getCache();
+
+    Header header;
+    RomConfig config;
+    /**
+     * CRC32 of the ROM banks, only computed for iNES 1.0 headers when the
+     * ROM database has entries, 0 otherwise.
+     */
+    u32 crc;
+    u8 mapperType;
+    /** PRG-ROM and CHR-ROM banks, in the file mapping. */
+    const u8 *prgRom;
+    size_t prgRomSize;
+    const u8 *chrRom;
+    size_t chrRomSize;
+
+private:
+    RomImage();
+
+    bool map(const char *file);
+
+    void *_map;
+    size_t _mapSize;
+    std::mutex _lock;
+    std::shared_ptr<M6502::InstructionCache> _cache;
 };
 
 class Rom
@@ -29,12 +124,39 @@ public:
     Rom(const char *file);
     ~Rom();
 
+    /**
+     * @brief Enable or disable the save files (disabled by default). When
+     *  enabled, the PRG-RAM of battery backed cartridges is mapped from the
+     *  file \<rom\>.sav, shared with the file: the writes persist without
+     *  any copy or flush, even if the process crashes. Instances running
+     *  the same cartridge would share the RAM: only enable for a single
+     *  instance, and not for movies, which start from a blank RAM.
+     */
+    static void setSaveFiles(bool enable);
+
+    /**
+     * @brief Enable or disable the loader messages (enabled by default).
+     */
+    static void setVerbose(bool verbose);
+
+    /** Shared cartridge image: \ref prgRom and \ref chrRom point into it. */
+    std::shared_ptr<RomImage> image;
     Header header;
+    RomConfig config;
+    /** PRG-RAM, NULL if the cartridge has none. */
     u8 *prgRam;
+    size_t prgRamSize;
     u8 *chrRom;
     u8 *prgRom;
+
+private:
+    void releaseMemories();
+
+    /** The PRG-RAM is mapped from the save file. */
+    bool _saveMapped;
 };
 
-extern Rom *currentRom;
+/** Cartridge of the instance running on the calling thread. */
+extern thread_local Rom *currentRom;
 
 #endif /* _ROM_H_INCLUDED_ */
@@ -0,0 +1,74 @@
+
+#include "RomDatabase.h"
+
+namespace RomDatabase {
+
+/**
+ * Known cartridges, sorted by checksum. Only the dumps whose iNES 1.0
+ * header cannot describe the board need an entry: NES 2.0 headers are
+ * trusted as is. The last entry is a sentinel, never matched.
+ */
+static constexpr Entry database[] = {
+    /* crc,        mapper, sub, flags, prgRam, prgNvram, chrRam */
+    { 0xffffffff,  0,      0,   0,     0,      0,        0 },
+};
+
+static constexpr size_t databaseSize =
+    sizeof(database) / sizeof(database[0]) - 1;
+
+/**
+ * @brief Check the order of the entries \p lo to \p hi (excluded). The
+ *  range is split in halves to bound the recursion depth.
+ */
+static constexpr bool isSorted(size_t lo, size_t hi)
+{
+    return hi - lo < 2 ? true :
+        hi - lo == 2 ? database[lo].crc < database[lo + 1].crc :
+        isSorted(lo, (lo + hi) / 2 + 1) && isSorted((lo + hi) / 2, hi);
+}
+
+static_assert(isSorted(0, sizeof(database) / sizeof(database[0])),
+              "ROM database must be sorted by checksum");
+
+static u32 crcTable[256];
+
+static void initCrcTable(void) __attribute__((constructor));
+static void initCrcTable(void)
+{
+    for (u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crcTable[i] = c;
+    }
+}
+
+u32 crc32(const u8 *data, size_t size, u32 crc)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+bool isEmpty()
+{
+    return databaseSize == 0;
+}
+
+const Entry *lookup(u32 crc)
+{
+    size_t lo = 0, hi = databaseSize;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (database[mid].crc == crc)
+            return &database[mid];
+        if (database[mid].crc < crc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+};
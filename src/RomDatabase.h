@@ -0,0 +1,50 @@
+
+#ifndef _ROMDATABASE_H_INCLUDED_
+#define _ROMDATABASE_H_INCLUDED_
+
+#include <cstddef>
+
+#include "type.h"
+
+namespace RomDatabase {
+
+#define ROMDB_BATTERY           (1 << 0)
+#define ROMDB_MIRROR_V          (1 << 1)
+#define ROMDB_MIRROR_4SCR       (1 << 2)
+
+/**
+ * Configuration of a known cartridge, overriding its iNES 1.0 header.
+ * The memory sizes are in bytes.
+ */
+struct Entry {
+    /** CRC32 of the PRG-ROM followed by the CHR-ROM. */
+    u32 crc;
+    u16 mapper;
+    u8 submapper;
+    u8 flags;
+    u32 prgRamSize;
+    u32 prgNvramSize;
+    u32 chrRamSize;
+};
+
+/**
+ * @brief Compute the CRC32 (IEEE 802.3) of \p size bytes, continuing
+ *  the checksum \p crc.
+ */
+u32 crc32(const u8 *data, size_t size, u32 crc = 0);
+
+/**
+ * @brief Return true if the database has no entry: the checksum of the
+ *  cartridges, which reads all their banks, can then be skipped.
+ */
+bool isEmpty();
+
+/**
+ * @brief Return the configuration of the cartridge with the checksum
+ *  \p crc, or NULL if it is not in the database.
+ */
+const Entry *lookup(u32 crc);
+
+};
+
+#endif /* _ROMDATABASE_H_INCLUDED_ */
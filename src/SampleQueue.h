@@ -0,0 +1,92 @@
+
+#ifndef _SAMPLEQUEUE_H_INCLUDED_
+#define _SAMPLEQUEUE_H_INCLUDED_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "type.h"
+
+/**
+ * @brief Lock-free ring of audio samples, with a single producer (the
+ *  emulation thread) and a single consumer (the audio device thread).
+ *
+ *  Same protocol as \ref InputQueue: each side only writes its own index,
+ *  and the release store of the index publishes the samples written
+ *  (resp. frees the slots read) before it.
+ */
+class SampleQueue
+{
+public:
+    SampleQueue() : _mask(0), _head(0), _tail(0) {}
+    ~SampleQueue() {}
+
+    /**
+     * @brief Allocate the ring, and drop the queued samples. Must not be
+     *  called while the queue is in use.
+     * @param capacity      minimum number of samples, rounded up to a power
+     *                      of two
+     */
+    void resize(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        _samples.assign(size, 0);
+        _mask = size - 1;
+        _head.store(0);
+        _tail.store(0);
+    }
+
+    size_t getCapacity() const { return _samples.size(); }
+
+    /**
+     * @brief Return the number of queued samples. Exact for the calling
+     *  side, a lower (resp. upper) bound for the other one.
+     */
+    size_t getFill() const {
+        return _tail.load(std::memory_order_acquire) -
+            _head.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Append up to \p count samples.
+     * @return              the number of samples appended
+     */
+    size_t push(const i16 *samples, size_t count) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t room = _samples.size() -
+            (tail - _head.load(std::memory_order_acquire));
+        if (count > room)
+            count = room;
+        for (size_t i = 0; i < count; i++)
+            _samples[(tail + i) & _mask] = samples[i];
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Remove up to \p count samples.
+     * @return              the number of samples removed
+     */
+    size_t pop(i16 *samples, size_t count) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t fill = _tail.load(std::memory_order_acquire) - head;
+        if (count > fill)
+            count = fill;
+        for (size_t i = 0; i < count; i++)
+            samples[i] = _samples[(head + i) & _mask];
+        _head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<i16> _samples;
+    size_t _mask;
+    /** Index of the next sample to read, written by the consumer. */
+    std::atomic<size_t> _head;
+    /** Index of the next sample to write, written by the producer. */
+    std::atomic<size_t> _tail;
+};
+
+#endif /* _SAMPLEQUEUE_H_INCLUDED_ */
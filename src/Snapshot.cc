@@ -0,0 +1,114 @@
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "Snapshot.h"
+#include "Memory.h"
+#include "Mapper.h"
+#include "Joypad.h"
+#include "exception.h"
+#include "M6502State.h"
+#include "N2C02State.h"
+#include "RP2A03State.h"
+
+namespace Snapshot {
+
+size_t getSize()
+{
+    return sizeof(Header) +
+        sizeof(M6502::State) +
+        sizeof(Joypad::Joypad) +
+        sizeof(RP2A03::State) +
+        Memory::getStateSize() +
+        N2C02::getStateSize() +
+        currentMapper->getStateSize();
+}
+
+void save(std::vector<u8> &blob)
+{
+    size_t size = getSize();
+    blob.resize(size);
+    u8 *buf = blob.data();
+
+    Header *header = (Header *)buf;
+    memcpy(header->magic, "NESS", 4);
+    header->version = SNAPSHOT_VERSION;
+    header->size = size;
+    header->rom = currentRom->header;
+    buf += sizeof(Header);
+
+    memcpy(buf, M6502::state, sizeof(M6502::State));
+    buf += sizeof(M6502::State);
+    memcpy(buf, Joypad::currentJoypad, sizeof(Joypad::Joypad));
+    buf += sizeof(Joypad::Joypad);
+    memcpy(buf, RP2A03::state, sizeof(RP2A03::State));
+    buf += sizeof(RP2A03::State);
+    Memory::saveState(buf);
+    buf += Memory::getStateSize();
+    N2C02::saveState(buf);
+    buf += N2C02::getStateSize();
+    currentMapper->saveState(buf);
+}
+
+void load(const std::vector<u8> &blob)
+{
+    const u8 *buf = blob.data();
+    const Header *header = (const Header *)buf;
+
+    if (blob.size() < sizeof(Header) ||
+        memcmp(header->magic, "NESS", 4) != 0 ||
+        header->version != SNAPSHOT_VERSION ||
+        header->size != blob.size() ||
+        header->size != getSize() ||
+        memcmp(&header->rom, &currentRom->header, sizeof(::Header)) != 0)
+        throw InvalidSnapshot();
+    buf += sizeof(Header);
+
+    memcpy(M6502::state, buf, sizeof(M6502::State));
+    buf += sizeof(M6502::State);
+    memcpy(Joypad::currentJoypad, buf, sizeof(Joypad::Joypad));
+    buf += sizeof(Joypad::Joypad);
+    memcpy(RP2A03::state, buf, sizeof(RP2A03::State));
+    buf += sizeof(RP2A03::State);
+
+    /*
+     * The mapper is restored last: it maps its banks and nametables, and
+     * schedules its interrupts, from the restored PPU state.
+     */
+    Memory::loadState(buf);
+    buf += Memory::getStateSize();
+    N2C02::loadState(buf);
+    buf += N2C02::getStateSize();
+    currentMapper->loadState(buf);
+}
+
+void save(const char *file)
+{
+    std::vector<u8> blob;
+    save(blob);
+
+    FILE *fd = fopen(file, "wb");
+    if (fd == NULL)
+        throw std::invalid_argument("Cannot write to file");
+    size_t n = fwrite(blob.data(), blob.size(), 1, fd);
+    fclose(fd);
+    if (n != 1)
+        throw std::runtime_error("Cannot write to file");
+}
+
+void load(const char *file)
+{
+    FILE *fd = fopen(file, "rb");
+    if (fd == NULL)
+        throw std::invalid_argument("Cannot read from file");
+
+    /* Read one more byte to detect oversized files. */
+    std::vector<u8> blob(getSize() + 1);
+    size_t n = fread(blob.data(), 1, blob.size(), fd);
+    fclose(fd);
+    blob.resize(n);
+    load(blob);
+}
+
+};
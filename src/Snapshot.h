@@ -0,0 +1,61 @@
+
+#ifndef _SNAPSHOT_H_INCLUDED_
+#define _SNAPSHOT_H_INCLUDED_
+
+#include <vector>
+
+#include "Rom.h"
+#include "type.h"
+
+/**
+ * Version of the snapshot format, to be incremented with any change of the
+ * saved structures.
+ */
+#define SNAPSHOT_VERSION        5
+
+namespace Snapshot {
+
+/**
+ * Snapshot header. The header is followed by the CPU registers, the joypad
+ * state, the APU state, the CPU memories, the PPU state and the mapper
+ * state, each saved as a raw copy of the emulator structures: a snapshot
+ * can only be loaded by the same build, with the same ROM.
+ */
+struct Header {
+    u8 magic[4];        /* Should contain the string 'NESS'. */
+    u32 version;        /* Snapshot format version. */
+    u32 size;           /* Total size, including the header. */
+    ::Header rom;       /* Header of the loaded ROM. */
+};
+
+/**
+ * @brief Return the size of a snapshot of the current machine.
+ */
+size_t getSize();
+
+/**
+ * @brief Save the machine state to \p blob. The vector is resized to
+ *  \ref getSize, it is not reallocated if large enough.
+ */
+void save(std::vector<u8> &blob);
+
+/**
+ * @brief Restore the machine state from \p blob.
+ * @throw InvalidSnapshot if the snapshot was not created by the same
+ *  version, or with another ROM
+ */
+void load(const std::vector<u8> &blob);
+
+/**
+ * @brief Save the machine state to the file \p file.
+ */
+void save(const char *file);
+
+/**
+ * @brief Restore the machine state from the file \p file.
+ */
+void load(const char *file);
+
+};
+
+#endif /* _SNAPSHOT_H_INCLUDED_ */
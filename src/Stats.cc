@@ -0,0 +1,148 @@
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+#include "Stats.h"
+#include "M6502State.h"
+#include "M6502Jit.h"
+#include "N2C02State.h"
+
+namespace Stats {
+
+thread_local Counters counters;
+thread_local uint64_t nestedTicks;
+bool timing = false;
+
+/**
+ * State at the start of the current sampling interval.
+ */
+static struct {
+    Counters counters;
+    ulong cycles;
+    ulong frames;
+    uint64_t ticks;
+    std::chrono::steady_clock::time_point time;
+} last;
+
+static ulong reportInterval = 0;
+static ulong reportFrames = 0;
+static std::ostream *reportStream = NULL;
+
+static inline ulong getCycles()
+{
+    return M6502::state ? M6502::state->cycles : 0;
+}
+
+static void start()
+{
+    last.counters = counters;
+    last.cycles = getCycles();
+    last.frames = N2C02::state->frame;
+    last.ticks = ticks();
+    last.time = std::chrono::steady_clock::now();
+}
+
+ulong getPeakRss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+void reset()
+{
+    memset(&counters, 0, sizeof(counters));
+    nestedTicks = 0;
+    reportFrames = 0;
+    start();
+}
+
+void sample(Report &report)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - last.time;
+    double seconds = elapsed.count();
+    double rate = seconds > 0 ? 1. / seconds : 0.;
+    /* Time stamp counter frequency, calibrated on the interval. */
+    uint64_t tsc = ticks() - last.ticks;
+    double tickPeriod = tsc ? seconds / tsc : 0.;
+
+    uint64_t jitCycles = counters.jitCycles - last.counters.jitCycles;
+    uint64_t interpreterCycles =
+        counters.interpreterCycles - last.counters.interpreterCycles;
+    uint64_t jitRuns = counters.jitRuns - last.counters.jitRuns;
+
+    report.elapsed = seconds;
+    report.cyclesPerSecond = (getCycles() - last.cycles) * rate;
+    report.framesPerSecond = (N2C02::state->frame - last.frames) * rate;
+    report.ppuSyncsPerSecond =
+        (counters.ppuSyncs - last.counters.ppuSyncs) * rate;
+    report.bankSwitchesPerSecond =
+        (counters.bankSwitches - last.counters.bankSwitches) * rate;
+    report.jitCycleRatio = jitCycles + interpreterCycles ?
+        (double)jitCycles / (jitCycles + interpreterCycles) : 0.;
+    report.cyclesPerJitRun = jitRuns ? (double)jitCycles / jitRuns : 0.;
+    report.interpreterInstructions = counters.interpreterInstructions;
+    report.blocksCompiled = counters.blocksCompiled;
+    report.codeBufferSize = M6502::cache ? M6502::cache->getSize() : 0;
+    report.codeBufferCapacity =
+        M6502::cache ? M6502::cache->getCapacity() : 0;
+    report.peakRss = getPeakRss();
+    for (int i = 0; i < SUBSYSTEM_COUNT; i++)
+        report.time[i] =
+            (counters.ticks[i] - last.counters.ticks[i]) * tickPeriod;
+
+    start();
+}
+
+void dumpJson(std::ostream &os, const Report &report)
+{
+    static const char *names[SUBSYSTEM_COUNT] = {
+        "jit", "interpreter", "compiler", "ppu", "video", "idle", "rewind",
+        "runahead", "apu",
+    };
+
+    os << std::fixed << std::setprecision(3);
+    os << "{\"elapsed\":" << report.elapsed;
+    os << ",\"cycles_per_second\":" << report.cyclesPerSecond;
+    os << ",\"frames_per_second\":" << report.framesPerSecond;
+    os << ",\"ppu_syncs_per_second\":" << report.ppuSyncsPerSecond;
+    os << ",\"bank_switches_per_second\":" << report.bankSwitchesPerSecond;
+    os << ",\"jit_cycle_ratio\":" << report.jitCycleRatio;
+    os << ",\"cycles_per_jit_run\":" << report.cyclesPerJitRun;
+    os << ",\"interpreter_instructions\":" << report.interpreterInstructions;
+    os << ",\"blocks_compiled\":" << report.blocksCompiled;
+    os << ",\"code_buffer_size\":" << report.codeBufferSize;
+    os << ",\"code_buffer_capacity\":" << report.codeBufferCapacity;
+    os << ",\"peak_rss_kb\":" << report.peakRss;
+    os << ",\"time\":{";
+    for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+        os << (i ? "," : "") << "\"" << names[i] << "\":";
+        os << std::setprecision(6) << report.time[i];
+    }
+    os << "}}" << std::defaultfloat << std::endl;
+}
+
+void setReportInterval(ulong frames, std::ostream &os)
+{
+    reportInterval = frames;
+    reportFrames = 0;
+    timing = frames > 0;
+    reportStream = &os;
+}
+
+void frame()
+{
+    if (reportInterval == 0 || ++reportFrames < reportInterval)
+        return;
+    Report report;
+    sample(report);
+    dumpJson(*reportStream, report);
+    reportFrames = 0;
+}
+
+};
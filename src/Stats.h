@@ -0,0 +1,171 @@
+
+#ifndef _STATS_H_INCLUDED_
+#define _STATS_H_INCLUDED_
+
+#include <cstddef>
+#include <ostream>
+#include <x86intrin.h>
+
+#include "type.h"
+
+namespace Stats {
+
+/**
+ * Subsystems for which the elapsed time is measured.
+ */
+enum Subsystem {
+    SUBSYSTEM_JIT           = 0,    /**< Recompiled code execution. */
+    SUBSYSTEM_INTERPRETER   = 1,    /**< Interpreted instructions. */
+    SUBSYSTEM_COMPILER      = 2,    /**< Block recompilation. */
+    SUBSYSTEM_PPU           = 3,    /**< PPU catch-up from the main loop. */
+    SUBSYSTEM_VIDEO         = 4,    /**< Frame presentation. */
+    SUBSYSTEM_IDLE          = 5,    /**< Frame pacing and pause. */
+    SUBSYSTEM_REWIND        = 6,    /**< Rewind capture and restore. */
+    SUBSYSTEM_RUNAHEAD      = 7,    /**< Run-ahead save and restore. */
+    SUBSYSTEM_APU           = 8,    /**< APU catch-up and sample synthesis. */
+    SUBSYSTEM_COUNT         = 9,
+};
+
+/**
+ * Raw event counters, incremented by the emulation code. All values are
+ * cumulated since the start of the emulation.
+ */
+struct Counters {
+    /** Number of entries in recompiled code. */
+    uint64_t jitRuns;
+    /** CPU cycles spent in recompiled code. */
+    uint64_t jitCycles;
+    /** Instructions executed by the interpreter. */
+    uint64_t interpreterInstructions;
+    /** CPU cycles spent in the interpreter. */
+    uint64_t interpreterCycles;
+    /** Number of recompiled instruction blocks. */
+    uint64_t blocksCompiled;
+    /** Calls to N2C02::sync. */
+    uint64_t ppuSyncs;
+    /** PRG and CHR bank changes performed by the mapper. */
+    uint64_t bankSwitches;
+    /** Time stamp counter ticks spent in each subsystem. */
+    uint64_t ticks[SUBSYSTEM_COUNT];
+};
+
+/** Counters of the emulation running on the calling thread. */
+extern thread_local Counters counters;
+
+/**
+ * The time spent in the subsystems is measured, only while the reports
+ * are enabled (see \ref setReportInterval): otherwise the time stamp
+ * counter is never read, and the subsystem times are null.
+ */
+extern bool timing;
+
+/**
+ * Ticks charged by \ref chargeNested since the last \ref charge, deducted
+ * from the subsystem charged next.
+ */
+extern thread_local uint64_t nestedTicks;
+
+/**
+ * Metrics computed over a sampling interval.
+ */
+struct Report {
+    /** Length of the interval, in seconds. */
+    double elapsed;
+    double cyclesPerSecond;
+    double framesPerSecond;
+    double ppuSyncsPerSecond;
+    double bankSwitchesPerSecond;
+    /**
+     * Fraction of the CPU cycles, not of the instructions, emulated by
+     * recompiled code.
+     */
+    double jitCycleRatio;
+    /** Average number of cycles per entry in recompiled code. */
+    double cyclesPerJitRun;
+    /** Cumulated counters. */
+    uint64_t interpreterInstructions;
+    uint64_t blocksCompiled;
+    size_t codeBufferSize;
+    size_t codeBufferCapacity;
+    /** Peak resident set size of the process, in kilobytes. */
+    ulong peakRss;
+    /** Time spent in each subsystem, in seconds. */
+    double time[SUBSYSTEM_COUNT];
+};
+
+/**
+ * @brief Time stamp counter, used to measure the time spent in the
+ *  subsystems (converted to seconds when reporting).
+ */
+static inline uint64_t ticks()
+{
+    return timing ? __rdtsc() : 0;
+}
+
+/**
+ * @brief Charge the time elapsed since \p start to the subsystem \p sub,
+ *  less the time charged meanwhile by \ref chargeNested.
+ * @return              the current time stamp
+ */
+static inline uint64_t charge(Subsystem sub, uint64_t start)
+{
+    if (!timing)
+        return 0;
+    uint64_t now = ticks();
+    counters.ticks[sub] += now - start - nestedTicks;
+    nestedTicks = 0;
+    return now;
+}
+
+/**
+ * @brief Charge the time elapsed since \p start to the subsystem \p sub,
+ *  from inside the measure of another subsystem (e.g. the presentation of
+ *  a frame during a PPU catch-up): the time is not charged twice.
+ */
+static inline void chargeNested(Subsystem sub, uint64_t start)
+{
+    if (!timing)
+        return;
+    uint64_t elapsed = ticks() - start;
+    counters.ticks[sub] += elapsed;
+    nestedTicks += elapsed;
+}
+
+/**
+ * @brief Return the peak resident set size of the process, in kilobytes.
+ */
+ulong getPeakRss();
+
+/**
+ * @brief Reset the counters and start a new sampling interval.
+ */
+void reset();
+
+/**
+ * @brief Compute the metrics over the interval since the last call
+ *  (or the last \ref reset), and start a new interval.
+ */
+void sample(Report &report);
+
+/**
+ * @brief Dump a report as a single line JSON object.
+ */
+void dumpJson(std::ostream &os, const Report &report);
+
+/**
+ * @brief Enable periodic reports, and the measure of the subsystem times.
+ * @param frames        number of frames between two reports,
+ *                      0 to disable the reports
+ * @param os            output stream for the JSON reports
+ */
+void setReportInterval(ulong frames, std::ostream &os);
+
+/**
+ * @brief Signal the completion of a frame, dumps a report if the
+ *  report interval elapsed.
+ */
+void frame();
+
+};
+
+#endif /* _STATS_H_INCLUDED_ */
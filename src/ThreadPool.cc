@@ -0,0 +1,114 @@
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threads)
+    : _generation(0), _pending(0), _active(0), _quit(false)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    for (unsigned int i = 0; i < threads; i++)
+        _queues.emplace_back(new Queue());
+    for (unsigned int i = 0; i < threads; i++)
+        _threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _quit = true;
+    }
+    _start.notify_all();
+    for (std::thread &thread : _threads)
+        thread.join();
+}
+
+void ThreadPool::run(size_t count, std::function<void(size_t)> task)
+{
+    if (count == 0)
+        return;
+
+    std::unique_lock<std::mutex> lock(_lock);
+    size_t workers = _queues.size();
+    for (size_t i = 0; i < count; i++) {
+        Queue &queue = *_queues[i % workers];
+        std::lock_guard<std::mutex> queueLock(queue.lock);
+        queue.tasks.push_back(i);
+    }
+    _task = task;
+    _pending = count;
+    _generation++;
+    _start.notify_all();
+    _done.wait(lock, [this] { return _pending == 0 && _active == 0; });
+    _task = nullptr;
+}
+
+/**
+ * @brief Take the next task from the back of the worker's own queue.
+ */
+bool ThreadPool::pop(size_t id, size_t &task)
+{
+    Queue &queue = *_queues[id];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    if (queue.tasks.empty())
+        return false;
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+/**
+ * @brief Take a task from the front of another worker's queue.
+ */
+bool ThreadPool::steal(size_t id, size_t &task)
+{
+    size_t workers = _queues.size();
+    for (size_t i = 1; i < workers; i++) {
+        Queue &queue = *_queues[(id + i) % workers];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.tasks.empty())
+            continue;
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::work(size_t id)
+{
+    unsigned long generation = 0;
+
+    while (true) {
+        std::function<void(size_t)> task;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _start.wait(lock,
+                [&] { return _quit || _generation != generation; });
+            if (_quit)
+                return;
+            generation = _generation;
+            /* Woken up after the end of the batch. */
+            if (_pending == 0)
+                continue;
+            task = _task;
+            _active++;
+        }
+
+        /*
+         * All the tasks are queued before the batch starts: once all the
+         * queues are empty, the worker is done with this batch.
+         */
+        size_t index;
+        while (pop(id, index) || steal(id, index)) {
+            task(index);
+            _pending--;
+        }
+
+        std::lock_guard<std::mutex> lock(_lock);
+        if (--_active == 0 && _pending == 0)
+            _done.notify_all();
+    }
+}
@@ -0,0 +1,70 @@
+
+#ifndef _THREADPOOL_H_INCLUDED_
+#define _THREADPOOL_H_INCLUDED_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of worker threads executing batches of indexed tasks.
+ *
+ *  The tasks of a batch are dealt to the workers up front. Each worker runs
+ *  its own tasks from the back of its queue, then steals from the front of
+ *  the other queues: workers that drew cheap tasks take over the remaining
+ *  work of the others.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @param threads       number of workers, 0 for one per hardware thread
+     */
+    ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    /**
+     * @brief Run \p task (i) for i in [0, \p count), and wait for the
+     *  completion of all the tasks. The tasks must not throw. Must not be
+     *  called concurrently.
+     */
+    void run(size_t count, std::function<void(size_t)> task);
+
+    size_t getThreadCount() const { return _threads.size(); }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    void work(size_t id);
+    bool pop(size_t id, size_t &task);
+    bool steal(size_t id, size_t &task);
+
+    std::vector<std::thread> _threads;
+    std::vector<std::unique_ptr<Queue>> _queues;
+
+    std::mutex _lock;
+    std::condition_variable _start;
+    std::condition_variable _done;
+    std::function<void(size_t)> _task;
+    /** Incremented for each batch, wakes up the workers. */
+    unsigned long _generation;
+    std::atomic<size_t> _pending;
+    /**
+     * Workers draining the queues of the current batch. The next batch
+     * is not queued before they are all done, so that no worker runs its
+     * tasks with the function of the previous batch.
+     */
+    size_t _active;
+    bool _quit;
+};
+
+#endif /* _THREADPOOL_H_INCLUDED_ */
@@ -2,21 +2,22 @@
 #ifndef _TIMER_H_INCLUDED_
 #define _TIMER_H_INCLUDED_
 
-#include <ctime>
 #include <chrono>
 #include <thread>
 
+#include "type.h"
+
 class Timer
 {
 public:
-    Timer() : _start(0) {}
+    Timer() : _start(std::chrono::steady_clock::now()) {}
     ~Timer() {}
 
     /**
      * @brief Reset the timer.
      */
     void reset() {
-        _start = clock();
+        _start = std::chrono::steady_clock::now();
     }
 
     /**
@@ -24,7 +25,8 @@ public:
      * started or reset.
      */
     unsigned long get() {
-        return (clock() - _start) * 1000L / CLOCKS_PER_SEC;
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - _start).count();
     }
 
     /**
@@ -38,7 +40,121 @@ public:
     }
 
 private:
-    clock_t _start;
+    std::chrono::steady_clock::time_point _start;
+};
+
+/**
+ * @brief Pace a periodic event (the emulated frames) on the monotonic clock.
+ *
+ *  The deadlines are absolute: the period is the exact fraction
+ *  \p den / \p num seconds, the rounding remainder is carried from one
+ *  frame to the next, and late frames are caught up by the following ones,
+ *  so the average rate does not drift. The wait sleeps until shortly
+ *  before the deadline, then spins ; the sleep margin adapts to the
+ *  observed scheduler overshoot.
+ */
+class FramePacer
+{
+public:
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::nanoseconds nanoseconds;
+
+    /**
+     * @param num, den      event rate, as the fraction \p num / \p den Hz
+     */
+    FramePacer(u32 num, u32 den)
+        : _num(num), _remainder(0), _margin(MARGIN_INIT),
+          _overshoot(MARGIN_INIT / 2) {
+        uint64_t period = (uint64_t)den * 1000000000ull;
+        _period = nanoseconds(period / num);
+        _periodRemainder = period % num;
+        reset();
+    }
+    ~FramePacer() {}
+
+    /**
+     * @brief Restart the schedule, the next deadline is one period away.
+     */
+    void reset() {
+        _next = clock::now();
+        _remainder = 0;
+        advance();
+    }
+
+    /**
+     * @brief Wait for the next deadline.
+     * @return              the lateness of the caller (zero if the deadline
+     *                      was not already passed)
+     */
+    nanoseconds wait() {
+        clock::time_point now = clock::now();
+        nanoseconds late(0);
+
+        if (now < _next) {
+            if (_next - now > _margin) {
+                clock::time_point wake = _next - _margin;
+                std::this_thread::sleep_until(wake);
+                now = clock::now();
+                updateMargin(now > wake ? now - wake : nanoseconds(0));
+            }
+            while (now < _next)
+                now = clock::now();
+        } else {
+            late = now - _next;
+            /*
+             * Too far behind (paused emulation, stalled host): drop the
+             * accumulated debt instead of running a burst of frames.
+             */
+            if (late > (long)MAX_LATENESS * _period) {
+                reset();
+                return late;
+            }
+        }
+        advance();
+        return late;
+    }
+
+    nanoseconds getPeriod() const { return _period; }
+    nanoseconds getMargin() const { return _margin; }
+
+private:
+    enum {
+        /* Number of periods after which the schedule is restarted. */
+        MAX_LATENESS = 4,
+        /*
+         * Bounds of the spin margin (in nanoseconds) ; the margin is set
+         * to twice the average sleep overshoot.
+         */
+        MARGIN_INIT = 1000000,
+        MARGIN_MIN = 50000,
+        MARGIN_MAX = 2000000,
+    };
+
+    void advance() {
+        _next += _period;
+        _remainder += _periodRemainder;
+        if (_remainder >= _num) {
+            _remainder -= _num;
+            _next += nanoseconds(1);
+        }
+    }
+
+    void updateMargin(nanoseconds overshoot) {
+        _overshoot = (7 * _overshoot + overshoot) / 8;
+        _margin = 2 * _overshoot;
+        if (_margin < nanoseconds(MARGIN_MIN))
+            _margin = nanoseconds(MARGIN_MIN);
+        if (_margin > nanoseconds(MARGIN_MAX))
+            _margin = nanoseconds(MARGIN_MAX);
+    }
+
+    u32 _num;
+    nanoseconds _period;
+    u32 _periodRemainder;
+    u32 _remainder;
+    clock::time_point _next;
+    nanoseconds _margin;
+    nanoseconds _overshoot;
 };
 
 #endif /* _TIMER_H_INCLUDED_ */
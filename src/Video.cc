@@ -0,0 +1,196 @@
+
+#include <cstring>
+#include <chrono>
+
+#include "Video.h"
+
+using namespace Video;
+
+namespace Video {
+
+/**
+ * Backend installed by default, which simply retains the last frame.
+ */
+static FrameCollector defaultBackend;
+static Backend *currentBackend = &defaultBackend;
+
+};
+
+FrameCollector::FrameCollector(size_t capacity)
+    : _capacity(capacity ? capacity : 1), _count(0),
+      _width(0), _height(0)
+{
+}
+
+FrameCollector::~FrameCollector()
+{
+}
+
+int FrameCollector::init(
+    unsigned int width, unsigned int height, unsigned int zoom)
+{
+    (void)zoom;
+    _width = width;
+    _height = height;
+    _count = 0;
+    _frames.assign(_capacity * width * height, 0);
+    return 0;
+}
+
+void FrameCollector::quit()
+{
+}
+
+/**
+ * @brief Copy the frame to the next buffer of the ring.
+ */
+void FrameCollector::present(const u32 *pixels)
+{
+    size_t size = _width * _height;
+    size_t slot = _count % _capacity;
+    memcpy(&_frames[slot * size], pixels, size * sizeof(u32));
+    _count++;
+}
+
+const u32 *FrameCollector::getFrame(size_t age) const
+{
+    if (age >= _capacity || age >= _count)
+        return NULL;
+    size_t slot = (_count - 1 - age) % _capacity;
+    return &_frames[slot * _width * _height];
+}
+
+Presenter::Presenter(Backend *target)
+    : _target(target), _thread(NULL), _quit(false), _status(0),
+      _started(false)
+{
+}
+
+Presenter::~Presenter()
+{
+    quit();
+}
+
+/**
+ * @brief Start the presentation thread, which initialises the target
+ *  backend, and wait for the result of the initialisation.
+ */
+int Presenter::init(
+    unsigned int width, unsigned int height, unsigned int zoom)
+{
+    if (_thread != NULL)
+        return -1;
+
+    _queue.resize(width * height);
+    _quit = false;
+    _started = false;
+    _thread = new std::thread(&Presenter::run, this, width, height, zoom);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cond.wait(lock, [this] { return _started; });
+    return _status;
+}
+
+/**
+ * @brief Stop and join the presentation thread.
+ */
+void Presenter::quit()
+{
+    if (_thread == NULL)
+        return;
+    _quit = true;
+    _cond.notify_all();
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+/**
+ * @brief Publish the frame. \p pixels is normally the buffer returned by
+ *  \ref getBuffer, otherwise the frame is first copied to it.
+ */
+void Presenter::present(const u32 *pixels)
+{
+    u32 *back = _queue.getBack();
+    if (pixels != back)
+        memcpy(back, pixels, _queue.getSize() * sizeof(u32));
+    _queue.publish();
+    _cond.notify_one();
+}
+
+u32 *Presenter::getBuffer()
+{
+    return _queue.getBack();
+}
+
+/**
+ * @brief Presentation thread: forward the published frames to the target
+ *  backend. Frames published while the target is busy are dropped, only
+ *  the most recent one is presented.
+ */
+void Presenter::run(
+    unsigned int width, unsigned int height, unsigned int zoom)
+{
+    int status = _target->init(width, height, zoom);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _status = status;
+        _started = true;
+    }
+    _cond.notify_all();
+    if (status < 0)
+        return;
+
+    while (!_quit) {
+        /*
+         * The producer does not take the lock before notifying, a wakeup
+         * can be missed: the timeout bounds the added latency.
+         */
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait_for(lock, std::chrono::milliseconds(4),
+                [this] { return _quit || _queue.isFresh(); });
+        }
+        if (_queue.consume())
+            _target->present(_queue.getFront());
+    }
+    _target->quit();
+}
+
+namespace Video {
+
+/**
+ * @brief Replace the video backend. Must be called before \ref init.
+ * @param backend       new backend, or NULL to restore the default one
+ */
+void setBackend(Backend *backend)
+{
+    currentBackend = backend ? backend : &defaultBackend;
+}
+
+Backend *getBackend()
+{
+    return currentBackend;
+}
+
+int init(unsigned int width, unsigned int height, unsigned int zoom)
+{
+    return currentBackend->init(width, height, zoom);
+}
+
+void quit()
+{
+    currentBackend->quit();
+}
+
+void present(const u32 *pixels)
+{
+    currentBackend->present(pixels);
+}
+
+u32 *getBuffer()
+{
+    return currentBackend->getBuffer();
+}
+
+};
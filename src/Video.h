@@ -0,0 +1,129 @@
+
+#ifndef _VIDEO_H_INCLUDED_
+#define _VIDEO_H_INCLUDED_
+
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "FrameQueue.h"
+#include "type.h"
+
+namespace Video {
+
+/**
+ * Video output backend. The PPU renders into its own frame buffer and
+ * hands every completed frame to the installed backend.
+ */
+class Backend
+{
+public:
+    Backend() {}
+    virtual ~Backend() {}
+
+    /**
+     * @brief Prepare the backend for frames of the given geometry.
+     * @param width         frame width in pixels
+     * @param height        frame height in pixels
+     * @param zoom          suggested scaling factor for display
+     * @return              0 on success, -1 on failure
+     */
+    virtual int init(
+        unsigned int width, unsigned int height, unsigned int zoom) = 0;
+    virtual void quit() = 0;
+
+    /**
+     * @brief Output a completed frame.
+     * @param pixels        ARGB8888 pixels, \p width x \p height
+     */
+    virtual void present(const u32 *pixels) = 0;
+
+    /**
+     * @brief Return the buffer the next frame should be rendered into.
+     *  Backends that return NULL are passed a buffer owned by the caller.
+     */
+    virtual u32 *getBuffer() { return NULL; }
+};
+
+/**
+ * Default backend: completed frames are copied to a ring of in-memory
+ * buffers, nothing is displayed.
+ */
+class FrameCollector : public Backend
+{
+public:
+    /**
+     * @param capacity      number of frames retained
+     */
+    FrameCollector(size_t capacity = 1);
+    ~FrameCollector();
+
+    int init(unsigned int width, unsigned int height, unsigned int zoom);
+    void quit();
+    void present(const u32 *pixels);
+
+    /**
+     * @brief Return one of the retained frames.
+     * @param age           0 for the last frame, 1 for the one before...
+     * @return              the frame pixels, or NULL if \p age is greater
+     *                      than the number of retained frames
+     */
+    const u32 *getFrame(size_t age = 0) const;
+    ulong getCount() const { return _count; }
+    unsigned int getWidth() const { return _width; }
+    unsigned int getHeight() const { return _height; }
+
+private:
+    std::vector<u32> _frames;
+    size_t _capacity;
+    ulong _count;
+    unsigned int _width;
+    unsigned int _height;
+};
+
+/**
+ * Backend forwarding the frames to another backend on a dedicated
+ * presentation thread. The frames are rendered directly into the
+ * buffers of a \ref FrameQueue: presenting a frame never blocks the
+ * emulation thread, whatever the time spent uploading it.
+ */
+class Presenter : public Backend
+{
+public:
+    /**
+     * @param target        backend called from the presentation thread
+     */
+    Presenter(Backend *target);
+    ~Presenter();
+
+    int init(unsigned int width, unsigned int height, unsigned int zoom);
+    void quit();
+    void present(const u32 *pixels);
+    u32 *getBuffer();
+
+private:
+    void run(unsigned int width, unsigned int height, unsigned int zoom);
+
+    Backend *_target;
+    FrameQueue _queue;
+    std::thread *_thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::atomic<bool> _quit;
+    int _status;
+    bool _started;
+};
+
+void setBackend(Backend *backend);
+Backend *getBackend();
+
+int init(unsigned int width, unsigned int height, unsigned int zoom);
+void quit();
+void present(const u32 *pixels);
+u32 *getBuffer();
+
+};
+
+#endif /* _VIDEO_H_INCLUDED_ */
@@ -11,6 +11,46 @@ public:
     const char *what() const noexcept { return "Invalid ROM File"; }
 };
 
+class UnsupportedMapper : public InvalidRom
+{
+public:
+    UnsupportedMapper(u16 mapper) : mapper(mapper) {}
+    ~UnsupportedMapper() {}
+    const char *what() const noexcept { return "Unsupported Mapper"; }
+
+    u16 mapper;
+};
+
+class InvalidSnapshot : public std::exception
+{
+public:
+    InvalidSnapshot() {}
+    ~InvalidSnapshot() {}
+    const char *what() const noexcept { return "Invalid Snapshot"; }
+};
+
+class InvalidMovie : public std::exception
+{
+public:
+    InvalidMovie() {}
+    ~InvalidMovie() {}
+    const char *what() const noexcept { return "Invalid Movie"; }
+};
+
+class MovieBackendMismatch : public InvalidMovie
+{
+public:
+    MovieBackendMismatch(bool jit) : jit(jit) {}
+    ~MovieBackendMismatch() {}
+    const char *what() const noexcept {
+        return jit ?
+            "Movie recorded with the recompiler, replay it without -i" :
+            "Movie recorded with the interpreter, replay it with -i";
+    }
+
+    bool jit;
+};
+
 class UnsupportedInstruction : public std::exception
 {
 public:
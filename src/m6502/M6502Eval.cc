@@ -22,7 +22,7 @@ struct BacktraceEntry
 };
 
 #ifdef CPU_BACKTRACE
-static std::vector<BacktraceEntry> _backtrace;
+static thread_local std::vector<BacktraceEntry> _backtrace;
 #endif
 
 #define A           (state->regs.a)
@@ -254,13 +254,13 @@ static inline u8 SRE(u8 m) {
 }
 
 static inline void PUSH(u8 m) {
-    Memory::ram[(u16)0x100 + (u16)SP] = m;
+    Memory::state->ram[(u16)0x100 + (u16)SP] = m;
     SP--;
 }
 
 static inline u8 PULL() {
     SP++;
-    return Memory::ram[(u16)0x100 + (u16)SP];
+    return Memory::state->ram[(u16)0x100 + (u16)SP];
 }
 
 static inline void NOP(u16 m) {
@@ -1049,7 +1049,8 @@ void triggerNMI()
 }
 
 /**
- * @brief Trigger an IRQ.
+ * @brief Trigger an IRQ. The line is level triggered: it stays asserted
+ *  until the source is acknowledged.
  */
 void triggerIRQ()
 {
@@ -1069,7 +1070,6 @@ void triggerIRQ()
     P |= P_I;
     PC = Memory::loadw(Memory::IRQ_ADDR);
     state->cycles += Asm::instructions[BRK_IMP].cycles;
-    state->irq = false;
 }
 
 /**
@@ -1,4 +1,5 @@
 
+#include <climits>
 #include <iostream>
 #include <iomanip>
 
@@ -6,13 +7,15 @@
 #include "M6502State.h"
 #include "M6502Eval.h"
 #include "Memory.h"
+#include "Stats.h"
 
 #define PAGE_DIFF(addr0, addr1) ((((addr0) ^ (addr1)) & 0xff00) != 0)
+#define WINDOW_DIFF(addr0, addr1) ((((addr0) ^ (addr1)) & 0xe000) != 0)
 
 using namespace M6502;
 
 namespace M6502 {
-InstructionCache cache(new CodeBuffer());
+thread_local InstructionCache *cache = NULL;
 };
 
 Instruction::Instruction(u16 address, u8 opcode, u8 op0, u8 op1)
@@ -38,6 +41,9 @@ Instruction::Instruction(u16 address, u8 opcode, u8 op0, u8 op1)
         case JSR_ABS:
         case RTI_IMP:
         case RTS_IMP:
+        /* The IRQ is taken between two interpreted instructions. */
+        case CLI_IMP:
+        case PLP_IMP:
         // case BCC_REL:
         // case BCS_REL:
         // case BEQ_REL:
@@ -72,43 +78,83 @@ Instruction::Instruction(u16 address, u8 opcode, u8 op0, u8 op1)
  *      6502 stack operations
  */
 
-InstructionCache::InstructionCache(CodeBuffer *buffer)
+InstructionCache::InstructionCache(const u8 *prgRom, size_t prgRomSize,
+                                   size_t capacity)
 :
-    _asmEmitter(buffer)
+    _buffer(capacity), _asmEmitter(&_buffer),
+    _prgRom(prgRom), _prgRomSize(prgRomSize)
 {
-    _cacheSize = 0x8000;
-    _cache = new Instruction *[0x8000];
+    _pageCount = (prgRomSize + 0x1fff) / 0x2000;
+    _pages = new std::atomic<Page *>[4 * _pageCount]();
 }
 
 InstructionCache::~InstructionCache()
 {
-    for (size_t i = 0; i < _cacheSize; i++)
-        if (_cache[i])
-            delete _cache[i];
-    delete _cache;
+    for (size_t p = 0; p < 4 * _pageCount; p++) {
+        Page *page = _pages[p].load(std::memory_order_relaxed);
+        if (page == NULL)
+            continue;
+        for (size_t i = 0; i < 0x2000; i++)
+            if (page->instructions[i])
+                delete page->instructions[i];
+        delete page;
+    }
+    delete[] _pages;
 }
 
-Instruction *InstructionCache::fetchInstruction(u16 address)
+/**
+ * Return the index of the page of the PRG-ROM the current instance maps
+ * at \p address, for the window of \p address, or -1 if the address is
+ * not in the PRG-ROM.
+ */
+long InstructionCache::getPageIndex(u16 address) const
 {
-    uint offset = address - 0x8000;
-    return _cache[offset];
+    if (address < 0x8000)
+        return -1;
+    size_t window = (address >> 13) & 0x3;
+    const u8 *page = Memory::state->prgBank[window];
+    if (page < _prgRom || page >= _prgRom + _prgRomSize ||
+        (page - _prgRom) % 0x2000)
+        return -1;
+    return window * _pageCount + (page - _prgRom) / 0x2000;
 }
 
 Instruction *InstructionCache::cacheInstruction(u16 address)
 {
-    uint offset = address - 0x8000;
-    if (_cache[offset] != NULL)
-        return _cache[offset];
+    std::atomic<Page *> &slot = _pages[getPageIndex(address)];
+    Page *page = slot.load(std::memory_order_relaxed);
+    if (page == NULL) {
+        page = new Page();
+        slot.store(page, std::memory_order_release);
+    }
+    uint offset = address & 0x1fff;
+    if (page->instructions[offset] != NULL)
+        return page->instructions[offset];
     u8 opcode = Memory::load(address);
     size_t bytes = Asm::instructions[opcode].bytes;
-    /// FIXME check for bank overflow
     u8 op0 = bytes > 1 ? Memory::load(address + 1) : 0;
     u8 op1 = bytes > 2 ? Memory::load(address + 2) : 0;
     Instruction *instr = new Instruction(address, opcode, op0, op1);
-    _cache[offset] = instr;
+    /* The operands in the next window may be switched: interpreted. */
+    if (WINDOW_DIFF(address, address + bytes - 1))
+        instr->exit = true;
+    page->instructions[offset] = instr;
     return instr;
 }
 
+/**
+ * Emit the code returning to the interpreter with the instruction at
+ * \p address, and return its start.
+ */
+const u8 *InstructionCache::compileExit(u16 address)
+{
+    const u8 *code = _asmEmitter.getPtr();
+    _asmEmitter.MOV(X86::eax, address);
+    _asmEmitter.POPF();
+    _asmEmitter.RETN();
+    return code;
+}
+
 Instruction *InstructionCache::cacheBlock(u16 address)
 {
     u16 pc = address;
@@ -117,7 +163,7 @@ Instruction *InstructionCache::cacheBlock(u16 address)
     Instruction **last = &first;
     // _stack.clear();
 
-    // const u8 *ptr = _asmEmitter.getPtr();
+    const u8 *ptr = _asmEmitter.getPtr();
 
     while (1) {
         instr = cacheInstruction(pc);
@@ -131,6 +177,8 @@ Instruction *InstructionCache::cacheBlock(u16 address)
 
         _stack.push(instr);
         pc += Asm::instructions[instr->opcode].bytes;
+        if (WINDOW_DIFF(address, pc))
+            break;
     }
 
     /* Fast flag analysis */
@@ -158,10 +206,14 @@ Instruction *InstructionCache::cacheBlock(u16 address)
         if (instr->exit)
             break;
     }
+    /* The block runs into the next window. */
+    if (instr == NULL)
+        compileExit(pc);
 
-    // if (_asmEmitter.getPtr() != ptr) {
-    //     _asmEmitter.dump(ptr);
-    // }
+    if (_asmEmitter.getPtr() != ptr) {
+        Stats::counters.blocksCompiled++;
+        // _asmEmitter.dump(ptr);
+    }
 
     /* Return block start */
     return first;
@@ -169,20 +221,37 @@ Instruction *InstructionCache::cacheBlock(u16 address)
 
 Instruction *InstructionCache::cache(u16 address)
 {
-    if (address < 0x8000)
+    long index = getPageIndex(address);
+    if (index < 0)
         return NULL;
 
+    uint offset = address & 0x1fff;
+    Page *page = _pages[index].load(std::memory_order_acquire);
+    Instruction *block = page != NULL ?
+        page->blocks[offset].load(std::memory_order_acquire) : NULL;
+    if (block != NULL)
+        return block;
+
+    std::lock_guard<std::mutex> lock(_lock);
     // _queue.clear();
-    Instruction *block = cacheBlock(address);
+    block = cacheBlock(address);
 
     while (!_queue.empty()) {
         Instruction *branch, *target;
         branch = _queue.front();
         _queue.pop();
+        /* The target window may be switched when the branch is taken. */
+        if (WINDOW_DIFF(branch->address, branch->branchAddress)) {
+            _asmEmitter.setJump(branch->nativeBranchAddress,
+                                compileExit(branch->branchAddress));
+            continue;
+        }
         target = cacheBlock(branch->branchAddress);
         _asmEmitter.setJump(branch->nativeBranchAddress, target->nativeCode);
     }
 
+    page = _pages[index].load(std::memory_order_relaxed);
+    page->blocks[offset].store(block, std::memory_order_release);
     return block;
 }
 
@@ -194,10 +263,38 @@ const X86::Reg<u8> A = X86::dh;
 const X86::Reg<u8> X = X86::bl;
 const X86::Reg<u8> Y = X86::bh;
 
-static u8 requiredFlags;
+/**
+ * Instance base register, loaded with the address of the CPU ram of the
+ * running instance. The recompiled code addresses the instance memories
+ * relative to this register, never with absolute addresses.
+ */
+const X86::Reg<u32> Base = X86::ebp;
+
+/* Flags required after the instruction being compiled. */
+static thread_local u8 requiredFlags;
 
 };
 
+/**
+ * Return the operand addressing \p ptr, which must belong to the memories
+ * of the current instance, relative to the instance base register. The
+ * offset is the same for all the instances.
+ */
+static X86::Mem instanceMem(const void *ptr)
+{
+    return Jit::Base((const u8 *)ptr - Memory::state->ram);
+}
+
+/**
+ * Load the address of the zero page byte \p off into eax. The ram is
+ * aligned on 0x100 so that the zero page can be indexed through al.
+ */
+static void loadZeroPageAddress(X86::Emitter &emit, u8 off)
+{
+    emit.MOV(X86::eax, Jit::Base);
+    emit.MOV(X86::al, off);
+}
+
 /**
  * Increment the cycle count.
  */
@@ -210,11 +307,12 @@ static void incrementCycles(X86::Emitter &emit, u32 upd)
 }
 
 /**
- * Check the cycle count.
+ * Check the cycle count against the exit bound, and return to the
+ * interpreter with the instruction at \p address if it is reached.
  */
 static void checkCycles(X86::Emitter &emit, u16 address)
 {
-    emit.CMP(X86::esi, 0);
+    emit.CMP(X86::esi, instanceMem(&state->jitLimit));
     u32 *jmp = emit.JL();
     emit.MOV(X86::eax, address);
     emit.POPF();
@@ -514,15 +612,11 @@ static inline void CLC(X86::Emitter &emit) {
 }
 
 static inline void CLD(X86::Emitter &emit) {
-    u8 *p = &state->regs.p;
-    emit.MOV(X86::eax, (u32)p);
-    emit.AND(X86::eax(), (u8)0xf7);
+    emit.AND(instanceMem(&state->regs.p), (u8)0xf7);
 }
 
 static inline void CLI(X86::Emitter &emit) {
-    u8 *p = &state->regs.p;
-    emit.MOV(X86::eax, (u32)p);
-    emit.AND(X86::eax(), (u8)0xfb);
+    emit.AND(instanceMem(&state->regs.p), (u8)0xfb);
 }
 
 static inline void CLV(X86::Emitter &emit) {
@@ -567,9 +661,7 @@ static inline void PHA(X86::Emitter &emit) {
 }
 
 static inline void PHP(X86::Emitter &emit) {
-    u8 *p = &state->regs.p;
-    emit.MOV(X86::eax, (u32)p);
-    emit.MOV(Jit::M, X86::eax());
+    emit.MOV(Jit::M, instanceMem(&state->regs.p));
     emit.AND(Jit::M, 0x3c); // Clear Carry, Zero, Overflow, Sign flags
     emit.OR(Jit::M, 0x30); // Set virtual flags
     emit.POP(X86::ecx);
@@ -590,13 +682,11 @@ static inline void PLA(X86::Emitter &emit) {
 }
 
 static inline void PLP(X86::Emitter &emit) {
-    u8 *p = &state->regs.p;
     /* Unstack new flag values */
     PULL(emit, Jit::M);
     emit.AND(Jit::M, ~0x30); // Clear virtual flags
     /* Update Interrupt, Decimal, etc. flags in state memory. */
-    emit.MOV(X86::eax, (u32)p);
-    emit.MOV(X86::eax(), Jit::M);
+    emit.MOV(instanceMem(&state->regs.p), Jit::M);
     /* Update x86 status flags. */
     emit.POP(X86::ecx);
     emit.AND(X86::ecx, 0xfffff73e); // Clear Carry, Zero, Sign, Overflow bits
@@ -618,15 +708,11 @@ static inline void SEC(X86::Emitter &emit) {
 }
 
 static inline void SED(X86::Emitter &emit) {
-    u8 *p = &state->regs.p;
-    emit.MOV(X86::eax, (u32)p);
-    emit.OR(X86::eax(), (u8)0x8);
+    emit.OR(instanceMem(&state->regs.p), (u8)0x8);
 }
 
 static inline void SEI(X86::Emitter &emit) {
-    u8 *p = &state->regs.p;
-    emit.MOV(X86::eax, (u32)p);
-    emit.OR(X86::eax(), (u8)0x4);
+    emit.OR(instanceMem(&state->regs.p), (u8)0x4);
 }
 
 static inline void TAX(X86::Emitter &emit) {
@@ -746,9 +832,8 @@ static void loadZeroPage(
     bool wb,
     const X86::Reg<u8> &r = Jit::M)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
-    emit.MOV(X86::eax, (u32)(zp + off));
+    loadZeroPageAddress(emit, off);
     emit.MOV(r, X86::eax());
     cont(emit, r);
     if (wb)
@@ -760,9 +845,8 @@ static void storeZeroPage(
     u16 pc,
     const X86::Reg<u8> &r)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
-    emit.MOV(X86::eax, (u32)(zp + off));
+    loadZeroPageAddress(emit, off);
     emit.MOV(X86::eax(), r);
 }
 
@@ -774,9 +858,8 @@ static void loadZeroPageIndexed(
     const X86::Reg<u8> &p,
     const X86::Reg<u8> &r = Jit::M)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
-    emit.MOV(X86::eax, (u32)(zp + off));
+    loadZeroPageAddress(emit, off);
     emit.ADD(X86::al, p);
     emit.MOV(r, X86::eax());
     cont(emit, r);
@@ -790,115 +873,141 @@ static void storeZeroPageIndexed(
     const X86::Reg<u8> &p,
     const X86::Reg<u8> &r)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
-    emit.MOV(X86::eax, (u32)(zp + off));
+    loadZeroPageAddress(emit, off);
     emit.ADD(X86::al, p);
     emit.MOV(X86::eax(), r);
 }
 
-static void loadAbsolute(
-    X86::Emitter &emit,
-    u16 pc,
-    Operation cont,
-    bool wb,
-    const X86::Reg<u8> &r = Jit::M)
+/**
+ * Store called by the recompiled code. The stores to the registers may
+ * raise an interrupt or move the next interrupt deadline: the code then
+ * returns at the end of the instruction, and the quantum is recomputed.
+ */
+static void storeMemory(u16 addr, u8 val, long quantum)
 {
-    u16 addr = Memory::loadw(pc + 1);
+    Memory::store(addr, val, quantum);
+    if (addr >= 0x2000 && (addr < 0x6000 || addr >= 0x8000))
+        state->jitLimit = LONG_MIN;
+}
+
+/**
+ * Call Memory::load with the address in \p r, at the current cycle count.
+ * The value is returned in al, ecx and edx are preserved.
+ */
+static void callLoad(X86::Emitter &emit, const X86::Reg<u32> &r)
+{
+    emit.PUSH(X86::ecx);
     emit.PUSH(X86::edx);
     emit.PUSH(X86::esi);
-    emit.PUSH((u32)addr);
+    emit.PUSH(r);
     emit.CALL((u8 *)Memory::load);
-    emit.POP(X86::ecx);
     emit.POP(X86::edx);
     emit.POP(X86::edx);
-    emit.MOV(Jit::M, X86::al);
-    cont(emit, Jit::M);
-    if (wb) {
-        emit.PUSH(X86::esi);
-        emit.PUSH(X86::edx);
-        emit.PUSH((u32)addr);
-        emit.CALL((u8 *)Memory::store);
-        emit.POP(X86::ecx);
-        emit.POP(X86::edx);
-        emit.POP(X86::eax);
-    }
+    emit.POP(X86::edx);
+    emit.POP(X86::ecx);
 }
 
-static void storeAbsolute(
-    X86::Emitter &emit,
-    u16 pc,
-    const X86::Reg<u8> &r)
+/**
+ * Store M to the address in \p r, at the current cycle count. eax is
+ * overwritten, ecx and edx are preserved.
+ */
+static void callStore(X86::Emitter &emit, const X86::Reg<u32> &r)
 {
-    u16 addr = Memory::loadw(pc + 1);
-    if (r != Jit::M)
-        emit.MOV(Jit::M, r);
+    emit.PUSH(X86::ecx);
+    emit.PUSH(X86::edx);
     emit.PUSH(X86::esi);
     emit.PUSH(X86::edx);
-    emit.PUSH((u32)addr);
-    emit.CALL((u8 *)Memory::store);
-    emit.POP(X86::ecx);
-    emit.POP(X86::edx);
+    emit.PUSH(r);
+    emit.CALL((u8 *)storeMemory);
+    emit.POP(X86::eax);
     emit.POP(X86::eax);
+    emit.POP(X86::eax);
+    emit.POP(X86::edx);
+    emit.POP(X86::ecx);
 }
 
 /**
  * Implement the Oops cycle.
- * A first fecth is performed at the partially computed address addr + x
- * (without wrapping), and repeated if the addition causes the high u8 to
- * change.
+ * Add the index \p p to the address in ecx. A first fetch is performed at
+ * the partially computed address (without wrapping) if the addition causes
+ * the high byte to change, followed by an extra cycle ; the instructions
+ * writing to memory (\p wb) always perform the first fetch, and have no
+ * extra cycle.
  */
-static void loadAbsoluteIndexed(
+static void indexAddress(
     X86::Emitter &emit,
-    u16 pc,
-    Operation cont,
-    bool wb,
     const X86::Reg<u8> &p,
-    const X86::Reg<u8> &r = Jit::M)
+    bool wb)
 {
-    u16 addr = Memory::loadw(pc + 1);
-    emit.MOV(X86::eax, (u32)addr);
+    emit.MOV(X86::eax, X86::ecx);
     emit.ADD(X86::al, p);
+    emit.MOV(X86::cl, X86::al);
     u32 *jmp = emit.JNC();
-    // Implement Oops cycle if the page changes. If the instruction is a
-    // Read-Modify write, the dummy read is always compiled in.
-    //
-    // Note: the dummy read is important only if the address is linked
-    // to the PPU registers.
+    emit.INC(X86::ch);
     if (!wb) {
+        callLoad(emit, X86::eax);
         emit.INC(X86::esi);
     }
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::eax);
-    emit.CALL((u8 *)Memory::load0);
-    emit.POP(X86::eax);
-    emit.POP(X86::edx);
-    emit.INC(X86::ah);
-    // Back to regular load.
     emit.setJump(jmp);
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::eax);
-    emit.CALL((u8 *)Memory::load0);
-    emit.POP(X86::ecx);
-    emit.POP(X86::edx);
+    if (wb)
+        callLoad(emit, X86::eax);
+}
+
+/**
+ * Load M from the address in ecx, and apply the operation \p cont. If the
+ * instruction is a Read-Modify-Write, the old value is written back before
+ * the result.
+ */
+static void loadAddress(X86::Emitter &emit, Operation cont, bool wb)
+{
+    callLoad(emit, X86::ecx);
     emit.MOV(Jit::M, X86::al);
-    // Double write back, old value is written once to the new address.
     if (wb) {
-        emit.PUSH(X86::edx);
-        emit.PUSH(X86::ecx);
-        emit.CALL((u8 *)Memory::store0);
-        emit.POP(X86::ecx);
-        emit.POP(X86::edx);
+        callStore(emit, X86::ecx);
         emit.MOV(X86::eax, X86::ecx);
     }
     cont(emit, Jit::M);
-    if (wb) {
-        emit.PUSH(X86::edx);
-        emit.PUSH(X86::eax);
-        emit.CALL((u8 *)Memory::store0);
-        emit.POP(X86::ecx);
-        emit.POP(X86::edx);
-    }
+    if (wb)
+        callStore(emit, X86::eax);
+}
+
+static void loadAbsolute(
+    X86::Emitter &emit,
+    u16 pc,
+    Operation cont,
+    bool wb,
+    const X86::Reg<u8> &r = Jit::M)
+{
+    u16 addr = Memory::loadw(pc + 1);
+    emit.MOV(X86::ecx, (u32)addr);
+    loadAddress(emit, cont, wb);
+}
+
+static void storeAbsolute(
+    X86::Emitter &emit,
+    u16 pc,
+    const X86::Reg<u8> &r)
+{
+    u16 addr = Memory::loadw(pc + 1);
+    if (r != Jit::M)
+        emit.MOV(Jit::M, r);
+    emit.MOV(X86::ecx, (u32)addr);
+    callStore(emit, X86::ecx);
+}
+
+static void loadAbsoluteIndexed(
+    X86::Emitter &emit,
+    u16 pc,
+    Operation cont,
+    bool wb,
+    const X86::Reg<u8> &p,
+    const X86::Reg<u8> &r = Jit::M)
+{
+    u16 addr = Memory::loadw(pc + 1);
+    emit.MOV(X86::ecx, (u32)addr);
+    indexAddress(emit, p, wb);
+    loadAddress(emit, cont, wb);
 }
 
 static void storeAbsoluteIndexed(
@@ -910,15 +1019,21 @@ static void storeAbsoluteIndexed(
     u16 addr = Memory::loadw(pc + 1);
     if (r != Jit::M)
         emit.MOV(Jit::M, r);
-    emit.MOV(X86::eax, (u32)addr);
+    emit.MOV(X86::ecx, (u32)addr);
+    indexAddress(emit, p, true);
+    callStore(emit, X86::ecx);
+}
+
+/**
+ * Load the address stored in the zero page at the address in eax into ecx
+ * (the pointer wraps around the zero page).
+ */
+static void loadZeroPagePointer(X86::Emitter &emit)
+{
     emit.MOV(X86::ecx, 0);
-    emit.MOV(X86::cl, p);
-    emit.ADD(X86::eax, X86::ecx);
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::eax);
-    emit.CALL((u8 *)Memory::store0);
-    emit.POP(X86::eax);
-    emit.POP(X86::edx);
+    emit.MOV(X86::cl, X86::eax());
+    emit.INC(X86::al);
+    emit.MOV(X86::ch, X86::eax());
 }
 
 static void loadIndexedIndirect(
@@ -928,37 +1043,11 @@ static void loadIndexedIndirect(
     bool wb,
     const X86::Reg<u8> &r = Jit::M)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
-    emit.MOV(X86::eax, (u32)(zp + off));
-    emit.MOV(X86::ecx, 0);
+    loadZeroPageAddress(emit, off);
     emit.ADD(X86::al, Jit::X);
-    emit.MOV(X86::cl, X86::eax());
-    emit.INC(X86::al);
-    emit.MOV(X86::ch, X86::eax());
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::ecx);
-    emit.CALL((u8 *)Memory::load0);
-    emit.POP(X86::ecx);
-    emit.POP(X86::edx);
-    emit.MOV(Jit::M, X86::al);
-    // Double write back, old value is written once to the new address.
-    if (wb) {
-        emit.PUSH(X86::edx);
-        emit.PUSH(X86::ecx);
-        emit.CALL((u8 *)Memory::store0);
-        emit.POP(X86::ecx);
-        emit.POP(X86::edx);
-        emit.MOV(X86::eax, X86::ecx);
-    }
-    cont(emit, Jit::M);
-    if (wb) {
-        emit.PUSH(X86::edx);
-        emit.PUSH(X86::eax);
-        emit.CALL((u8 *)Memory::store0);
-        emit.POP(X86::ecx);
-        emit.POP(X86::edx);
-    }
+    loadZeroPagePointer(emit);
+    loadAddress(emit, cont, wb);
 }
 
 static void storeIndexedIndirect(
@@ -966,29 +1055,15 @@ static void storeIndexedIndirect(
     u16 pc,
     const X86::Reg<u8> &r)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
     if (r != Jit::M)
         emit.MOV(Jit::M, r);
-    emit.MOV(X86::eax, (u32)(zp + off));
-    emit.MOV(X86::ecx, 0);
+    loadZeroPageAddress(emit, off);
     emit.ADD(X86::al, Jit::X);
-    emit.MOV(X86::cl, X86::eax());
-    emit.INC(X86::al);
-    emit.MOV(X86::ch, X86::eax());
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::ecx);
-    emit.CALL((u8 *)Memory::store0);
-    emit.POP(X86::ecx);
-    emit.POP(X86::edx);
+    loadZeroPagePointer(emit);
+    callStore(emit, X86::ecx);
 }
 
-/**
- * Implement the Oops cycle.
- * A first fecth is performed at the partially computed address
- * (without wrapping), and repeated if the addition causes the high u8 to
- * change.
- */
 static void loadIndirectIndexed(
     X86::Emitter &emit,
     u16 pc,
@@ -996,83 +1071,25 @@ static void loadIndirectIndexed(
     bool wb,
     const X86::Reg<u8> &r = Jit::M)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
-    emit.MOV(X86::eax, (u32)(zp + off));
-    emit.MOV(X86::ecx, 0);
-    emit.MOV(X86::cl, X86::eax());
-    emit.INC(X86::al);
-    emit.MOV(X86::ch, X86::eax());
-    emit.ADD(X86::cl, Jit::Y);
-    u32 *jmp = emit.JNC();
-    // Implement Oops cycle if the page changes.
-    // Note: the dummy read is important only if the address is linked
-    // to the PPU registers.
-    if (!wb) {
-        emit.INC(X86::esi);
-    }
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::ecx);
-    emit.CALL((u8 *)Memory::load0);
-    emit.POP(X86::ecx);
-    emit.POP(X86::edx);
-    emit.INC(X86::ch);
-    // Back to regular load.
-    emit.setJump(jmp);
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::ecx);
-    emit.CALL((u8 *)Memory::load0);
-    emit.POP(X86::ecx);
-    emit.POP(X86::edx);
-    emit.MOV(Jit::M, X86::al);
-    // Double write back, old value is written once to the new address.
-    if (wb) {
-        emit.PUSH(X86::edx);
-        emit.PUSH(X86::ecx);
-        emit.CALL((u8 *)Memory::store0);
-        emit.POP(X86::ecx);
-        emit.POP(X86::edx);
-        emit.MOV(X86::eax, X86::ecx); // Save write back address to eax
-    }
-    cont(emit, Jit::M);
-    if (wb) {
-        emit.PUSH(X86::edx);
-        emit.PUSH(X86::eax);
-        emit.CALL((u8 *)Memory::store0);
-        emit.POP(X86::ecx);
-        emit.POP(X86::edx);
-    }
+    loadZeroPageAddress(emit, off);
+    loadZeroPagePointer(emit);
+    indexAddress(emit, Jit::Y, wb);
+    loadAddress(emit, cont, wb);
 }
 
-/**
- * Implement the Oops cycle.
- * A first fecth is performed at the partially computed address addr + y
- * (without wrapping).
- */
 static void storeIndirectIndexed(
     X86::Emitter &emit,
     u16 pc,
     const X86::Reg<u8> &r)
 {
-    u8 *zp = Memory::ram;
     u8 off = Memory::load(pc + 1);
-    emit.MOV(X86::eax, (u32)(zp + off));
-    emit.MOV(X86::ecx, 0);
-    emit.MOV(X86::cl, X86::eax());
-    emit.INC(X86::al);
-    emit.MOV(X86::ch, X86::eax());
-    emit.ADD(X86::cl, Jit::Y);
-    // TODO perform load at intermediate address (without wrapping)
-    u32 *jmp = emit.JNC();
-    emit.INC(X86::ch);
-    emit.setJump(jmp);
     if (r != Jit::M)
         emit.MOV(Jit::M, r);
-    emit.PUSH(X86::edx);
-    emit.PUSH(X86::ecx);
-    emit.CALL((u8 *)Memory::store0);
-    emit.POP(X86::ecx);
-    emit.POP(X86::edx);
+    loadZeroPageAddress(emit, off);
+    loadZeroPagePointer(emit);
+    indexAddress(emit, Jit::Y, true);
+    callStore(emit, X86::ecx);
 }
 
 /**
@@ -1172,7 +1189,6 @@ static void storeIndirectIndexed(
 /** Create a banch instruction with the given condition. */
 #define CASE_BR_REL(op, oppcond)                                               \
     case op##_REL: {                                                           \
-        checkCycles(emit, address);                                            \
         emit.POPF();                                                           \
         u32 *__next = oppcond();                                               \
         emit.PUSHF();                                                          \
@@ -1197,6 +1213,12 @@ void Instruction::compile(X86::Emitter &emit)
         return;
     }
 
+    /*
+     * Stop on the first instruction boundary past the quantum, where the
+     * interpreter would see the next event.
+     */
+    checkCycles(emit, address);
+
     /* Interpret instruction. */
     switch (opcode)
     {
@@ -1527,19 +1549,20 @@ extern "C" {
  * Assembly entry point.
  *
  * The quantum is negative and incremented for each instruction. It is tested
- * for zero at each branch instructions, meaning the jit can emulate more
- * cpu cycles than indicated by the \p quantum.
+ * before each instruction, meaning the jit emulates the instructions
+ * starting before the end of the \p quantum, as the interpreter would.
  *
  * @param code      Pointer to recompiled native code
  * @param regs      Pointer to the structure containing the register values
- * @param stack     Pointer to the start of the 6502 stack buffer
+ * @param ram       Pointer to the CPU ram of the instance, loaded into the
+ *                  instance base register
  * @param quantum   Expected number of cycles to emulate
  * @return          Incremented value of the quantum
  */
 extern long asmEntry(
     const void *nativeCode,
     Registers *regs,
-    u8 *stack,
+    u8 *ram,
     long quantum);
 };
 
@@ -1555,8 +1578,7 @@ void Instruction::run(long quantum)
 
     // trace(opcode);
     Registers *regs = &state->regs;
-    u8 *stack = Memory::ram + 0x100;
     state->cycles += quantum;
-    long r = asmEntry(nativeCode, regs, stack, -quantum);
+    long r = asmEntry(nativeCode, regs, Memory::state->ram, -quantum);
     state->cycles += r;
 }
@@ -2,6 +2,8 @@
 #ifndef _M6502JIT_H_INCLUDED_
 #define _M6502JIT_H_INCLUDED_
 
+#include <atomic>
+#include <mutex>
 #include <queue>
 #include <stack>
 
@@ -51,29 +53,64 @@ private:
     u32 *nativeBranchAddress;
 };
 
+/**
+ * @brief Recompiled code of the PRG-ROM, indexed by the 8K CPU window and
+ *  the PRG-ROM page mapped in it.
+ *
+ *  The code of a page only depends on the ROM contents: the blocks never
+ *  run nor branch into another window, and return to the interpreter
+ *  instead. The code stays valid when the mapper switches the banks.
+ *
+ *  A cache can be shared by instances running on separate threads:
+ *  compilation is serialized, and the blocks already compiled are looked up
+ *  without locking. The native code of a returned block is never modified.
+ */
 class InstructionCache
 {
 public:
-    InstructionCache(CodeBuffer *buffer);
+    InstructionCache(const u8 *prgRom, size_t prgRomSize,
+                     size_t capacity = 0x100000);
     ~InstructionCache();
 
-    Instruction *fetchInstruction(u16 address);
+    /**
+     * @brief Return the block starting at \p address in the banks mapped
+     *  by the current instance, compiling it if needed, or NULL if the
+     *  address is not in the PRG-ROM.
+     */
     Instruction *cache(u16 address);
 
     size_t getSize() const { return _asmEmitter.getSize(); }
+    size_t getCapacity() const { return _asmEmitter.getCapacity(); }
 
 private:
+    /** Instructions of one PRG-ROM page mapped in one window. */
+    struct Page {
+        Instruction *instructions[0x2000];
+        /** Blocks returned by \ref cache, published to the other threads. */
+        std::atomic<Instruction *> blocks[0x2000];
+    };
+
+    long getPageIndex(u16 address) const;
     Instruction *cacheInstruction(u16 address);
     Instruction *cacheBlock(u16 address);
+    const u8 *compileExit(u16 address);
 
+    CodeBuffer _buffer;
     X86::Emitter _asmEmitter;
-    Instruction **_cache;
-    size_t _cacheSize;
+    const u8 *_prgRom;
+    size_t _prgRomSize;
+    size_t _pageCount;
+    /** Pages indexed by window and PRG-ROM page, allocated on first use. */
+    std::atomic<Page *> *_pages;
+    std::mutex _lock;
     std::queue<Instruction *> _queue;
     std::stack<Instruction *> _stack;
 };
 
-extern InstructionCache cache;
+/**
+ * @brief Recompiled code of the instance running on the calling thread.
+ */
+extern thread_local InstructionCache *cache;
 
 };
 
@@ -8,7 +8,7 @@
 using namespace M6502;
 
 namespace M6502 {
-    State *state = NULL;
+    thread_local State *state = NULL;
 };
 
 State::State()
@@ -16,10 +16,6 @@ State::State()
     clear();
 }
 
-State::~State()
-{
-}
-
 void State::clear()
 {
     regs.pc = 0;
@@ -30,7 +26,8 @@ void State::clear()
     regs.p = 0x24;
     cycles = 0;
     nmi = false;
-    irq = false;
+    irq = 0;
+    jitLimit = 0;
 }
 
 void State::reset()
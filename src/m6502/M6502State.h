@@ -7,6 +7,16 @@
 
 namespace M6502 {
 
+/**
+ * Sources of the IRQ line, bits of \ref State::irq. Each source asserts
+ * and releases its own bit, the line is asserted while any bit is set.
+ */
+enum IrqSource {
+    IRQ_FRAME       = 1 << 0,   /**< APU frame counter. */
+    IRQ_DMC         = 1 << 1,   /**< APU delta modulation channel. */
+    IRQ_MAPPER      = 1 << 2,   /**< Cartridge mapper. */
+};
+
 struct Registers
 {
     u8 a;
@@ -21,7 +31,8 @@ class State
 {
 public:
     State();
-    ~State();
+    /* Trivial destructor: the state is saved and restored by copy. */
+    ~State() = default;
 
     /**
      * @brief Set the cpu registers to the default boot values.
@@ -43,14 +54,48 @@ public:
     /** Set to true if an NMI is pending. */
     bool nmi;
 
-    /** Set to true if an IRQ is pending. */
-    bool irq;
+    /**
+     * IRQ line, one bit per asserting source (see \ref IrqSource). The
+     * interrupt is taken while non-zero and not masked: the sources
+     * release the line when the interrupt is acknowledged.
+     */
+    u8 irq;
+
+    /**
+     * Exit bound of the recompiled code: the code returns at the first
+     * instruction boundary where the (negative) quantum counter is greater
+     * than or equal to this value. Zero while running, lowered by the
+     * recompiled stores to the registers so that the quantum is recomputed
+     * with the new deadlines.
+     */
+    long jitLimit;
 };
 
 /**
- * @brief Global cpu state object.
+ * @brief CPU state of the instance running on the calling thread.
  */
-extern State *state;
+extern thread_local State *state;
+
+/**
+ * @brief Assert (resp. release) the IRQ line for the source \p source.
+ */
+static inline void raiseIrq(IrqSource source)
+{
+    state->irq |= source;
+}
+
+static inline void clearIrq(IrqSource source)
+{
+    state->irq &= ~source;
+}
+
+static inline void setIrq(IrqSource source, bool asserted)
+{
+    if (asserted)
+        raiseIrq(source);
+    else
+        clearIrq(source);
+}
 
 static_assert(offsetof(Registers, a) == 0, "Unexpected Registers.a offset");
 static_assert(offsetof(Registers, x) == 1, "Unexpected Registers.x offset");
@@ -1,27 +1,210 @@
 
 #include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <unistd.h>
 
-#include "Rom.h"
+#include "Emulator.h"
 #include "Core.h"
-#include "Mapper.h"
 #include "Joypad.h"
+#include "Movie.h"
+#include "Audio.h"
 #include "Events.h"
+#include "Video.h"
+#include "Stats.h"
+#include "Memory.h"
 #include "M6502State.h"
 #include "N2C02State.h"
 
+#ifndef HEADLESS
+#include "SDLBackend.h"
+#endif
+
+static int usage()
+{
+    std::cerr << "usage: nes [-i] [-r seed] [-s frames] [-R megabytes]";
+    std::cerr << " [-l frames] [-m|-p|-a movie] [-w wav] <rom>";
+#ifdef HEADLESS
+    std::cerr << " [frames]" << std::endl;
+    std::cerr << "       nes -b [-i] [-r seed] <rom> <frames>";
+#endif
+    std::cerr << std::endl;
+    return 1;
+}
+
+#ifdef HEADLESS
+/**
+ * @brief FNV-1a hash of the CPU ram and the last frame, compared between
+ *  benchmark runs to check that the emulation is deterministic.
+ */
+static u32 hashState(const Video::FrameCollector *collector)
+{
+    u32 h = 2166136261u;
+    for (size_t i = 0; i < 0x800; i++)
+        h = (h ^ Memory::state->ram[i]) * 16777619u;
+
+    const u32 *frame = collector->getFrame(0);
+    size_t size = collector->getWidth() * collector->getHeight();
+    for (size_t i = 0; frame != NULL && i < size; i++)
+        h = (h ^ frame[i]) * 16777619u;
+    return h;
+}
+
+/**
+ * @brief Dump the results of a benchmark run as a single line JSON object.
+ */
+static void dumpBench(const char *rom, bool jit, double elapsed,
+                      const Video::FrameCollector *collector)
+{
+    ulong frames = N2C02::state->frame;
+    ulong cycles = M6502::state->cycles;
+    double rate = elapsed > 0 ? 1. / elapsed : 0.;
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "{\"rom\":\"" << rom << "\"";
+    std::cout << ",\"backend\":\"" << (jit ? "jit" : "interpreter") << "\"";
+    std::cout << ",\"frames\":" << frames;
+    std::cout << ",\"cycles\":" << cycles;
+    std::cout << ",\"elapsed\":" << elapsed;
+    std::cout << ",\"frames_per_second\":" << frames * rate;
+    std::cout << ",\"cycles_per_second\":" << cycles * rate;
+    std::cout << ",\"peak_rss_kb\":" << Stats::getPeakRss();
+    std::cout << ",\"hash\":\"" << std::hex << std::setfill('0');
+    std::cout << std::setw(8) << hashState(collector) << std::dec << "\"}";
+    std::cout << std::endl;
+}
+#endif
+
 int main(int argc, char *argv[])
 {
+    int opt;
+    bool bench = false;
+    bool jit = true;
+    bool script = false;
+    u32 seed = 0;
+    const char *movieFile = NULL;
+    const char *audioFile = NULL;
+    Movie::Mode movieMode = Movie::MOVIE_RECORD;
+    int status = 0;
+
+    while ((opt = getopt(argc, argv, "bir:s:R:l:m:p:a:w:")) != -1) {
+        switch (opt) {
+            case 'b':
+                bench = true;
+                break;
+            case 'i':
+                /* Interpreter only. */
+                jit = false;
+                break;
+            case 'r':
+                /* Scripted input. */
+                script = true;
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                /* Dump a JSON report every N frames. */
+                Stats::setReportInterval(strtoul(optarg, NULL, 0), std::cout);
+                break;
+            case 'R':
+                /* Rewind buffer size, in megabytes. */
+                Core::setRewind(
+                    new Rewind((size_t)strtoul(optarg, NULL, 0) << 20));
+                break;
+            case 'l':
+                /* Run-ahead, in frames. */
+                Core::setRunAhead(strtoul(optarg, NULL, 0));
+                break;
+            case 'm':
+                /* Record an input movie. */
+                movieFile = optarg;
+                movieMode = Movie::MOVIE_RECORD;
+                break;
+            case 'p':
+                /* Play back an input movie. */
+                movieFile = optarg;
+                movieMode = Movie::MOVIE_PLAYBACK;
+                break;
+            case 'a':
+                /* Play back an input movie, checking the ram hashes. */
+                movieFile = optarg;
+                movieMode = Movie::MOVIE_AUDIT;
+                break;
+            case 'w':
+                /* Write the audio output to a WAV file. */
+                audioFile = optarg;
+                break;
+            default:
+                return usage();
+        }
+    }
+    if (optind >= argc)
+        return usage();
+
     try {
-        currentRom = new Rom(argv[1]);
-        M6502::state = new M6502::State();
-        // N2C02::currentState = new N2C02::State();
-        Joypad::currentJoypad = new Joypad::Joypad();
-        N2C02::init();
+#ifndef HEADLESS
+        if (bench)
+            return usage();
+        SDLEvents *events = new SDLEvents();
+        Video::setBackend(new Video::Presenter(new SDLVideo(events)));
+        Events::setBackend(events);
+        Audio::setBackend(new SDLAudio());
+#else
+        /* Stop after the requested number of frames. */
+        ulong frames =
+            optind + 1 < argc ? strtoul(argv[optind + 1], NULL, 0) : 0;
+        if (bench && frames == 0)
+            return usage();
+        Video::FrameCollector *collector = new Video::FrameCollector();
+        Video::setBackend(collector);
+        Core::setFrameLimit(frames);
+#endif
+        if (audioFile != NULL)
+            Audio::setBackend(new Audio::FileSink(audioFile));
+        /* Movies and benchmarks start from a blank battery RAM. */
+        Rom::setSaveFiles(movieFile == NULL && !bench);
+        /* The benchmark results are the only output. */
+        Rom::setVerbose(!bench);
+        Emulator *emulator = new Emulator(argv[optind]);
+        Movie *movie = NULL;
+        if (movieFile != NULL) {
+            movie = new Movie(movieFile, movieMode, jit);
+            Core::setMovie(movie);
+        }
+        /* The event backend owns the window the video backend draws to. */
         Events::init();
+        N2C02::init();
+        Audio::init();
+        Core::setJit(jit);
+        if (script)
+            Core::setFrameCallback([seed] (ulong frame) {
+                Joypad::scriptInput(Joypad::currentJoypad, seed, frame);
+            });
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
         Core::emulate();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+#ifdef HEADLESS
+        if (bench)
+            dumpBench(argv[optind], jit, elapsed.count(), collector);
+#else
+        (void)elapsed;
+#endif
+        Audio::quit();
         N2C02::quit();
+        Events::shutdown();
+        if (movie != NULL) {
+            if (movie->getDesync() >= 0)
+                status = 1;
+            Core::setMovie(NULL);
+            delete movie;
+        }
+        delete emulator;
     } catch (const std::exception &exc) {
         std::cerr << "Fatal error (main): " << exc.what() << std::endl;
+        status = 1;
     }
-    return 0;
+    return status;
 }
@@ -0,0 +1,15 @@
+
+#include "axrom.h"
+
+static Mapper *createAxROM(Rom *rom) {
+    return new AxROM(rom);
+}
+
+/**
+ * Install the AxROM mapper.
+ */
+static void insert(void) __attribute__((constructor));
+static void insert(void)
+{
+    mappers[7] = createAxROM;
+}
@@ -0,0 +1,40 @@
+
+#ifndef _AXROM_H_INCLUDED_
+#define _AXROM_H_INCLUDED_
+
+#include "BankMapper.h"
+#include "N2C02State.h"
+
+/**
+ * AxROM (mapper 7): one switchable 32K PRG-ROM window, 8K of CHR-RAM,
+ * single screen mirroring selected by the bank register.
+ */
+class AxROM final : public BankMapper
+{
+public:
+    AxROM(Rom *rom)
+        : BankMapper(rom, MAPPER_AXROM, "AxROM", &_bankRegister,
+                     sizeof(_bankRegister)) {
+        remap();
+    }
+
+    ~AxROM() {
+    }
+
+    void storePrg(u16 addr, u8 val) {
+        (void)addr;
+        _bankRegister = val;
+        remap();
+    }
+
+private:
+    u8 _bankRegister;
+
+    void remap() {
+        mapPrg(0x8000, 0x8000, _bankRegister & 0x7);
+        mapChr(0x0000, 0x2000, 0);
+        N2C02::set1ScreenMirroring((_bankRegister & 0x10) != 0);
+    }
+};
+
+#endif /* _AXROM_H_INCLUDED_ */
@@ -0,0 +1,37 @@
+
+#ifndef _CNROM_H_INCLUDED_
+#define _CNROM_H_INCLUDED_
+
+#include "BankMapper.h"
+
+/**
+ * CNROM (mapper 3): fixed PRG-ROM, one switchable 8K CHR-ROM bank.
+ */
+class CNROM final : public BankMapper
+{
+public:
+    CNROM(Rom *rom)
+        : BankMapper(rom, MAPPER_CNROM, "CNROM", &_bankRegister,
+                     sizeof(_bankRegister)) {
+        remap();
+    }
+
+    ~CNROM() {
+    }
+
+    void storePrg(u16 addr, u8 val) {
+        (void)addr;
+        _bankRegister = val;
+        mapChr(0x0000, 0x2000, _bankRegister);
+    }
+
+private:
+    u8 _bankRegister;
+
+    void remap() {
+        mapPrg(0x8000, 0x8000, 0);
+        mapChr(0x0000, 0x2000, _bankRegister);
+    }
+};
+
+#endif /* _CNROM_H_INCLUDED_ */
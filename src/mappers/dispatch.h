@@ -0,0 +1,42 @@
+
+#ifndef _DISPATCH_H_INCLUDED_
+#define _DISPATCH_H_INCLUDED_
+
+#include "Mapper.h"
+#include "nrom.h"
+#include "mmc1.h"
+#include "cnrom.h"
+#include "mmc3.h"
+#include "uxrom.h"
+#include "axrom.h"
+#include "gxrom.h"
+#include "mmc2.h"
+#include "mmc5.h"
+
+/**
+ * @brief Call the function object \p f with \p mapper cast to its concrete
+ *  class. \p f has a template call operator, instantiated for each mapper
+ *  class listed in \ref MapperType: the mapper methods it calls are
+ *  resolved at compile time and inlined. The mappers of type MAPPER_OTHER
+ *  are passed as is, and go through the virtual methods.
+ */
+template<typename F>
+static inline __attribute__((always_inline))
+void dispatchMapper(Mapper *mapper, F &f)
+{
+    switch (mapper->type) {
+        case MAPPER_NROM:   f(static_cast<NROM *>(mapper)); break;
+        case MAPPER_MMC1:   f(static_cast<MMC1 *>(mapper)); break;
+        case MAPPER_CNROM:  f(static_cast<CNROM *>(mapper)); break;
+        case MAPPER_MMC3:   f(static_cast<MMC3 *>(mapper)); break;
+        case MAPPER_UXROM:  f(static_cast<UxROM *>(mapper)); break;
+        case MAPPER_AXROM:  f(static_cast<AxROM *>(mapper)); break;
+        case MAPPER_GXROM:  f(static_cast<GxROM *>(mapper)); break;
+        case MAPPER_MMC2:   f(static_cast<MMC2 *>(mapper)); break;
+        case MAPPER_MMC4:   f(static_cast<MMC4 *>(mapper)); break;
+        case MAPPER_MMC5:   f(static_cast<MMC5 *>(mapper)); break;
+        default:            f(mapper); break;
+    }
+}
+
+#endif /* _DISPATCH_H_INCLUDED_ */
@@ -0,0 +1,15 @@
+
+#include "gxrom.h"
+
+static Mapper *createGxROM(Rom *rom) {
+    return new GxROM(rom);
+}
+
+/**
+ * Install the GxROM mapper.
+ */
+static void insert(void) __attribute__((constructor));
+static void insert(void)
+{
+    mappers[66] = createGxROM;
+}
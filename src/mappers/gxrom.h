@@ -0,0 +1,38 @@
+
+#ifndef _GXROM_H_INCLUDED_
+#define _GXROM_H_INCLUDED_
+
+#include "BankMapper.h"
+
+/**
+ * GxROM (mapper 66): one switchable 32K PRG-ROM window and one switchable
+ * 8K CHR-ROM window, selected by the same register.
+ */
+class GxROM final : public BankMapper
+{
+public:
+    GxROM(Rom *rom)
+        : BankMapper(rom, MAPPER_GXROM, "GxROM", &_bankRegister,
+                     sizeof(_bankRegister)) {
+        remap();
+    }
+
+    ~GxROM() {
+    }
+
+    void storePrg(u16 addr, u8 val) {
+        (void)addr;
+        _bankRegister = val;
+        remap();
+    }
+
+private:
+    u8 _bankRegister;
+
+    void remap() {
+        mapPrg(0x8000, 0x8000, (_bankRegister >> 4) & 0x3);
+        mapChr(0x0000, 0x2000, _bankRegister & 0x3);
+    }
+};
+
+#endif /* _GXROM_H_INCLUDED_ */
@@ -0,0 +1,113 @@
+
+#ifndef _MMC1_H_INCLUDED_
+#define _MMC1_H_INCLUDED_
+
+#include "BankMapper.h"
+#include "Memory.h"
+#include "N2C02State.h"
+
+/**
+ * MMC1 (mapper 1): the registers are written one bit at a time through a
+ * serial load register. PRG-ROM in one 32K or two 16K windows, CHR in one
+ * 8K or two 4K windows, controlled mirroring.
+ */
+class MMC1 final : public BankMapper
+{
+public:
+    MMC1(Rom *rom)
+        : BankMapper(rom, MAPPER_MMC1, "MMC1", &_regs, sizeof(_regs)) {
+        /* PRG-RAM, absent from some boards. */
+        Memory::configPrgRam(rom->prgRam, rom->prgRamSize);
+        Memory::state->prgRamEnabled = true;
+        /* The mirroring is undefined at power on: keep the header's. */
+        _regs.controlRegister =
+            rom->config.verticalMirroring ? 0x0e : 0x0f;
+        remap();
+    }
+
+    ~MMC1() {
+    }
+
+    void storePrg(u16 addr, u8 val) {
+        /* Reset the load register. */
+        if (val & 0x80) {
+            _regs.loadRegisterSize = 0;
+            _regs.controlRegister |= 0x0c;
+            remap();
+            return;
+        }
+        /* Feed data into the load register. */
+        _regs.loadRegister >>= 1;
+        _regs.loadRegister |= (val << 4);
+        _regs.loadRegisterSize++;
+
+        if (_regs.loadRegisterSize < 5)
+            return;
+
+        if (addr < 0xa000)
+            _regs.controlRegister = _regs.loadRegister;
+        else
+        if (addr < 0xc000)
+            _regs.chrBank0Register = _regs.loadRegister;
+        else
+        if (addr < 0xe000)
+            _regs.chrBank1Register = _regs.loadRegister;
+        else
+            _regs.prgBankRegister = _regs.loadRegister;
+        remap();
+
+        _regs.loadRegisterSize = 0;
+        _regs.loadRegister = 0;
+    }
+
+private:
+    /* Registers, grouped to be saved with one copy. */
+    struct {
+        /* Number of valid data bits in the load register */
+        uint loadRegisterSize;
+        u8 loadRegister;
+        u8 controlRegister;
+        u8 chrBank0Register;
+        u8 chrBank1Register;
+        u8 prgBankRegister;
+    } _regs;
+
+    void remap() {
+        u8 prg = _regs.prgBankRegister & 0xf;
+        Memory::state->prgRamWriteProtected =
+            (_regs.prgBankRegister & 0x10) != 0;
+
+        /* PRG bank switching mode. */
+        switch (_regs.controlRegister & 0xc) {
+            case 0x0:
+            case 0x4:
+                mapPrg(0x8000, 0x8000, prg >> 1);
+                break;
+            case 0x8:
+                mapPrg(0x8000, 0x4000, 0);
+                mapPrg(0xc000, 0x4000, prg);
+                break;
+            default:
+                mapPrg(0x8000, 0x4000, prg);
+                mapPrg(0xc000, 0x4000, -1);
+                break;
+        }
+
+        /* CHR bank switching mode. */
+        if (_regs.controlRegister & 0x10) {
+            mapChr(0x0000, 0x1000, _regs.chrBank0Register & 0x1f);
+            mapChr(0x1000, 0x1000, _regs.chrBank1Register & 0x1f);
+        } else
+            mapChr(0x0000, 0x2000, (_regs.chrBank0Register & 0x1e) >> 1);
+
+        /* Name table mirroring. */
+        switch (_regs.controlRegister & 0x3) {
+            case 0: N2C02::set1ScreenMirroring(0); break;
+            case 1: N2C02::set1ScreenMirroring(1); break;
+            case 2: N2C02::setVerticalMirroring(); break;
+            default: N2C02::setHorizontalMirroring(); break;
+        }
+    }
+};
+
+#endif /* _MMC1_H_INCLUDED_ */
@@ -0,0 +1,15 @@
+
+#include "mmc2.h"
+
+static Mapper *createMMC2(Rom *rom) {
+    return new MMC2(rom);
+}
+
+/**
+ * Install the MMC2 mapper.
+ */
+static void insert(void) __attribute__((constructor));
+static void insert(void)
+{
+    mappers[9] = createMMC2;
+}
@@ -0,0 +1,121 @@
+
+#ifndef _MMC2_H_INCLUDED_
+#define _MMC2_H_INCLUDED_
+
+#include "BankMapper.h"
+#include "Memory.h"
+#include "N2C02State.h"
+
+/**
+ * MMC2 (mapper 9) and MMC4 (mapper 10). Each 4K CHR window has two bank
+ * registers, selected by a latch flipped when the PPU fetches the tiles
+ * 0xfd or 0xfe of the pattern table. The MMC2 has one switchable 8K PRG-ROM
+ * window and three fixed ones, the MMC4 one switchable 16K window and a
+ * fixed one, and PRG-RAM.
+ */
+template<bool isMMC4>
+class MMC2Board : public BankMapper
+{
+public:
+    /* The CHR latches are flipped by the pattern fetches. */
+    static const bool watchesChr = true;
+
+    void storePrg(u16 addr, u8 val) {
+        switch (addr & 0xf000) {
+            case 0xa000:
+                _regs.prgBankRegister = val;
+                break;
+            case 0xb000:
+            case 0xc000:
+            case 0xd000:
+            case 0xe000:
+                _regs.chrBankRegister[(addr - 0xb000) >> 12] = val;
+                break;
+            case 0xf000:
+                _regs.mirroringRegister = val;
+                break;
+            default:
+                return;
+        }
+        remap();
+    }
+
+    /**
+     * Update the latches after the fetch of the sprite or tile row at
+     * \p addr. The MMC2 only flips the latch 0 on the first row of the
+     * tile 0xfd (resp. 0xfe), on any row for the latch 1.
+     */
+    void fetchChr(u16 addr) {
+        u16 row = addr & 0x1ff8;
+        int latch = addr >> 12;
+        u8 val;
+        if (row == 0x0fd8 || row == 0x1fd8)
+            val = 0;
+        else if (row == 0x0fe8 || row == 0x1fe8)
+            val = 1;
+        else
+            return;
+        if (!isMMC4 && latch == 0 && (addr & 0x7))
+            return;
+        if (_regs.latch[latch] != val) {
+            _regs.latch[latch] = val;
+            mapChr(latch << 12, 0x1000,
+                   _regs.chrBankRegister[2 * latch + val]);
+        }
+    }
+
+protected:
+    MMC2Board(Rom *rom, MapperType type, const std::string name)
+        : BankMapper(rom, type, name, &_regs, sizeof(_regs)) {
+        if (isMMC4) {
+            Memory::configPrgRam(rom->prgRam, rom->prgRamSize);
+            Memory::state->prgRamEnabled = true;
+        } else
+            Memory::state->prgRamEnabled = false;
+        _regs.latch[0] = 1;
+        _regs.latch[1] = 1;
+        remap();
+    }
+
+private:
+    /* Registers, grouped to be saved with one copy. */
+    struct {
+        u8 prgBankRegister;
+        /* Banks 0xfd and 0xfe of the window 0x0000, then 0x1000. */
+        u8 chrBankRegister[4];
+        u8 mirroringRegister;
+        u8 latch[2];
+    } _regs;
+
+    void remap() {
+        if (isMMC4) {
+            mapPrg(0x8000, 0x4000, _regs.prgBankRegister & 0xf);
+            mapPrg(0xc000, 0x4000, -1);
+        } else {
+            mapPrg(0x8000, 0x2000, _regs.prgBankRegister & 0xf);
+            mapPrg(0xa000, 0x2000, -3);
+            mapPrg(0xc000, 0x2000, -2);
+            mapPrg(0xe000, 0x2000, -1);
+        }
+        mapChr(0x0000, 0x1000, _regs.chrBankRegister[_regs.latch[0]]);
+        mapChr(0x1000, 0x1000, _regs.chrBankRegister[2 + _regs.latch[1]]);
+        if (_regs.mirroringRegister & 0x1)
+            N2C02::setHorizontalMirroring();
+        else
+            N2C02::setVerticalMirroring();
+    }
+};
+
+class MMC2 final : public MMC2Board<false>
+{
+public:
+    MMC2(Rom *rom) : MMC2Board(rom, MAPPER_MMC2, "MMC2") {}
+};
+
+class MMC4 final : public MMC2Board<true>
+{
+public:
+    MMC4(Rom *rom) : MMC2Board(rom, MAPPER_MMC4, "MMC4") {}
+};
+
+#endif /* _MMC2_H_INCLUDED_ */
@@ -0,0 +1,187 @@
+
+#ifndef _MMC3_H_INCLUDED_
+#define _MMC3_H_INCLUDED_
+
+#include <climits>
+
+#include "BankMapper.h"
+#include "Memory.h"
+#include "N2C02State.h"
+#include "M6502State.h"
+
+/**
+ * MMC3 (mapper 4): two switchable 8K PRG-ROM windows, two 2K and four 1K
+ * CHR windows, with swappable layouts; scanline counter clocked by the
+ * rises of the PPU A12 line.
+ */
+class MMC3 final : public BankMapper
+{
+public:
+    MMC3(Rom *rom)
+        : BankMapper(rom, MAPPER_MMC3, "MMC3", &_regs, sizeof(_regs)) {
+        /* PRG-RAM, absent from some boards. */
+        Memory::configPrgRam(rom->prgRam, rom->prgRamSize);
+        Memory::state->prgRamEnabled = true;
+        Memory::state->prgRamWriteProtected = true;
+
+        /* Initial banks. */
+        remap();
+    }
+
+    /* The IRQ counter is clocked by the rises of A12. */
+    static const bool watchesA12 = true;
+
+    void storePrg(u16 addr, u8 val)
+    {
+        if (addr < 0xa000) {
+            if (addr & 0x1) {
+                /* Bank data. */
+                writeBankDataRegister(val);
+            } else {
+                /* Bank select. */
+                writeBankSelectRegister(val);
+            }
+        }
+        else
+        if (addr < 0xc000) {
+            if (addr & 0x1) {
+                /* PRG-RAM protect. */
+                _regs.prgRamProtectRegister = val;
+                Memory::state->prgRamEnabled = (val & 0x80) != 0;
+                Memory::state->prgRamWriteProtected = (val & 0x40) != 0;
+            } else {
+                /* Mirroring control. */
+                _regs.mirroringRegister = val;
+                if (val & 0x1)  N2C02::setHorizontalMirroring();
+                else            N2C02::setVerticalMirroring();
+            }
+        }
+        else
+        if (addr < 0xe000) {
+            if (addr & 0x1) {
+                /* IRQ reload: the counter is reloaded on the next rise. */
+                _regs.irqCounter = 0;
+                _regs.irqReload = 1;
+            } else
+                /* IRQ latch */
+                _regs.irqLatch = val;
+            updateIrqDeadline();
+        }
+        else {
+            if (addr & 0x1)
+                /* IRQ enable */
+                _regs.irqEnabled = 1;
+            else {
+                /* IRQ disable, acknowledges the pending interrupt. */
+                _regs.irqEnabled = 0;
+                M6502::clearIrq(M6502::IRQ_MAPPER);
+            }
+            updateIrqDeadline();
+        }
+    }
+
+    /*
+     * The mirroring and PRG-RAM protection are restored with the PPU
+     * and memory states.
+     */
+    void loadState(const u8 *buf) {
+        BankMapper::loadState(buf);
+        updateIrqDeadline();
+    }
+
+    void sync() {
+        updateIrqDeadline();
+    }
+
+    /**
+     * Clock the IRQ counter: reload it when zero or requested, decrement
+     * it otherwise. The interrupt is asserted when the counter reaches
+     * zero.
+     */
+    void riseA12()
+    {
+        if (_regs.irqCounter == 0 || _regs.irqReload) {
+            _regs.irqCounter = _regs.irqLatch;
+            _regs.irqReload = 0;
+        } else
+            _regs.irqCounter--;
+
+        if (_regs.irqCounter == 0 && _regs.irqEnabled)
+            M6502::raiseIrq(M6502::IRQ_MAPPER);
+        updateIrqDeadline();
+    }
+
+    void updatePpu()
+    {
+        updateIrqDeadline();
+    }
+
+private:
+    /* Registers, grouped to be saved with one copy. */
+    struct {
+        u8 bankSelectRegister;
+        u8 bankRegister[8];
+        u8 prgRamProtectRegister;
+        u8 mirroringRegister;
+        u8 irqLatch;
+        u8 irqCounter;
+
+        bool irqEnabled;
+        bool irqReload;
+    } _regs;
+
+    void remap()
+    {
+        const u8 *r = _regs.bankRegister;
+
+        /* CHR banks: the 2K windows are swapped with the 1K windows. */
+        u16 chr2k = _regs.bankSelectRegister & 0x80 ? 0x1000 : 0x0000;
+        mapChr(chr2k, 0x800, r[0] >> 1);
+        mapChr(chr2k + 0x800, 0x800, r[1] >> 1);
+        mapChr(chr2k ^ 0x1000, 0x400, r[2]);
+        mapChr((chr2k ^ 0x1000) + 0x400, 0x400, r[3]);
+        mapChr((chr2k ^ 0x1000) + 0x800, 0x400, r[4]);
+        mapChr((chr2k ^ 0x1000) + 0xc00, 0x400, r[5]);
+
+        /* PRG banks: R6 is swapped with the second to last bank. */
+        u16 prg = _regs.bankSelectRegister & 0x40 ? 0xc000 : 0x8000;
+        mapPrg(prg, 0x2000, r[6]);
+        mapPrg(0xa000, 0x2000, r[7]);
+        mapPrg(prg ^ 0x4000, 0x2000, -2);
+        mapPrg(0xe000, 0x2000, -1);
+    }
+
+    void writeBankSelectRegister(u8 val)
+    {
+        u8 old = _regs.bankSelectRegister;
+        _regs.bankSelectRegister = val;
+
+        /* Check whether the write changes the mapping options. */
+        if ((val & 0xc0) != (old & 0xc0)) {
+            remap();
+        }
+    }
+
+    void writeBankDataRegister(u8 val)
+    {
+        _regs.bankRegister[_regs.bankSelectRegister & 0x7] = val;
+        remap();
+    }
+
+    /**
+     * Predict the cycle of the next interrupt from the number of rises
+     * needed to bring the counter to zero.
+     */
+    void updateIrqDeadline()
+    {
+        if (!_regs.irqEnabled) {
+            irqDeadline = ULONG_MAX;
+            return;
+        }
+        unsigned int rises = _regs.irqCounter == 0 || _regs.irqReload ?
+            _regs.irqLatch + 1 : _regs.irqCounter;
+        irqDeadline = N2C02::predictA12Rise(rises);
+    }
+};
+
+#endif /* _MMC3_H_INCLUDED_ */
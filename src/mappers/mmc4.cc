@@ -0,0 +1,15 @@
+
+#include "mmc2.h"
+
+static Mapper *createMMC4(Rom *rom) {
+    return new MMC4(rom);
+}
+
+/**
+ * Install the MMC4 mapper.
+ */
+static void insert(void) __attribute__((constructor));
+static void insert(void)
+{
+    mappers[10] = createMMC4;
+}
@@ -0,0 +1,15 @@
+
+#include "mmc5.h"
+
+static Mapper *createMMC5(Rom *rom) {
+    return new MMC5(rom);
+}
+
+/**
+ * Install the MMC5 mapper.
+ */
+static void insert(void) __attribute__((constructor));
+static void insert(void)
+{
+    mappers[5] = createMMC5;
+}
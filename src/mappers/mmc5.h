@@ -0,0 +1,335 @@
+
+#ifndef _MMC5_H_INCLUDED_
+#define _MMC5_H_INCLUDED_
+
+#include <climits>
+#include <cstring>
+
+#include "BankMapper.h"
+#include "Memory.h"
+#include "N2C02State.h"
+#include "M6502State.h"
+
+/**
+ * MMC5 (mapper 5): PRG-ROM in one to four windows, CHR in one to eight
+ * windows with separate banks for the background and the 8x16 sprites,
+ * banked PRG-RAM, 1K of expansion RAM usable as a nametable, fill mode
+ * nametable, scanline interrupt and multiplier.
+ *
+ * Not emulated: the audio channels, the extended attribute mode (ExRAM
+ * mode 1, the ExRAM is used as plain nametable memory), the vertical
+ * split, and PRG-RAM mapped at 0x8000-0xdfff (the bit 7 of the PRG bank
+ * registers is ignored, ROM is always selected).
+ */
+class MMC5 final : public BankMapper
+{
+public:
+    MMC5(Rom *rom)
+        : BankMapper(rom, MAPPER_MMC5, "MMC5", &_regs, sizeof(_regs)) {
+        Memory::state->prgRamEnabled = true;
+        _regs.prgMode = 3;
+        _regs.chrMode = 3;
+        _regs.prgBank[4] = 0xff;
+        memset(_blank, 0, sizeof(_blank));
+        fill();
+        remap();
+    }
+
+    ~MMC5() {
+    }
+
+    void storePrg(u16 addr, u8 val) {
+        (void)addr; (void)val;
+    }
+
+    /* The sprite size selects the CHR banks of the background. */
+    void updatePpu() {
+        if (N2C02::state->ctrl.h != _regs.sprites8x16) {
+            _regs.sprites8x16 = N2C02::state->ctrl.h;
+            remapChr();
+        }
+        updateIrqDeadline();
+    }
+
+    u8 loadExp(u16 addr, long quantum) {
+        switch (addr) {
+            case 0x5204: {
+                /* IRQ status, the pending interrupt is acknowledged. */
+                N2C02::sync(quantum);
+                if (M6502::state->cycles + quantum >= irqDeadline)
+                    sync();
+                bool inFrame = rendering() && N2C02::state->scanline < 240;
+                u8 val = (_regs.irqPending << 7) | (inFrame << 6);
+                _regs.irqPending = false;
+                M6502::clearIrq(M6502::IRQ_MAPPER);
+                return val;
+            }
+            case 0x5205:
+                return (_regs.multiplicand * _regs.multiplier) & 0xff;
+            case 0x5206:
+                return (_regs.multiplicand * _regs.multiplier) >> 8;
+            default:
+                break;
+        }
+        /* ExRAM, readable in the modes 2 and 3. */
+        if (addr >= 0x5c00 && _regs.exRamMode >= 2)
+            return _regs.exRam[addr & 0x3ff];
+        return 0;
+    }
+
+    void storeExp(u16 addr, u8 val, long quantum) {
+        if (addr < 0x5100)
+            return;
+        /* The writes change the rendering from the next dot. */
+        N2C02::sync(quantum);
+        if (addr >= 0x5c00) {
+            /* ExRAM, writable in the modes 0 to 2. */
+            if (_regs.exRamMode < 3) {
+                _regs.exRam[addr & 0x3ff] = val;
+                N2C02::updateNametable(_regs.exRam, addr);
+            }
+            return;
+        }
+        if (addr >= 0x5120 && addr < 0x512c) {
+            _regs.chrBank[addr - 0x5120] = val | (_regs.chrUpper << 8);
+            _regs.chrLastB = addr >= 0x5128;
+            remapChr();
+            return;
+        }
+        switch (addr) {
+            case 0x5100: _regs.prgMode = val & 0x3; break;
+            case 0x5101: _regs.chrMode = val & 0x3; break;
+            case 0x5102: _regs.prgRamProtect[0] = val & 0x3; break;
+            case 0x5103: _regs.prgRamProtect[1] = val & 0x3; break;
+            case 0x5104: _regs.exRamMode = val & 0x3; break;
+            case 0x5105: _regs.ntMapping = val; break;
+            case 0x5106:
+                _regs.fillTile = val;
+                fill();
+                return;
+            case 0x5107:
+                _regs.fillAttr = val & 0x3;
+                fill();
+                return;
+            case 0x5113:
+            case 0x5114:
+            case 0x5115:
+            case 0x5116:
+            case 0x5117:
+                _regs.prgBank[addr - 0x5113] = val;
+                break;
+            case 0x5130:
+                _regs.chrUpper = val & 0x3;
+                return;
+            case 0x5203:
+                _regs.irqTarget = val;
+                updateIrqDeadline();
+                return;
+            case 0x5204:
+                _regs.irqEnabled = (val & 0x80) != 0;
+                M6502::setIrq(M6502::IRQ_MAPPER,
+                              _regs.irqEnabled && _regs.irqPending);
+                updateIrqDeadline();
+                return;
+            case 0x5205: _regs.multiplicand = val; return;
+            case 0x5206: _regs.multiplier = val; return;
+            default:
+                return;
+        }
+        remap();
+    }
+
+    /*
+     * The scanline counter matches the target: the pending flag is raised
+     * at the start of the line, when rendering.
+     */
+    void sync() {
+        if (rendering()) {
+            _regs.irqPending = true;
+            if (_regs.irqEnabled)
+                M6502::raiseIrq(M6502::IRQ_MAPPER);
+        }
+        updateIrqDeadline();
+    }
+
+    /*
+     * The whole PRG-RAM is saved: only the mapped bank is saved with the
+     * memory state.
+     */
+    size_t getStateSize() const {
+        return BankMapper::getStateSize() + rom->prgRamSize;
+    }
+
+    void saveState(u8 *buf) const {
+        BankMapper::saveState(buf);
+        if (rom->prgRam)
+            memcpy(buf + BankMapper::getStateSize(), rom->prgRam,
+                   rom->prgRamSize);
+    }
+
+    void loadState(const u8 *buf) {
+        if (rom->prgRam)
+            memcpy(rom->prgRam, buf + BankMapper::getStateSize(),
+                   rom->prgRamSize);
+        BankMapper::loadState(buf);
+        fill();
+        N2C02::updateNametable(_regs.exRam);
+        updateIrqDeadline();
+    }
+
+private:
+    /* Registers, grouped to be saved with one copy. */
+    struct {
+        u8 prgMode;
+        u8 chrMode;
+        u8 prgRamProtect[2];
+        u8 exRamMode;
+        u8 ntMapping;
+        u8 fillTile;
+        u8 fillAttr;
+        /* PRG bank registers 0x5113 (PRG-RAM) to 0x5117. */
+        u8 prgBank[5];
+        /* CHR bank registers, sets A (0x5120-0x5127) and B (0x5128-). */
+        u16 chrBank[12];
+        u8 chrUpper;
+        bool chrLastB;
+        bool sprites8x16;
+        u8 irqTarget;
+        bool irqEnabled;
+        bool irqPending;
+        u8 multiplicand;
+        u8 multiplier;
+        u8 exRam[0x400];
+    } _regs;
+
+    /* Fill mode nametable, and nametable read as zeros. */
+    u8 _fill[0x400];
+    u8 _blank[0x400];
+
+    /**
+     * Build the fill mode nametable from the fill tile and attribute.
+     */
+    void fill() {
+        memset(_fill, _regs.fillTile, 0x3c0);
+        memset(_fill + 0x3c0, _regs.fillAttr * 0x55, 0x40);
+        N2C02::updateNametable(_fill);
+    }
+
+    static bool rendering() {
+        return N2C02::state->mask.br || N2C02::state->mask.sr;
+    }
+
+    void remap() {
+        const u8 *bank = _regs.prgBank;
+
+        /* PRG-ROM windows. */
+        switch (_regs.prgMode) {
+            case 0:
+                mapPrg(0x8000, 0x8000, (bank[4] & 0x7f) >> 2);
+                break;
+            case 1:
+                mapPrg(0x8000, 0x4000, (bank[2] & 0x7f) >> 1);
+                mapPrg(0xc000, 0x4000, (bank[4] & 0x7f) >> 1);
+                break;
+            case 2:
+                mapPrg(0x8000, 0x4000, (bank[2] & 0x7f) >> 1);
+                mapPrg(0xc000, 0x2000, bank[3] & 0x7f);
+                mapPrg(0xe000, 0x2000, bank[4] & 0x7f);
+                break;
+            default:
+                mapPrg(0x8000, 0x2000, bank[1] & 0x7f);
+                mapPrg(0xa000, 0x2000, bank[2] & 0x7f);
+                mapPrg(0xc000, 0x2000, bank[3] & 0x7f);
+                mapPrg(0xe000, 0x2000, bank[4] & 0x7f);
+                break;
+        }
+
+        /* PRG-RAM window, writable after the unlock sequence. */
+        size_t ramBanks = rom->prgRamSize / 0x2000;
+        if (ramBanks > 0)
+            Memory::configPrgRam(
+                rom->prgRam + (bank[0] & 0x7) % ramBanks * 0x2000, 0x2000);
+        else
+            Memory::configPrgRam(rom->prgRam, rom->prgRamSize);
+        Memory::state->prgRamWriteProtected =
+            _regs.prgRamProtect[0] != 0x2 || _regs.prgRamProtect[1] != 0x1;
+
+        remapChr();
+
+        /* Nametables, the fill mode page is read-only. */
+        for (int n = 0; n < 4; n++) {
+            switch ((_regs.ntMapping >> (2 * n)) & 0x3) {
+                case 0:
+                    N2C02::mapNametable(n, N2C02::getNametablePage(0));
+                    break;
+                case 1:
+                    N2C02::mapNametable(n, N2C02::getNametablePage(1));
+                    break;
+                case 2:
+                    if (_regs.exRamMode < 2)
+                        N2C02::mapNametable(n, _regs.exRam);
+                    else
+                        N2C02::mapNametable(n, _blank, true);
+                    break;
+                default:
+                    N2C02::mapNametable(n, _fill, true);
+                    break;
+            }
+        }
+    }
+
+    typedef void (MMC5::*MapChr)(u16 addr, size_t size, int bank);
+
+    /**
+     * Map the CHR set A: one 8K window selected by 0x5127, two 4K windows
+     * selected by 0x5123 and 0x5127, four 2K windows selected by the odd
+     * registers, or eight 1K windows.
+     */
+    void mapChrSetA(MapChr map) {
+        size_t size = 0x2000 >> _regs.chrMode;
+        for (size_t addr = 0; addr < 0x2000; addr += size) {
+            int reg = (addr + size) / 0x400 - 1;
+            (this->*map)(addr, size, _regs.chrBank[reg]);
+        }
+    }
+
+    /**
+     * Map the CHR set B: the registers 0x5128 to 0x512b map the windows
+     * of the lower 4K, mirrored in the upper 4K.
+     */
+    void mapChrSetB(MapChr map) {
+        size_t size = 0x2000 >> _regs.chrMode;
+        for (size_t addr = 0; addr < 0x2000; addr += size) {
+            int reg = 8 + ((((addr & 0xfff) + size) / 0x400 - 1) & 0x3);
+            (this->*map)(addr, size, _regs.chrBank[reg]);
+        }
+    }
+
+    /**
+     * The 8x16 sprites use the set A, and the background the set B. With
+     * 8x8 sprites, the last written set is used for both.
+     */
+    void remapChr() {
+        if (_regs.sprites8x16) {
+            mapChrSetA(&MMC5::mapChrSprites);
+            mapChrSetB(&MMC5::mapChrBackground);
+        } else if (_regs.chrLastB)
+            mapChrSetB(&MMC5::mapChr);
+        else
+            mapChrSetA(&MMC5::mapChr);
+    }
+
+    /**
+     * Schedule the interrupt at the start of the target line, if in the
+     * visible lines.
+     */
+    void updateIrqDeadline() {
+        if (_regs.irqTarget == 0 || _regs.irqTarget >= 240 || !rendering()) {
+            irqDeadline = ULONG_MAX;
+            return;
+        }
+        irqDeadline = N2C02::predictDot(_regs.irqTarget, 2);
+    }
+};
+
+#endif /* _MMC5_H_INCLUDED_ */
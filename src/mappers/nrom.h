@@ -0,0 +1,35 @@
+
+#ifndef _NROM_H_INCLUDED_
+#define _NROM_H_INCLUDED_
+
+#include "BankMapper.h"
+#include "Memory.h"
+
+/**
+ * NROM (mapper 0): 16K or 32K of PRG-ROM, 8K of CHR-ROM or CHR-RAM, no
+ * bank switching.
+ */
+class NROM final : public BankMapper
+{
+public:
+    NROM(Rom *rom)
+        : BankMapper(rom, MAPPER_NROM, "NROM", NULL, 0) {
+        Memory::state->prgRamEnabled = false;
+        remap();
+    }
+
+    ~NROM() {
+    }
+
+    void storePrg(u16 addr, u8 val) {
+        (void)addr; (void)val;
+    }
+
+private:
+    void remap() {
+        mapPrg(0x8000, 0x8000, 0);
+        mapChr(0x0000, 0x2000, 0);
+    }
+};
+
+#endif /* _NROM_H_INCLUDED_ */
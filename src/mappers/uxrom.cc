@@ -0,0 +1,15 @@
+
+#include "uxrom.h"
+
+static Mapper *createUxROM(Rom *rom) {
+    return new UxROM(rom);
+}
+
+/**
+ * Install the UxROM mapper.
+ */
+static void insert(void) __attribute__((constructor));
+static void insert(void)
+{
+    mappers[2] = createUxROM;
+}
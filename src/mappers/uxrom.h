@@ -0,0 +1,39 @@
+
+#ifndef _UXROM_H_INCLUDED_
+#define _UXROM_H_INCLUDED_
+
+#include "BankMapper.h"
+
+/**
+ * UxROM (mapper 2): one switchable 16K PRG-ROM window at 0x8000, the last
+ * bank fixed at 0xc000; 8K of CHR-RAM.
+ */
+class UxROM final : public BankMapper
+{
+public:
+    UxROM(Rom *rom)
+        : BankMapper(rom, MAPPER_UXROM, "UxROM", &_bankRegister,
+                     sizeof(_bankRegister)) {
+        remap();
+    }
+
+    ~UxROM() {
+    }
+
+    void storePrg(u16 addr, u8 val) {
+        (void)addr;
+        _bankRegister = val;
+        mapPrg(0x8000, 0x4000, _bankRegister);
+    }
+
+private:
+    u8 _bankRegister;
+
+    void remap() {
+        mapPrg(0x8000, 0x4000, _bankRegister);
+        mapPrg(0xc000, 0x4000, -1);
+        mapChr(0x0000, 0x2000, 0);
+    }
+};
+
+#endif /* _UXROM_H_INCLUDED_ */
@@ -1,29 +1,35 @@
 
+#include <climits>
 #include <iostream>
+#include <cstring>
 #include <pthread.h>
-#include <SDL2/SDL.h>
 #include <sys/time.h>
 
 #include "N2C02State.h"
 #include "M6502State.h"
 #include "Memory.h"
 #include "Rom.h"
-#include "Timer.h"
+#include "mappers/dispatch.h"
+#include "Video.h"
+#include "Stats.h"
 
 using namespace N2C02;
 
-#define N2C02_FRAME_RATE        (60.10f)
-#define N2C02_FRAME_MS          ((unsigned long)(1000.f / N2C02_FRAME_RATE))
-
 #define PPU_VBLOCKS             (30)
 #define PPU_HBLOCKS             (32)
 #define PPU_WIDTH               (PPU_HBLOCKS * 8)
 #define PPU_HEIGHT              (PPU_VBLOCKS * 8)
 
+/*
+ * The frame buffer has the native PPU resolution ; the debug build
+ * keeps a double sized picture with room for the debug views on the right.
+ */
 #ifndef PPU_DEBUG
-#define SCREEN_WIDTH            (PPU_WIDTH * 2)
-#define SCREEN_HEIGHT           (PPU_HEIGHT * 2)
+#define SCREEN_SCALE            1
+#define SCREEN_WIDTH            (PPU_WIDTH)
+#define SCREEN_HEIGHT           (PPU_HEIGHT)
 #else
+#define SCREEN_SCALE            2
 #define SCREEN_WIDTH            (PPU_WIDTH * 4)
 #define SCREEN_HEIGHT           (PPU_HEIGHT * 2)
 #endif
@@ -71,11 +77,11 @@ using namespace N2C02;
 #define PPUADDR     6
 #define PPUDATA     7
 
-#define PRERENDER   (state.scanline == 261)
-#define POSTRENDER  (state.scanline == 240)
-#define RENDEROFF   (!state.mask.br && !state.mask.sr)
-#define RENDERON    (state.mask.br || state.mask.sr)
-#define VBLANK      (state.scanline > 240)
+#define PRERENDER   (state->scanline == 261)
+#define POSTRENDER  (state->scanline == 240)
+#define RENDEROFF   (!state->mask.br && !state->mask.sr)
+#define RENDERON    (state->mask.br || state->mask.sr)
+#define VBLANK      (state->scanline > 240)
 
 /**
  * @brief Interleave the bits of two byte values.
@@ -98,58 +104,90 @@ struct sprite {
     };
 };
 
-/*
- * Scanline callback. If set, the function is called at the end of each
- * render line. The set switch \p scanlineCallbackSet is used because
- * checking the validity is too slow
- *   ```
- *   if (scanlineCallback) {
- *      ...
- *   }
- *   ```
+/**
+ * PPU internal memories, grouped in a single structure so that they are
+ * saved and restored with one copy.
+ */
+struct Storage {
+    /** SPR-RAM to store sprite attributes. */
+    union {
+        u8 raw[256];
+        struct sprite sprites[64];
+    } oam;
+
+    /** Secondary sprite storage, used for sprite evaluation. */
+    struct {
+        struct sprite sprites[8];
+        u8 bitmap[16];
+        u8 cnt;
+    } oamsec;
+
+    /** Sprite registers, used for rendering. */
+    struct {
+        struct sprite sprites[8];
+        u8 bitmap[16];
+        u8 cnt;
+    } oamreg;
+
+    /** Nametables. */
+    u8 ntable[4][0x400];
+
+    /** Palette memory. */
+    u8 palette[32];
+
+    /** Odd frame tracking, the last cycle is skipped. */
+    bool oddframe;
+};
+
+namespace N2C02 {
+
+/**
+ * Memories and rendering context of an emulator instance.
  */
-static std::function<void(int, int)> scanlineCallback;
-static bool scanlineCallbackSet = false;
-
-/** SDL objects. */
-static SDL_Window *window;
-static SDL_Surface *screen;
-static uint32_t *pixels;
-static Timer fps;
-
-/** SPR-RAM to store sprite attributes. */
-static union {
-    u8 raw[256];
-    struct sprite sprites[64];
-} oam;
-
-/** Secondary sprite storage, used for sprite evaluation. */
-static struct {
-    struct sprite sprites[8];
-    u8 bitmap[16];
-    u8 cnt;
-} oamsec;
-
-/** Sprite registers, used for rendering. */
-static struct {
-    struct sprite sprites[8];
-    u8 bitmap[16];
-    u8 cnt;
-} oamreg;
-
-/** Allocate nametables. */
-static u8 ntable0[0x400];
-static u8 ntable1[0x400];
-static u8 ntable2[0x400];
-static u8 ntable3[0x400];
-
-/** Setup nametable mirroring, which defaults to horizontal. */
-static u8 *ntables[4] = {
-    ntable0, ntable0, ntable1, ntable1
+struct Context {
+    Storage storage;
+
+    /**
+     * Nametables mapped read-only (bit n for the quarter n): writes to
+     * them are ignored.
+     */
+    u8 ntReadOnly;
+
+    /**
+     * Palette of each tile of the four nametables (32x32, the rows 30 and
+     * 31 use the last attribute row), decoded from the attribute tables
+     * when the nametables are mapped and updated on the attribute writes
+     * (see \ref updateNametable).
+     */
+    u8 palettes[4][32 * 32];
+
+    /**
+     * Nametable and palette rows of the current coarse Y, in the left
+     * and right nametables of the current vertical nametable select:
+     * the tile fetches index them with the coarse X and the horizontal
+     * nametable select. Updated with \ref prefetchRow whenever the
+     * coarse Y, the vertical nametable select or the nametable pages
+     * change.
+     */
+    const u8 *ntRow[2];
+    const u8 *palRow[2];
+
+    /**
+     * Frame buffer, handed to the video backend on vertical blank. The PPU
+     * renders into the buffer provided by the backend if any.
+     */
+    uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+    uint32_t *pixels;
+    /** The frames are handed to the video backend (see \ref init). */
+    bool presenting;
+    /** The completed frames are not handed to the video backend. */
+    bool skip;
+};
+
 };
 
-/** Contains the palette memory. */
-extern u8 palette[32];
+/** Palette memory at power on. */
+extern const u8 defaultPalette[32];
 
 /* RGB color palette. */
 extern const u32 colors[64];
@@ -157,32 +195,32 @@ extern const u32 colors[64];
 
 namespace N2C02 {
 
-State state;
+/** State and context of the instance current on the calling thread. */
+thread_local State *state = NULL;
+static thread_local Context *context = NULL;
 
 static u8 load(u16 addr);
 static void store(u16 addr, u8 val);
+static void prefetchRow(void);
 
 };
 
 /**
- * @brief Setup the PPU memory map and initialise the SDL objects.
+ * @brief Setup the PPU registers.
  */
 State::State()
-    : scanline(0), cycle(0), bus(0), readBuffer(0),
+    : scanline(0), cycle(0), sync(0), frame(0), bus(0), readBuffer(0),
         regs({ 0 }), ctrl({ 0 }), mask({ 0 }), status(0), oamaddr(0)
 {
     ctrl.i = 0x1;
 }
 
-State::~State()
-{
-}
-
 void State::clear()
 {
     scanline = 0;
     cycle = 0;
     sync = 0;
+    frame = 0;
 }
 
 /**
@@ -190,6 +228,7 @@ void State::clear()
  */
 u8 State::readRegister(u16 addr, long quantum)
 {
+    auto &oam = context->storage.oam;
     /* Synchronize with CPU */
     N2C02::sync(quantum);
 
@@ -265,17 +304,28 @@ u8 State::readRegister(u16 addr, long quantum)
                 readBuffer = load(regs.v & 0x2fff);
             }
             regs.v = (regs.v + ctrl.i) & 0x3fff;
+            prefetchRow();
             bus = val;
             break;
     }
     return val;
 }
 
+/**
+ * Notify the mapper of a change of PPUCTRL or PPUMASK.
+ */
+struct UpdatePpu {
+    template<class M> void operator()(M *mapper) {
+        mapper->updatePpu();
+    }
+};
+
 /**
  * Write to one of the PPU io registers.
  */
 void State::writeRegister(u16 addr, u8 val, long quantum)
 {
+    auto &oam = context->storage.oam;
     /* Synchronize with CPU */
     N2C02::sync(quantum);
     /* Set the value on the internal data bus. */
@@ -291,6 +341,10 @@ void State::writeRegister(u16 addr, u8 val, long quantum)
             ctrl.b = (val & PPUCTRL_B) ? 0x1000 : 0x0000;
             ctrl.h = (val & PPUCTRL_H) != 0;
             ctrl.v = (val & PPUCTRL_V) != 0;
+            {
+                UpdatePpu update;
+                dispatchMapper(currentMapper, update);
+            }
             break;
 
         case PPUMASK:
@@ -299,6 +353,10 @@ void State::writeRegister(u16 addr, u8 val, long quantum)
             mask.sc = (val & PPUMASK_M) == 0;
             mask.br = (val & PPUMASK_b) != 0;
             mask.sr = (val & PPUMASK_s) != 0;
+            {
+                UpdatePpu update;
+                dispatchMapper(currentMapper, update);
+            }
             break;
 
         case PPUSTATUS:
@@ -343,6 +401,7 @@ void State::writeRegister(u16 addr, u8 val, long quantum)
                 regs.t = (regs.t & 0xff00) | val;
                 regs.v = regs.t;
                 regs.w = 0;
+                prefetchRow();
             } else {
                 regs.t =
                     (regs.t & 0x00ff) |
@@ -354,6 +413,7 @@ void State::writeRegister(u16 addr, u8 val, long quantum)
         case PPUDATA:
             store(regs.v, val);
             regs.v = (regs.v + ctrl.i) & 0x3fff;
+            prefetchRow();
             break;
     }
 }
@@ -364,65 +424,119 @@ void State::writeRegister(u16 addr, u8 val, long quantum)
  */
 void State::dmaTransfer(u8 val)
 {
+    auto &oam = context->storage.oam;
     /* Synchronize with CPU */
-    oam.raw[state.oamaddr++] = val;
+    oam.raw[state->oamaddr++] = val;
 }
 
 namespace N2C02 {
 
-int init()
+Context *createContext()
 {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        std::cerr << "failed to initialise SDL: " << SDL_GetError();
-        std::cerr << std::endl;
-        SDL_Quit();
-        return -1;
-    }
+    Context *context = new Context();
+    auto &storage = context->storage;
+    /* Paint it blaaack. */
+    memset(context->framebuffer, 0, sizeof(context->framebuffer));
+    memset(&storage, 0, sizeof(storage));
+    memcpy(storage.palette, defaultPalette, sizeof(storage.palette));
+    context->pixels = context->framebuffer;
+    context->presenting = false;
+    context->skip = false;
+    /* The nametables are mapped by the mapper. */
+    context->ntReadOnly = 0;
+    context->ntRow[0] = context->ntRow[1] = storage.ntable[0];
+    context->palRow[0] = context->palRow[1] = context->palettes[0];
+    return context;
+}
 
-    window = SDL_CreateWindow("cnes 0.1",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-    if (!window) {
-        std::cerr << "failed to create SDL window: " << SDL_GetError();
-        std::cerr << std::endl;
-        quit();
-        return -1;
-    }
+void destroyContext(Context *context)
+{
+    delete context;
+}
 
-    screen = SDL_GetWindowSurface(window);
-    if (!screen) {
-        std::cerr << "failed to obtain SDL screen: " << SDL_GetError();
-        std::cerr << std::endl;
-        quit();
-        return -1;
-    }
-    if (screen->format->BytesPerPixel != 4) {
-        std::cerr << "unsupported pixel format\n" << std::endl;
-        quit();
+void makeCurrent(State *ppuState, Context *ppuContext)
+{
+    state = ppuState;
+    context = ppuContext;
+}
+
+int init()
+{
+    auto &pixels = context->pixels;
+    if (Video::init(SCREEN_WIDTH, SCREEN_HEIGHT, 2 / SCREEN_SCALE) < 0)
         return -1;
-    }
-    /* Paint it blaaack. */
-    pixels = (uint32_t *)screen->pixels;
-    memset(pixels, 0, 4 * SCREEN_WIDTH * SCREEN_HEIGHT);
-    SDL_UpdateWindowSurface(window);
-
-    /* Setup name table mirroring. */
-    if (currentRom->header.ctrl[0] & NES_CTRL0_MIRROR_4SCR)
-        set4ScreenMirroring();
-    else if (currentRom->header.ctrl[0] & NES_CTRL0_MIRROR_V)
-        setVerticalMirroring();
-    else
-        setHorizontalMirroring();
+    pixels = Video::getBuffer();
+    if (pixels == NULL)
+        pixels = context->framebuffer;
+    context->presenting = true;
     return 0;
 }
 
 void quit()
 {
-    if (window) {
-        SDL_DestroyWindow(window);
-        window = NULL;
+    Video::quit();
+    context->pixels = context->framebuffer;
+    context->presenting = false;
+}
+
+void setFrameSkip(bool skip)
+{
+    context->skip = skip;
+}
+
+const uint32_t *getFramebuffer()
+{
+    return context->presenting ? NULL : context->framebuffer;
+}
+
+size_t getScreenWidth()
+{
+    return SCREEN_WIDTH;
+}
+
+size_t getScreenHeight()
+{
+    return SCREEN_HEIGHT;
+}
+
+/**
+ * @brief Return the page of the nametable \p quarter (0-3).
+ */
+static inline u8 *getNametable(int quarter)
+{
+    return Memory::state->chrBank[8 + quarter];
+}
+
+/**
+ * @brief Point the nametable and palette rows to the coarse Y of the
+ *  VRAM address.
+ */
+static void prefetchRow(void)
+{
+    u16 v = state->regs.v;
+    unsigned int coarseY = (v >> 5) & 0x1f;
+    unsigned int quarter = (v >> 10) & 0x2;
+    u8 *const *pages = &Memory::state->chrBank[8 + quarter];
+    for (int i = 0; i < 2; i++) {
+        context->ntRow[i] = pages[i] + coarseY * 32;
+        context->palRow[i] = context->palettes[quarter + i] + coarseY * 32;
     }
-    SDL_Quit();
+}
+
+/**
+ * @brief Decode the attribute byte at \p offset (0x3c0-0x3ff) of the
+ *  nametable \p quarter into the palettes of its 4x4 tiles. Each pair of
+ *  bits selects the palette of 2x2 tiles, at the shift composed of the
+ *  bit 1 of the coarse X and Y.
+ */
+static void decodeAttribute(int quarter, unsigned int offset)
+{
+    u8 at = getNametable(quarter)[offset];
+    u8 *tiles = context->palettes[quarter] +
+        ((offset >> 3) & 0x7) * 4 * 32 + (offset & 0x7) * 4;
+    for (unsigned int y = 0; y < 4; y++)
+        for (unsigned int x = 0; x < 4; x++)
+            tiles[y * 32 + x] = (at >> (((y & 0x2) << 1) | (x & 0x2))) & 0x3;
 }
 
 /**
@@ -430,10 +544,11 @@ void quit()
  */
 void setVerticalMirroring(void)
 {
-    ntables[0] = ntable0;
-    ntables[1] = ntable1;
-    ntables[2] = ntable0;
-    ntables[3] = ntable1;
+    auto &ntable = context->storage.ntable;
+    mapNametable(0, ntable[0]);
+    mapNametable(1, ntable[1]);
+    mapNametable(2, ntable[0]);
+    mapNametable(3, ntable[1]);
 }
 
 /**
@@ -441,10 +556,11 @@ void setVerticalMirroring(void)
  */
 void setHorizontalMirroring(void)
 {
-    ntables[0] = ntable0;
-    ntables[1] = ntable0;
-    ntables[2] = ntable1;
-    ntables[3] = ntable1;
+    auto &ntable = context->storage.ntable;
+    mapNametable(0, ntable[0]);
+    mapNametable(1, ntable[0]);
+    mapNametable(2, ntable[1]);
+    mapNametable(3, ntable[1]);
 }
 
 /**
@@ -452,11 +568,10 @@ void setHorizontalMirroring(void)
  */
 void set1ScreenMirroring(int upper)
 {
-    u8 *sel = upper ? ntable1 : ntable0;
-    ntables[0] = sel;
-    ntables[1] = sel;
-    ntables[2] = sel;
-    ntables[3] = sel;
+    auto &ntable = context->storage.ntable;
+    u8 *sel = upper ? ntable[1] : ntable[0];
+    for (int i = 0; i < 4; i++)
+        mapNametable(i, sel);
 }
 
 /**
@@ -464,19 +579,115 @@ void set1ScreenMirroring(int upper)
  */
 void set4ScreenMirroring(void)
 {
-    ntables[0] = ntable0;
-    ntables[1] = ntable1;
-    ntables[2] = ntable2;
-    ntables[3] = ntable3;
+    auto &ntable = context->storage.ntable;
+    for (int i = 0; i < 4; i++)
+        mapNametable(i, ntable[i]);
 }
 
 /**
- * Attach a callback called at the end of each scanline.
+ * @brief Decode the whole attribute table of the nametable \p quarter.
  */
-void setScanlineCallback(std::function<void(int, int)> callback)
+static void decodeAttributes(int quarter)
+{
+    for (unsigned int offset = 0x3c0; offset < 0x400; offset++)
+        decodeAttribute(quarter, offset);
+}
+
+void mapNametable(int quarter, u8 *page, bool readOnly)
 {
-    scanlineCallback = callback;
-    scanlineCallbackSet = true;
+    quarter &= 0x3;
+    u8 mask = 1 << quarter;
+    /* The mappers map the nametables again on every bank switch. */
+    if (getNametable(quarter) == page &&
+        ((context->ntReadOnly & mask) != 0) == readOnly)
+        return;
+    Memory::state->chrBank[8 + quarter] = page;
+    Memory::state->chrBank[12 + quarter] = page;
+    if (readOnly)
+        context->ntReadOnly |= mask;
+    else
+        context->ntReadOnly &= ~mask;
+    decodeAttributes(quarter);
+    prefetchRow();
+}
+
+void updateNametable(const u8 *page, u16 offset)
+{
+    offset &= 0x3ff;
+    if (offset < 0x3c0)
+        return;
+    for (int quarter = 0; quarter < 4; quarter++)
+        if (getNametable(quarter) == page)
+            decodeAttribute(quarter, offset);
+}
+
+void updateNametable(const u8 *page)
+{
+    for (int quarter = 0; quarter < 4; quarter++)
+        if (getNametable(quarter) == page)
+            decodeAttributes(quarter);
+}
+
+u8 *getNametablePage(int n)
+{
+    return context->storage.ntable[n & 0x3];
+}
+
+size_t getStateSize()
+{
+    return sizeof(State) + sizeof(Storage) + 4;
+}
+
+/**
+ * @brief Save the PPU state: the registers, the internal memories, and
+ *  the nametable mirroring encoded as the indexes of the selected
+ *  nametables. The nametables mapped to mapper memories are saved as 0xff,
+ *  and left to the mapper on restore.
+ */
+void saveState(u8 *buf)
+{
+    auto &storage = context->storage;
+    memcpy(buf, state, sizeof(State));
+    buf += sizeof(State);
+    memcpy(buf, &storage, sizeof(storage));
+    buf += sizeof(storage);
+    for (int i = 0; i < 4; i++) {
+        u8 *page = getNametable(i);
+        size_t n = (page - storage.ntable[0]) / 0x400;
+        buf[i] = page >= storage.ntable[0] && n < 4 ? n : 0xff;
+    }
+}
+
+void loadState(const u8 *buf)
+{
+    auto &storage = context->storage;
+    memcpy(state, buf, sizeof(State));
+    buf += sizeof(State);
+    memcpy(&storage, buf, sizeof(storage));
+    buf += sizeof(storage);
+    for (int i = 0; i < 4; i++) {
+        if (buf[i] != 0xff)
+            mapNametable(i, storage.ntable[buf[i] & 0x3]);
+        /* The page may be unchanged, with a restored content. */
+        decodeAttributes(i);
+    }
+    prefetchRow();
+}
+
+/**
+ * @brief Read the pattern byte at \p addr through the CHR pages of the
+ *  background (resp. of the sprites). The address is wrapped to the
+ *  pattern tables: the fetches of the unused sprite slots compute
+ *  addresses out of range.
+ */
+static inline u8 loadChr(u16 addr)
+{
+    return Memory::state->chrBank[(addr >> 10) & 0x7][addr & 0x3ff];
+}
+
+static inline u8 loadSpriteChr(u16 addr)
+{
+    return Memory::state->chrSpriteBank[(addr >> 10) & 0x7][addr & 0x3ff];
 }
 
 /**
@@ -486,11 +697,9 @@ void setScanlineCallback(std::function<void(int, int)> callback)
  */
 static u8 load(u16 addr)
 {
-    if (addr < 0x2000)
-        return Memory::chrRom[addr];
-    else
+    auto &palette = context->storage.palette;
     if (addr < 0x3f00)
-        return ntables[(addr >> 10) & 0x3][addr & 0x3ff];
+        return Memory::state->chrBank[(addr >> 10) & 0xf][addr & 0x3ff];
     else
     if ((addr & 0x3) == 0)
         return palette[addr % 16];
@@ -499,6 +708,17 @@ static u8 load(u16 addr)
     return 0;
 }
 
+/**
+ * Write to the CHR memory, with the mapper method inlined.
+ */
+struct StoreChr {
+    u16 addr;
+    u8 val;
+    template<class M> void operator()(M *mapper) {
+        mapper->storeChr(addr, val);
+    }
+};
+
 /**
  * Store a byte at an address in the CPU memory address space.
  * @param addr          absolute memory address
@@ -506,11 +726,20 @@ static u8 load(u16 addr)
  */
 static void store(u16 addr, u8 val)
 {
-    if (addr < 0x2000)
-        currentMapper->storeChr(addr, val);
+    auto &palette = context->storage.palette;
+    if (addr < 0x2000) {
+        StoreChr store = { addr, val };
+        dispatchMapper(currentMapper, store);
+    }
     else
-    if (addr < 0x3f00)
-        ntables[(addr >> 10) & 0x3][addr & 0x3ff] = val;
+    if (addr < 0x3f00) {
+        int quarter = (addr >> 10) & 0x3;
+        if (!(context->ntReadOnly & (1 << quarter))) {
+            u8 *page = getNametable(quarter);
+            page[addr & 0x3ff] = val;
+            updateNametable(page, addr);
+        }
+    }
     else
     if ((addr & 0x3) == 0)
         palette[addr % 16] = val;
@@ -552,10 +781,14 @@ static void store(u16 addr, u8 val)
  */
 static inline void drawPixel(int x, int y, uint32_t c)
 {
+    auto &pixels = context->pixels;
     if (x < 0 || y < 0 ||
         x >= 8 * PPU_HBLOCKS ||
         y >= 8 * PPU_VBLOCKS)
         return;
+#if SCREEN_SCALE == 1
+    pixels[x + y * SCREEN_WIDTH] = c;
+#else
     x *= 2;
     y *= 2 * SCREEN_WIDTH;
     int z = x + y;
@@ -563,14 +796,26 @@ static inline void drawPixel(int x, int y, uint32_t c)
     pixels[z + 1] = c;
     pixels[z + SCREEN_WIDTH] = c;
     pixels[z + SCREEN_WIDTH + 1] = c;
+#endif
 }
 
 /**
- * @brief Refresh the game window.
+ * @brief Hand the completed frame to the video backend, and select the
+ *  buffer for the next frame. Instances not attached to the backend keep
+ *  rendering to their own frame buffer.
  */
 static inline void flushScreen(void)
 {
-    SDL_UpdateWindowSurface(window);
+    auto &pixels = context->pixels;
+    auto &framebuffer = context->framebuffer;
+    if (!context->presenting || context->skip)
+        return;
+    uint64_t start = Stats::ticks();
+    Video::present(pixels);
+    pixels = Video::getBuffer();
+    if (pixels == NULL)
+        pixels = framebuffer;
+    Stats::chargeNested(Stats::SUBSYSTEM_VIDEO, start);
 }
 
 /**
@@ -578,8 +823,8 @@ static inline void flushScreen(void)
  */
 static inline void shiftRegisters(void)
 {
-    state.regs.pats <<= 2;
-    state.regs.pals = (state.regs.pals << 2) | state.regs.pall;
+    state->regs.pats <<= 2;
+    state->regs.pals = (state->regs.pals << 2) | state->regs.pall;
 }
 
 /**
@@ -587,8 +832,8 @@ static inline void shiftRegisters(void)
  */
 static inline void shiftRegisters8(void)
 {
-    state.regs.pats <<= 16;
-    state.regs.pals = state.regs.pall * 0x5555;
+    state->regs.pats <<= 16;
+    state->regs.pals = state->regs.pall * 0x5555;
 }
 
 /**
@@ -596,11 +841,13 @@ static inline void shiftRegisters8(void)
  */
 static inline void drawNextPixel(void)
 {
+    auto &oamreg = context->storage.oamreg;
+    auto &palette = context->storage.palette;
     /* Pixel data. */
-    unsigned int px = state.cycle - 1, py = state.scanline;
+    unsigned int px = state->cycle - 1, py = state->scanline;
 
     /* Early return when both background and sprite rendering are disabled. */
-    if (!state.mask.br && !state.mask.sr) {
+    if (!state->mask.br && !state->mask.sr) {
         drawPixel(px, py, 0x0);
         shiftRegisters();
         return;
@@ -610,7 +857,7 @@ static inline void drawNextPixel(void)
      * Early return when in first column and both background and sprite
      * clipping are activated.
      */
-    if (px < 8 && state.mask.bc && state.mask.sc) {
+    if (px < 8 && state->mask.bc && state->mask.sc) {
         drawPixel(px, py, 0x0);
         shiftRegisters();
         return;
@@ -622,11 +869,11 @@ static inline void drawNextPixel(void)
     u8 zero = 0, front = 0, pal = 0x10;
 
     /* Background rendering. */
-    if (state.mask.br && (!state.mask.bc || px >= 8)) {
-        bpx  = (state.regs.pats >> (30 - 2 * state.regs.x)) & 0x3;
+    if (state->mask.br && (!state->mask.bc || px >= 8)) {
+        bpx  = (state->regs.pats >> (30 - 2 * state->regs.x)) & 0x3;
     }
     /* Sprite rendering. */
-    if (state.mask.sr && (!state.mask.sc || px >= 8)) {
+    if (state->mask.sr && (!state->mask.sc || px >= 8)) {
         for (unsigned int n = 0; n < oamreg.cnt; n++) {
             struct sprite sprite = oamreg.sprites[n];
             unsigned int sx = sprite.val.x;
@@ -650,7 +897,7 @@ static inline void drawNextPixel(void)
 
     /* Sprite 0 hit. */
     if (spx != 0 && bpx != 0 && zero && px < 255) {
-        state.status |= PPUSTATUS_S;
+        state->status |= PPUSTATUS_S;
     }
 
     /* Craft the final palette address. */
@@ -660,7 +907,7 @@ static inline void drawNextPixel(void)
     } else
     if (bpx != 0) {
         pa = bpx;
-        pa |= (state.regs.pals >> (14 - 2 * state.regs.x) << 2) & 0xc;
+        pa |= (state->regs.pals >> (14 - 2 * state->regs.x) << 2) & 0xc;
     }
 
     u8 c = palette[pa];
@@ -673,7 +920,8 @@ static inline void drawNextPixel(void)
  */
 static inline void fetchPattern(void)
 {
-    state.regs.nt = ntables[(state.regs.v >> 10) & 0x3][state.regs.v & 0x3ff];
+    u16 v = state->regs.v;
+    state->regs.nt = context->ntRow[(v >> 10) & 0x1][v & 0x1f];
 }
 
 /**
@@ -683,40 +931,49 @@ static inline void fetchPattern(void)
 static inline void fetchAttribute(void)
 {
     /*
-     * The address of the attribute to fetch is constructed as follow:
+     * The attribute is fetched at the address constructed as follow:
      *
      * 10 NN 1111 YYY XXX
      * || || |||| ||| +++-- high 3 bits of coarse X (x/4)
      * || || |||| +++------ high 3 bits of coarse Y (y/4)
      * ++-||-++++---------- attribute offset 0x23c0
      *    ++--------------- nametable select
+     *
+     * The bits of the attribute u8 that correspond to the current tile
+     * are decoded in advance (see \ref decodeAttribute): the palette is
+     * read from the row of the coarse Y, at the coarse X.
      */
-    u16 pa =
-        ((state.regs.v >> 2) & 0x0007) |
-        ((state.regs.v >> 4) & 0x0038) |
-        (state.regs.v & VADDR_NT_MASK) |
-        0x23c0;
-    u8 fullat = ntables[(pa >> 10) & 0x3][pa & 0x3ff];
-    /*
-     * The bits of the attribute u8 that corrspond to the current tile are
-     * extracted at the shift composed of the bit 1 of the coarse
-     * x,y coordinates.
-     */
-    u8 shift = (state.regs.v & 0x2) | ((state.regs.v >> 4) & 0x4);
-    state.regs.at = fullat >> shift;
+    u16 v = state->regs.v;
+    state->regs.at = context->palRow[(v >> 10) & 0x1][v & 0x1f];
 }
 
+/**
+ * Notify the mapper of a pattern fetch.
+ */
+struct FetchChr {
+    u16 addr;
+    template<class M> void operator()(M *mapper) {
+        mapper->fetchChr(addr);
+    }
+};
+
 /**
  * @brief Fetch the bitmap line for the fetched name table pattern. The bitmap
  *  shift registers are updated at the same time.
+ * @param watchChr      the mapper watches the pattern fetches
  */
+template<bool watchChr>
 static inline void fetchBitmap(void)
 {
-    u16 pa = state.ctrl.b + ((state.regs.nt << 4) | (state.regs.v >> 12));
-    u16 lo = Memory::chrRom[pa];
-    u16 hi = Memory::chrRom[pa | 0x8];
-    state.regs.pats = (state.regs.pats & 0xffff0000) | interleave(lo, hi);
-    state.regs.pall = state.regs.at & 0x3;;
+    u16 pa = state->ctrl.b + ((state->regs.nt << 4) | (state->regs.v >> 12));
+    u16 lo = loadChr(pa);
+    u16 hi = loadChr(pa | 0x8);
+    if (watchChr) {
+        FetchChr fetch = { (u16)(pa | 0x8) };
+        dispatchMapper(currentMapper, fetch);
+    }
+    state->regs.pats = (state->regs.pats & 0xffff0000) | interleave(lo, hi);
+    state->regs.pall = state->regs.at & 0x3;;
 }
 
 /**
@@ -725,11 +982,11 @@ static inline void fetchBitmap(void)
  */
 static inline void incrCoarseX(void)
 {
-    if ((state.regs.v & VADDR_COARSE_X_MASK) == VADDR_COARSE_X_MAX) {
-        state.regs.v &= ~VADDR_COARSE_X_MASK;
-        state.regs.v ^= VADDR_NT_H_MASK;
+    if ((state->regs.v & VADDR_COARSE_X_MASK) == VADDR_COARSE_X_MAX) {
+        state->regs.v &= ~VADDR_COARSE_X_MASK;
+        state->regs.v ^= VADDR_NT_H_MASK;
     } else
-        state.regs.v++;
+        state->regs.v++;
 }
 
 /**
@@ -739,15 +996,20 @@ static inline void incrCoarseX(void)
 static inline void incrFineY(void)
 {
     /* No block change. */
-    if ((state.regs.v & VADDR_FINE_Y_MASK) != VADDR_FINE_Y_MASK)
-        state.regs.v += VADDR_FINE_Y_INCR;
-    /* Increment coarse Y with no wrap around. */
-    else if ((state.regs.v & VADDR_COARSE_Y_MASK) != VADDR_COARSE_Y_MAX)
-        state.regs.v = (state.regs.v & ~VADDR_FINE_Y_MASK) + VADDR_COARSE_Y_INCR;
-    /* Increment coarse Y with wrap around. */
+    if ((state->regs.v & VADDR_FINE_Y_MASK) != VADDR_FINE_Y_MASK)
+        state->regs.v += VADDR_FINE_Y_INCR;
     else {
-        state.regs.v &= ~(VADDR_COARSE_Y_MASK | VADDR_FINE_Y_MASK);
-        state.regs.v ^= VADDR_NT_V_MASK;
+        /* Increment coarse Y with no wrap around. */
+        if ((state->regs.v & VADDR_COARSE_Y_MASK) != VADDR_COARSE_Y_MAX)
+            state->regs.v =
+                (state->regs.v & ~VADDR_FINE_Y_MASK) + VADDR_COARSE_Y_INCR;
+        /* Increment coarse Y with wrap around. */
+        else {
+            state->regs.v &= ~(VADDR_COARSE_Y_MASK | VADDR_FINE_Y_MASK);
+            state->regs.v ^= VADDR_NT_V_MASK;
+        }
+        /* Next nametable row. */
+        prefetchRow();
     }
 }
 
@@ -757,6 +1019,7 @@ static inline void incrFineY(void)
  */
 static inline void clearSecondaryOAM(void)
 {
+    auto &oamsec = context->storage.oamsec;
     memset(oamsec.sprites, 0xff, sizeof(oamsec.sprites));
     oamsec.cnt = 0;
 }
@@ -766,6 +1029,8 @@ static inline void clearSecondaryOAM(void)
  */
 static void evaluateSprites(void)
 {
+    auto &oam = context->storage.oam;
+    auto &oamsec = context->storage.oamsec;
     int n, m;
     u8 y;
     clearSecondaryOAM();
@@ -774,13 +1039,13 @@ static void evaluateSprites(void)
     {
         /* Check if sprite in vertical range. */
         y = oam.sprites[n].val.y;
-        if (state.ctrl.h) {
-            if (state.scanline < (uint)y ||
-                state.scanline >= (uint)y + 16) {
+        if (state->ctrl.h) {
+            if (state->scanline < (uint)y ||
+                state->scanline >= (uint)y + 16) {
                 continue;
             }
-        } else if (state.scanline < (uint)y ||
-                   state.scanline >= (uint)y + 8) {
+        } else if (state->scanline < (uint)y ||
+                   state->scanline >= (uint)y + 8) {
             continue;
         }
         /* Copy sprite to secondary OAM. */
@@ -805,13 +1070,13 @@ overflow:
     m = 0;
     while (n < 64) {
         y = oam.sprites[n].raw[m];
-        if (state.scanline < (uint)y ||
-            state.scanline >= (uint)y + 8) {
+        if (state->scanline < (uint)y ||
+            state->scanline >= (uint)y + 8) {
             n++;
             m = (m + 1) % 4; /* The bug is here. */
         } else {
             /* n += (m == 3) + 1; */
-            state.status |= PPUSTATUS_O;
+            state->status |= PPUSTATUS_O;
             break;
         }
     }
@@ -820,17 +1085,20 @@ overflow:
 /**
  * Fetch the bitmaps for the secondary OAM sprites.
  */
+template<bool watchChr>
 static inline void fetchSpriteBitmap(void)
 {
-    int n = state.cycle / 8 - 33;
-    u16 offset = state.scanline - oamsec.sprites[n].val.y;
+    auto &oamsec = context->storage.oamsec;
+    auto &oamreg = context->storage.oamreg;
+    int n = state->cycle / 8 - 33;
+    u16 offset = state->scanline - oamsec.sprites[n].val.y;
     u16 pa;
 
     /*
      * For 8 x 16 sprites, the pattern table is selected by the bit 0 of the
      * sprite index.
      */
-    if (state.ctrl.h) {
+    if (state->ctrl.h) {
         pa = (oamsec.sprites[n].val.index & 0x1) * 0x1000;
         pa += (oamsec.sprites[n].val.index & ~0x1) * 16;
 
@@ -853,7 +1121,7 @@ static inline void fetchSpriteBitmap(void)
      * PPU control register.
      */
     else {
-        pa = state.ctrl.s;
+        pa = state->ctrl.s;
         pa += oamsec.sprites[n].val.index * 16;
         /* Vertical flip. */
         if (oamsec.sprites[n].val.attr & SPRITE_ATTR_VF)
@@ -862,8 +1130,12 @@ static inline void fetchSpriteBitmap(void)
             pa = pa + offset;
     }
 
-    oamreg.bitmap[2 * n] = Memory::chrRom[pa];
-    oamreg.bitmap[2 * n + 1] = Memory::chrRom[pa + 8];
+    oamreg.bitmap[2 * n] = loadSpriteChr(pa);
+    oamreg.bitmap[2 * n + 1] = loadSpriteChr(pa + 8);
+    if (watchChr) {
+        FetchChr fetch = { (u16)(pa + 8) };
+        dispatchMapper(currentMapper, fetch);
+    }
     oamreg.sprites[n].val = oamsec.sprites[n].val;
     oamreg.cnt = oamsec.cnt;
 }
@@ -871,10 +1143,11 @@ static inline void fetchSpriteBitmap(void)
 #if 0
 static void prerenderBackground(void)
 {
-    u16 v = state.regs.t;
+    auto &palette = context->storage.palette;
+    u16 v = state->regs.t;
     int fx, fy, cx, cy, nt, ntp;
-    fx = state.regs.x;
-    fy = (state.regs.v >> 12) & 0x7;
+    fx = state->regs.x;
+    fy = (state->regs.v >> 12) & 0x7;
     cx = v & 0x1f;
     cy = (v >> 5) & 0x1f;
     nt = (v >> 10) & 0x3;
@@ -887,17 +1160,17 @@ static void prerenderBackground(void)
         }
         ntp = nt;
         for (int tx = 0; tx <= PPU_HBLOCKS; tx++) {
-            u8 pat = ntables[ntp][t];
-            u8 att =
-                ntables[ntp][0x3c0 | ((t >> 4) & 0x38) | ((t >> 2) & 0x7)];
+            const u8 *ntable = getNametable(ntp);
+            u8 pat = ntable[t];
+            u8 att = ntable[0x3c0 | ((t >> 4) & 0x38) | ((t >> 2) & 0x7)];
             int shift = (t & 0x2) | ((t >> 4) & 0x4);
             att >>= shift;
             att &= 0x3;
 
-            u16 pa = state.ctrl.b + (pat << 4);
+            u16 pa = state->ctrl.b + (pat << 4);
             for (int j = 0; j < 8; j++) {
-                u16 lo = Memory::chrRom[pa];
-                u16 hi = Memory::chrRom[pa | 0x8];
+                u16 lo = loadChr(pa);
+                u16 hi = loadChr(pa | 0x8);
                 for (int i = 0; i < 8; i++) {
                     int p =
                         ((lo >> (7 - i)) & 0x1) |
@@ -924,7 +1197,8 @@ static void prerenderBackground(void)
  */
 static void prerenderSprites(void)
 {
-    int vsize = state.ctrl.h ? 16 : 8;
+    auto &oam = context->storage.oam;
+    int vsize = state->ctrl.h ? 16 : 8;
     u16 pt, ptl;
     int px, py;
     u8 index, attr;
@@ -942,18 +1216,18 @@ static void prerenderSprites(void)
 
         if (py >= 8 * PPU_VBLOCKS)
             continue;
-        if (state.ctrl.h) {
+        if (state->ctrl.h) {
             pt = (index & 0x1) * 0x1000;
             pt += (index & ~0x1) * 16;
         } else {
-            pt = state.ctrl.s + index * 16;
+            pt = state->ctrl.s + index * 16;
         }
 
         for (int line = 0; line < vsize; line++) {
             if (py + line >= 8 * PPU_VBLOCKS)
                 break;
             /* Patch pt for vertical flipping */
-            if (state.ctrl.h) {
+            if (state->ctrl.h) {
                 if (attr & SPRITE_ATTR_VF) {
                     /* Swap the high and low sprites and the sprite lines */
                     if (line >= 8)
@@ -1006,16 +1280,11 @@ static void drawSprites(void);
 
 /**
  * @brief Draw the next dot on screen (step equivalent).
+ * @param watchChr      the mapper watches the pattern fetches
  */
-void dot(void)
+template<bool watchChr>
+static void dot(void)
 {
-    /* Odd frame tracking, the last cycle is skipped. */
-    static bool oddframe = 0;
-
-    if (scanlineCallbackSet && RENDERON &&
-        state.scanline < 240 && state.cycle == 260)
-        scanlineCallback(state.scanline, state.cycle);
-
     /*
      * Pre render line is mostly garbage, but the last fetches must be
      * performed, as they represent the data for the first 2 tiles on the next
@@ -1023,43 +1292,44 @@ void dot(void)
      */
     if (PRERENDER) {
         /* Clear status flags. */
-        if (state.cycle == 1)
-            state.status = 0;
+        if (state->cycle == 1)
+            state->status = 0;
         /* Rendering disabled. */
         if (RENDEROFF)
             goto next;
         /* Reload coarse X coordinates. */
-        else if (state.cycle == 257) {
-            if (state.cycle == 65)
+        else if (state->cycle == 257) {
+            if (state->cycle == 65)
                 evaluateSprites();
-            state.oamaddr = 0;
-            state.regs.v =
-                (state.regs.v & ~VADDR_X_MASK) |
-                (state.regs.t & VADDR_X_MASK);
+            state->oamaddr = 0;
+            state->regs.v =
+                (state->regs.v & ~VADDR_X_MASK) |
+                (state->regs.t & VADDR_X_MASK);
         }
         /* Reload Y fine and coarse offsets. */
-        else if (state.cycle >= 280 && state.cycle <= 304) {
-            state.oamaddr = 0;
-            state.regs.v =
-                (state.regs.v & ~VADDR_Y_MASK) |
-                (state.regs.t & VADDR_Y_MASK);
+        else if (state->cycle >= 280 && state->cycle <= 304) {
+            state->oamaddr = 0;
+            state->regs.v =
+                (state->regs.v & ~VADDR_Y_MASK) |
+                (state->regs.t & VADDR_Y_MASK);
+            prefetchRow();
         }
         /* Sprite loading interval. */
-        else if (state.cycle >= 258 && state.cycle <= 320) {
-            state.oamaddr = 0;
-            if (state.cycle % 8 == 0)
-                fetchSpriteBitmap();
+        else if (state->cycle >= 258 && state->cycle <= 320) {
+            state->oamaddr = 0;
+            if (state->cycle % 8 == 0)
+                fetchSpriteBitmap<watchChr>();
         }
         /* Pre load two tiles for next line. */
-        else if (state.cycle >= 322 && state.cycle <= 340)
+        else if (state->cycle >= 322 && state->cycle <= 340)
         {
-            if (state.cycle % 8 == 2)
+            if (state->cycle % 8 == 2)
                 fetchPattern();
-            else if (state.cycle % 8 == 4)
+            else if (state->cycle % 8 == 4)
                 fetchAttribute();
-            else if (state.cycle % 8 == 0) {
+            else if (state->cycle % 8 == 0) {
                 shiftRegisters8();
-                fetchBitmap();
+                fetchBitmap<watchChr>();
                 incrCoarseX();
             }
         }
@@ -1070,12 +1340,12 @@ void dot(void)
     /* PPU is idle while VBlank is occuring. */
     else if (VBLANK) {
         /* Set the vblank flag on tick 1 of the scanline 241. */
-        if (state.scanline == 241 && state.cycle == 1) {
-            state.status |= PPUSTATUS_V;
-            M6502::state->nmi = state.ctrl.v;
+        if (state->scanline == 241 && state->cycle == 1) {
+            state->status |= PPUSTATUS_V;
+            M6502::state->nmi = state->ctrl.v;
 #ifdef PPU_DEBUG
             drawPalettes(0, 0);
-            if (ntables[0] == ntables[1]) {
+            if (getNametable(0) == getNametable(1)) {
                 drawNameTable(PPU_WIDTH, 0, 0);
                 drawNameTable(PPU_WIDTH, PPU_HEIGHT, 2);
                 drawAttrTable(PPU_WIDTH / 2, PPU_HEIGHT, 0);
@@ -1086,26 +1356,11 @@ void dot(void)
                 drawAttrTable(0, PPU_HEIGHT / 2, 0);
                 drawAttrTable(PPU_WIDTH / 2, PPU_HEIGHT / 2, 1);
             }
-            SDL_UpdateWindowSurface(window);
 #endif
             // prerenderBackground();
-            if (state.mask.br)
+            if (state->mask.br)
                 flushScreen();
-#ifndef PPU_MAX_FPS
-            /* Adjust the frame rate. */
-            fps.wait(N2C02_FRAME_MS);
-            fps.reset();
-#else
-            /* Display the frame rate. */
-            /// FIXME print text in debug window.
-            static unsigned int frames = 0;
-            frames++;
-            if (fps.get() > 1000) {
-                std::cout << "FPS:" << frames << std::endl;
-                fps.reset();
-                frames = 0;
-            }
-#endif
+            state->frame++;
         }
     }
     /* Rendering is disabled. */
@@ -1114,54 +1369,54 @@ void dot(void)
     /* Normal scanline. */
     else {
         /* First cycle is idle. */
-        if (state.cycle == 0)
+        if (state->cycle == 0)
             goto next;
         /* Next cycles form the visible scanline. */
-        else if (state.cycle <= 256) {
+        else if (state->cycle <= 256) {
             /* Draw a pixel with previously loaded data. */
             drawNextPixel();
             /*
              * Fetch new name table and attribute u8s at regular intervals ;
              * then the pattern data, and increment coarse X offset.
              */
-            if (state.cycle % 8 == 2)
+            if (state->cycle % 8 == 2)
                 fetchPattern();
-            else if (state.cycle % 8 == 4)
+            else if (state->cycle % 8 == 4)
                 fetchAttribute();
-            else if (state.cycle % 8 == 0) {
-                fetchBitmap();
+            else if (state->cycle % 8 == 0) {
+                fetchBitmap<watchChr>();
                 incrCoarseX();
             }
             /* Fine Y increment. */
-            if (state.cycle == 256) {
+            if (state->cycle == 256) {
                 evaluateSprites();
                 incrFineY();
             }
         }
         /* Copy coarse X from t to v. */
-        else if (state.cycle == 257) {
-            state.oamaddr = 0;
-            state.regs.v =
-                (state.regs.v & ~VADDR_X_MASK) |
-                (state.regs.t & VADDR_X_MASK);
+        else if (state->cycle == 257) {
+            state->oamaddr = 0;
+            state->regs.v =
+                (state->regs.v & ~VADDR_X_MASK) |
+                (state->regs.t & VADDR_X_MASK);
         }
         /* Load sprite pattern data. */
-        else if (state.cycle < 321) {
-            state.oamaddr = 0;
-            if (state.cycle % 8 == 0)
-                fetchSpriteBitmap();
+        else if (state->cycle < 321) {
+            state->oamaddr = 0;
+            if (state->cycle % 8 == 0)
+                fetchSpriteBitmap<watchChr>();
         }
         /* Pre load two tiles for next line. */
-        else if (state.cycle <= 340)
+        else if (state->cycle <= 340)
         {
             /* Exactly the same as visible scanline. */
-            if (state.cycle % 8 == 2)
+            if (state->cycle % 8 == 2)
                 fetchPattern();
-            else if (state.cycle % 8 == 4)
+            else if (state->cycle % 8 == 4)
                 fetchAttribute();
-            else if (state.cycle % 8 == 0) {
+            else if (state->cycle % 8 == 0) {
                 shiftRegisters8();
-                fetchBitmap();
+                fetchBitmap<watchChr>();
                 incrCoarseX();
             }
         }
@@ -1169,29 +1424,121 @@ void dot(void)
 
 next:
     /* Increment dot tick and scanline ; and handle odd frames */
-    state.cycle++;
-    if (state.cycle == 341 && state.scanline == 261) {
+    state->cycle++;
+    if (state->cycle == 341 && state->scanline == 261) {
         /* No skipped tick when BG rendering is off. */
-        state.cycle = RENDERON ? oddframe : 0;
-        oddframe = !oddframe;
-        state.scanline = 0;
-    } else if (state.cycle == 341) {
-        state.scanline++;
-        state.cycle = 0;
+        state->cycle = RENDERON ? context->storage.oddframe : 0;
+        context->storage.oddframe = !context->storage.oddframe;
+        state->scanline = 0;
+    } else if (state->cycle == 341) {
+        state->scanline++;
+        state->cycle = 0;
     }
 }
 
+/**
+ * PPU catch-up loop, instantiated for each mapper class: runs three dots
+ * per CPU cycle from \p sync to \p cpu. For the mappers watching A12,
+ * the dots are run in chunks up to the next rise, on which the mapper is
+ * called.
+ */
+struct RunDots {
+    unsigned long sync;
+    unsigned long cpu;
+    template<class M> void operator()(M *mapper) {
+        unsigned long dots = 3 * (cpu - sync);
+        int rise = M::watchesA12 ? getA12RiseDot() : -1;
+        if (rise < 0) {
+            for (; dots > 0; dots--)
+                dot<M::watchesChr>();
+            return;
+        }
+        while (dots > 0) {
+            bool render = state->scanline < 240 || PRERENDER;
+            if (render && state->cycle == (uint)rise) {
+                dot<M::watchesChr>();
+                dots--;
+                mapper->riseA12();
+                continue;
+            }
+            /* Run to the rise, or to the end of the line. */
+            unsigned long n = render && state->cycle < (uint)rise ?
+                rise - state->cycle : 341 - state->cycle;
+            if (n > dots)
+                n = dots;
+            for (dots -= n; n > 0; n--)
+                dot<M::watchesChr>();
+        }
+    }
+};
+
 void sync(long quantum)
 {
     unsigned long cpu = M6502::state->cycles + quantum;
-    unsigned long sync = state.sync;
-    while (sync < cpu) {
-        N2C02::dot();
-        N2C02::dot();
-        N2C02::dot();
-        sync++;
+    Stats::counters.ppuSyncs++;
+    if (state->sync < cpu) {
+        RunDots run = { state->sync, cpu };
+        dispatchMapper(currentMapper, run);
     }
-    state.sync = cpu;
+    state->sync = cpu;
+}
+
+int getA12RiseDot()
+{
+    if (RENDEROFF)
+        return -1;
+    u16 sprites = state->ctrl.h ? 0x1000 : state->ctrl.s;
+    if (state->ctrl.b == sprites)
+        return -1;
+    return state->ctrl.b == 0 ? 260 : 324;
+}
+
+ulong predictA12Rise(unsigned int count)
+{
+    int rise = getA12RiseDot();
+    if (rise < 0 || count == 0)
+        return ULONG_MAX;
+
+    /*
+     * Index the rises of a frame: lines 0-239, then the pre-render line
+     * (index 240). Find the index of the next rise from the current dot.
+     */
+    const unsigned long risesPerFrame = 241;
+    unsigned long scanline = state->scanline, cycle = state->cycle;
+    unsigned long next;
+    if (scanline < 240)
+        next = scanline + (cycle > (uint)rise);
+    else if (scanline < 261 || cycle <= (uint)rise)
+        next = 240;
+    else
+        next = 241;
+
+    unsigned long index = next + count - 1;
+    unsigned long frames = index / risesPerFrame;
+    unsigned long line = index % risesPerFrame;
+    if (line == 240)
+        line = 261;
+
+    /* Rendering is enabled: one dot is skipped every other frame. */
+    unsigned long dots = frames * 262 * 341 + line * 341 + rise -
+        (scanline * 341 + cycle);
+    dots -= context->storage.oddframe ? (frames + 1) / 2 : frames / 2;
+    return state->sync + dots / 3 + 1;
+}
+
+ulong predictDot(unsigned int scanline, unsigned int cycle)
+{
+    unsigned long pos = state->scanline * 341 + state->cycle;
+    unsigned long target = scanline * 341 + cycle;
+    unsigned long dots;
+    if (target >= pos)
+        dots = target - pos;
+    else {
+        dots = 262 * 341 - pos + target;
+        if (RENDERON && context->storage.oddframe)
+            dots--;
+    }
+    return state->sync + dots / 3 + 1;
 }
 
 /**
@@ -1199,6 +1546,7 @@ void sync(long quantum)
  */
 static void drawPatternTables(int sx, int sy)
 {
+    auto &pixels = context->pixels;
     uint32_t greyscale[4] = { 0xffffff, 0x404040, 0x808080, 0x0 };
     u16 addr, line;
     int hpos = 0, vpos = 0, col;
@@ -1208,8 +1556,8 @@ static void drawPatternTables(int sx, int sy)
 
     for (addr = 0x0000; addr < 0x2000; addr += 16) {
         for (line = 0; line < 8; line++) {
-            u8 lo = Memory::chrRom[addr + line];
-            u8 hi = Memory::chrRom[addr + line + 8];
+            u8 lo = loadChr(addr + line);
+            u8 hi = loadChr(addr + line + 8);
             for (col = 7; col >= 0; col--) {
                 int p =
                     ((lo >> col) & 0x1) |
@@ -1233,9 +1581,10 @@ static void drawPatternTables(int sx, int sy)
  */
 static void drawNameTable(int sx, int sy, int sel)
 {
+    auto &pixels = context->pixels;
     const uint32_t greyscale[4] = { 0xffffff, 0x404040, 0x808080, 0x0 };
-    const u8 *ntable = ntables[sel % 4];
-    const u16 ptable = state.ctrl.b;
+    const u8 *ntable = getNametable(sel % 4);
+    const u16 ptable = state->ctrl.b;
     int hpos = 0, vpos = 0;
 
     /* sx, sy refer to coordinates in the debug screen. */
@@ -1244,8 +1593,8 @@ static void drawNameTable(int sx, int sy, int sel)
     for (u16 addr = 0x0; addr < 0x3c0; addr++) {
         u8 nt = ntable[addr];
         for (u16 line = 0; line < 8; line++) {
-            u8 lo = Memory::chrRom[ptable + (nt << 4) + line];
-            u8 hi = Memory::chrRom[ptable + (nt << 4) + line + 8];
+            u8 lo = loadChr(ptable + (nt << 4) + line);
+            u8 hi = loadChr(ptable + (nt << 4) + line + 8);
             for (int col = 7; col >= 0; col--) {
                 int p =
                     ((lo >> col) & 0x1) |
@@ -1271,6 +1620,7 @@ static void drawNameTable(int sx, int sy, int sel)
  */
 static void _drawPaletteTile(int sx, int sy, uint32_t c[4])
 {
+    auto &pixels = context->pixels;
     int x, y;
     for (x = 0; x < 8; x ++)
         for (y = 0; y < 8; y ++) {
@@ -1338,8 +1688,6 @@ static void drawAttrTable(int sx, int sy, int sel)
         } else
             hpos += 4;
     }
-
-    SDL_UpdateWindowSurface(window);
 }
 
 /**
@@ -1347,6 +1695,7 @@ static void drawAttrTable(int sx, int sy, int sel)
  */
 static void drawPalettes(int sx, int sy)
 {
+    auto &pixels = context->pixels;
     u16 addr, line;
     int hpos = 0, vpos = 0, col;
 
@@ -1368,8 +1717,6 @@ static void drawPalettes(int sx, int sy)
         } else
             hpos++;
     }
-
-    SDL_UpdateWindowSurface(window);
 }
 
 /**
@@ -1377,7 +1724,9 @@ static void drawPalettes(int sx, int sy)
  */
 static void drawSprites(void)
 {
-    int vsize = state.ctrl.h ? 16 : 8;
+    auto &oam = context->storage.oam;
+    auto &pixels = context->pixels;
+    int vsize = state->ctrl.h ? 16 : 8;
     u16 pt, ptl;
     int px, py;
     u8 index, attr;
@@ -1396,18 +1745,18 @@ static void drawSprites(void)
 
         if (py >= 8 * PPU_VBLOCKS)
             continue;
-        if (state.ctrl.h) {
+        if (state->ctrl.h) {
             pt = (index & 0x1) * 0x1000;
             pt += (index & ~0x1) * 16;
         } else {
-            pt = state.ctrl.s + index * 16;
+            pt = state->ctrl.s + index * 16;
         }
 
         for (int line = 0; line < vsize; line++) {
             if (py + line >= 8 * PPU_VBLOCKS)
                 break;
             /* Patch pt for vertical flipping */
-            if (state.ctrl.h) {
+            if (state->ctrl.h) {
                 if (attr & SPRITE_ATTR_VF) {
                     /* Swap the high and low sprites and the sprite lines */
                     if (line >= 8)
@@ -1473,7 +1822,7 @@ const u32 colors[64] =
     0xff9ffff3, 0xff000000, 0xff000000, 0xff000000,
 };
 
-u8 palette[32] = {
+const u8 defaultPalette[32] = {
     0x09, 0x01, 0x00, 0x01, 0x00, 0x02, 0x02, 0x0d,
     0x08, 0x10, 0x08, 0x24, 0x00, 0x00, 0x04, 0x2c,
     0x09, 0x01, 0x34, 0x03, 0x00, 0x04, 0x00, 0x14,
@@ -28,10 +28,19 @@
 #ifndef _N2C02STATE_H_INCLUDED_
 #define _N2C02STATE_H_INCLUDED_
 
-#include <functional>
+#include <cstddef>
 
 #include "type.h"
 
+/*
+ * NTSC frame rate: 39375000 / 655171 Hz, about 60.0988 Hz
+ * (CPU clock of 236.25 / 132 MHz, 29780.5 CPU cycles per frame).
+ */
+#define N2C02_FRAME_RATE_NUM    39375000
+#define N2C02_FRAME_RATE_DEN    655171
+#define N2C02_FRAME_RATE \
+    ((double)N2C02_FRAME_RATE_NUM / N2C02_FRAME_RATE_DEN)
+
 namespace N2C02 {
 
 /**
@@ -112,7 +121,8 @@ class State
 {
 public:
     State();
-    ~State();
+    /* Trivial destructor: the state is saved and restored by copy. */
+    ~State() = default;
 
     void clear();
 
@@ -128,6 +138,11 @@ public:
      * CPU cycle count at the last time the PPU was updated.
      */
     unsigned long sync;
+    /*
+     * Number of completed frames, incremented at the start of the vertical
+     * blanking interval.
+     */
+    unsigned long frame;
 
     /*
      * The PPU has an internal data bus that it uses for communication with the
@@ -161,19 +176,126 @@ public:
     void dmaTransfer(u8 val);
 };
 
-extern State state;
+/**
+ * PPU memories and rendering context of an emulator instance: nametables,
+ * palette, sprite memories and frame buffer.
+ */
+struct Context;
+
+Context *createContext();
+void destroyContext(Context *context);
+
+/**
+ * @brief Select the PPU state and context of the emulator instance
+ *  running on the calling thread.
+ */
+void makeCurrent(State *state, Context *context);
+
+/**
+ * @brief PPU state of the current instance.
+ */
+extern thread_local State *state;
 
 void setVerticalMirroring(void);
 void setHorizontalMirroring(void);
 void set1ScreenMirroring(int upper);
 void set4ScreenMirroring(void);
-void setScanlineCallback(std::function<void(int, int)> callback);
 
+/**
+ * @brief Map the nametable \p quarter (0-3) to the 1K memory \p page, in
+ *  the PPU page table (see Memory::State::chrBank): one of the pages of
+ *  the PPU memory (see \ref getNametablePage), or a mapper memory (e.g.
+ *  expansion RAM, CHR-ROM), whose writes are ignored if \p readOnly.
+ *  Mapping the same page again is a no-op. Mapper memories are not saved
+ *  with the PPU state: the mapper maps them again on restore, and reports
+ *  their restored content with \ref updateNametable.
+ */
+void mapNametable(int quarter, u8 *page, bool readOnly = false);
+
+/**
+ * @brief Notify the PPU of a write to the byte \p offset of the mapper
+ *  memory \p page, outside of the PPU address space (e.g. expansion RAM
+ *  written by the CPU), to update the decoded attributes if the page is
+ *  mapped as a nametable.
+ */
+void updateNametable(const u8 *page, u16 offset);
+
+/**
+ * @brief Same as above, for a change of the whole page \p page (e.g.
+ *  mapper memory restored from a snapshot).
+ */
+void updateNametable(const u8 *page);
+
+/**
+ * @brief Return the page \p n (0-3) of the nametable memory. The pages 2
+ *  and 3 are only wired on four screen boards.
+ */
+u8 *getNametablePage(int n);
+
+/**
+ * @brief Return the size of the state saved by \ref saveState.
+ */
+size_t getStateSize();
+
+/**
+ * @brief Save the PPU registers and internal memories to \p buf,
+ *  which must have room for \ref getStateSize bytes.
+ */
+void saveState(u8 *buf);
+void loadState(const u8 *buf);
+
+/**
+ * @brief Initialise the video backend, and render the frames of the current
+ *  instance to its buffers. The other instances are not displayed.
+ */
 int init();
 void quit();
-void dot();
+
+/**
+ * @brief Do not hand the next completed frames of the current instance to
+ *  the video backend, until called again with \p skip false.
+ */
+void setFrameSkip(bool skip);
+
+/**
+ * @brief Return the frame buffer of the current instance, or NULL if the
+ *  instance is attached to the video backend. Between two frames, the
+ *  buffer holds the last completed frame.
+ */
+const uint32_t *getFramebuffer();
+size_t getScreenWidth();
+size_t getScreenHeight();
 void sync(long quantum);
 
+/**
+ * @brief Return the dot of the render lines (0-239 and pre-render) at
+ *  which the pattern fetches raise the address line A12, as filtered by
+ *  the mappers; or -1 if A12 does not rise with the current PPUCTRL and
+ *  PPUMASK settings. The rise is caused by the sprite fetches (dot 260)
+ *  when the background uses the pattern table 0x0000 and the sprites the
+ *  table 0x1000, by the prefetch of the next line (dot 324) in the
+ *  opposite case. 8x16 sprites are assumed to use the table 0x1000, as do
+ *  the unused sprite slots.
+ */
+int getA12RiseDot();
+
+/**
+ * @brief Predict the CPU cycle at which the \p count-th next rise of A12
+ *  is seen, assuming the PPU settings do not change meanwhile.
+ * @return              the first CPU cycle to which the PPU must be
+ *                      synchronised to emulate the rise, or ULONG_MAX if
+ *                      A12 does not rise
+ */
+ulong predictA12Rise(unsigned int count);
+
+/**
+ * @brief Predict the CPU cycle at which the PPU next runs the dot \p cycle
+ *  of the line \p scanline, within one frame.
+ * @return              the first CPU cycle to which the PPU must be
+ *                      synchronised to run the dot
+ */
+ulong predictDot(unsigned int scanline, unsigned int cycle);
+
 };
 
 #endif /* _N2C02STATE_H_INCLUDED_ */
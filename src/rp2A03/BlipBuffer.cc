@@ -0,0 +1,148 @@
+
+#include <cmath>
+#include <cstring>
+
+#include "BlipBuffer.h"
+
+/* Fractional sample positions of the steps. */
+#define PHASE_BITS      5
+#define PHASES          (1 << PHASE_BITS)
+/* Number of samples a step is spread over. */
+#define WIDTH           16
+/* Precision of the kernel coefficients. */
+#define KERNEL_BITS     15
+/* Cutoff of the DC removal filter. */
+#define BASS_SHIFT      9
+
+/**
+ * Band-limited step kernels, one per fractional sample position. The
+ * coefficients of each kernel sum to 1 << KERNEL_BITS.
+ */
+static i16 kernel[PHASES][WIDTH];
+
+/**
+ * Compute the kernels: derivative of a band-limited step, i.e. a sinc
+ * impulse with a cutoff just below the Nyquist frequency, shaped by a
+ * Blackman window.
+ */
+static void initKernel(void) __attribute__((constructor));
+static void initKernel(void)
+{
+    const double cutoff = 0.9;
+
+    for (int p = 0; p < PHASES; p++) {
+        double taps[WIDTH];
+        double sum = 0.;
+        for (int k = 0; k < WIDTH; k++) {
+            double x = k - WIDTH / 2 + 1 - (double)p / PHASES;
+            double t = M_PI * cutoff * x;
+            double sinc = x == 0. ? 1. : sin(t) / t;
+            double w = 0.42 + 0.5 * cos(2 * M_PI * x / WIDTH) +
+                0.08 * cos(4 * M_PI * x / WIDTH);
+            taps[k] = sinc * w;
+            sum += taps[k];
+        }
+
+        /* Normalize, and put the rounding error on the largest tap. */
+        int total = 0, peak = 0;
+        for (int k = 0; k < WIDTH; k++) {
+            kernel[p][k] = lround(taps[k] / sum * (1 << KERNEL_BITS));
+            total += kernel[p][k];
+            if (kernel[p][k] > kernel[p][peak])
+                peak = k;
+        }
+        kernel[p][peak] += (1 << KERNEL_BITS) - total;
+    }
+}
+
+BlipBuffer::BlipBuffer(size_t capacity)
+    : _buffer(capacity + WIDTH, 0), _factor(0), _offset(0), _available(0),
+      _integrator(0)
+{
+}
+
+BlipBuffer::~BlipBuffer()
+{
+}
+
+void BlipBuffer::setRates(double clockRate, double sampleRate)
+{
+    adjustRates(clockRate, sampleRate);
+    clear();
+}
+
+void BlipBuffer::adjustRates(double clockRate, double sampleRate)
+{
+    _factor = (uint64_t)(sampleRate / clockRate * 4294967296.);
+}
+
+void BlipBuffer::clear()
+{
+    std::fill(_buffer.begin(), _buffer.end(), 0);
+    _offset = 0;
+    _available = 0;
+    _integrator = 0;
+}
+
+void BlipBuffer::addDelta(ulong time, int delta)
+{
+    uint64_t pos = (uint64_t)time * _factor + _offset;
+    size_t index = pos >> 32;
+    uint phase = (pos >> (32 - PHASE_BITS)) & (PHASES - 1);
+
+    /* Steps past the end of the buffer are dropped. */
+    if (index + WIDTH > _buffer.size())
+        return;
+    int *out = &_buffer[index];
+    const i16 *in = kernel[phase];
+    for (int k = 0; k < WIDTH; k++)
+        out[k] += delta * in[k];
+}
+
+void BlipBuffer::endFrame(ulong duration)
+{
+    _offset += (uint64_t)duration * _factor;
+    _available = _offset >> 32;
+
+    /* Keep room for the next frame. */
+    size_t capacity = _buffer.size() - WIDTH;
+    if (_available > capacity / 2)
+        removeSamples(_available - capacity / 2);
+}
+
+/**
+ * @brief Integrate the signal over \p count samples, and move the
+ *  remaining steps to the start of the buffer.
+ */
+size_t BlipBuffer::readSamples(i16 *out, size_t count)
+{
+    if (count > _available)
+        count = _available;
+
+    int sum = _integrator;
+    for (size_t i = 0; i < count; i++) {
+        sum += _buffer[i];
+        int s = sum >> KERNEL_BITS;
+        if (s < -32768)
+            s = -32768;
+        if (s > 32767)
+            s = 32767;
+        if (out != NULL)
+            out[i] = s;
+        /* High-pass filter, removes the DC offset. */
+        sum -= s << (KERNEL_BITS - BASS_SHIFT);
+    }
+    _integrator = sum;
+
+    size_t remaining = _buffer.size() - count;
+    memmove(&_buffer[0], &_buffer[count], remaining * sizeof(int));
+    memset(&_buffer[remaining], 0, count * sizeof(int));
+    _offset -= (uint64_t)count << 32;
+    _available -= count;
+    return count;
+}
+
+void BlipBuffer::removeSamples(size_t count)
+{
+    readSamples(NULL, count);
+}
@@ -0,0 +1,78 @@
+
+#ifndef _BLIPBUFFER_H_INCLUDED_
+#define _BLIPBUFFER_H_INCLUDED_
+
+#include <cstddef>
+#include <vector>
+
+#include "type.h"
+
+/**
+ * @brief Band-limited step synthesiser.
+ *
+ *  The input signal is described by its changes: each step of the signal
+ *  is added at its clock time as a band-limited step (a windowed sinc
+ *  impulse, spread over a few samples), so the cost only depends on the
+ *  number of changes, not on the clock rate. The samples of a frame become
+ *  available when the frame ends ; reading them integrates the steps and
+ *  removes the DC offset.
+ */
+class BlipBuffer
+{
+public:
+    /**
+     * @param capacity      maximum number of samples buffered
+     */
+    BlipBuffer(size_t capacity = 8192);
+    ~BlipBuffer();
+
+    /**
+     * @brief Set the input clock rate and the output sample rate. Clears
+     *  the buffer.
+     */
+    void setRates(double clockRate, double sampleRate);
+
+    /**
+     * @brief Change the rates without clearing the buffer. Must be called
+     *  between two frames.
+     */
+    void adjustRates(double clockRate, double sampleRate);
+
+    /**
+     * @brief Add a step of amplitude \p delta to the signal, at \p time
+     *  clocks from the start of the current frame.
+     */
+    void addDelta(ulong time, int delta);
+
+    /**
+     * @brief End the current frame, lasting \p duration clocks: the
+     *  samples of the frame become available. When the buffer is full, the
+     *  oldest samples are dropped.
+     */
+    void endFrame(ulong duration);
+
+    /** Number of samples available for reading. */
+    size_t getAvailable() const { return _available; }
+
+    /**
+     * @brief Read up to \p count samples.
+     * @return              the number of samples read
+     */
+    size_t readSamples(i16 *out, size_t count);
+
+    void clear();
+
+private:
+    void removeSamples(size_t count);
+
+    std::vector<int> _buffer;
+    /** Samples per clock, 32.32 fixed point. */
+    uint64_t _factor;
+    /** Position of the start of the frame, in samples, 32.32 fixed point. */
+    uint64_t _offset;
+    size_t _available;
+    /** Integrated signal, before the DC removal. */
+    int _integrator;
+};
+
+#endif /* _BLIPBUFFER_H_INCLUDED_ */
@@ -0,0 +1,625 @@
+
+#include <climits>
+#include <cstring>
+
+#include "RP2A03State.h"
+#include "BlipBuffer.h"
+#include "Memory.h"
+#include "M6502State.h"
+
+/* Full scale amplitude of the mixer output. */
+#define MIXER_AMPLITUDE         32000
+
+namespace RP2A03 {
+
+thread_local State *state = NULL;
+
+/**
+ * Audio output of an emulator instance.
+ */
+struct Context {
+    BlipBuffer blip;
+    bool outputEnabled;
+};
+
+static thread_local Context *context = NULL;
+
+static const u8 lengthTable[32] = {
+    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const u8 dutyTable[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 },
+};
+
+static const u8 triangleTable[32] = {
+    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+};
+
+/* Noise and DMC timer periods, in CPU cycles (NTSC). */
+static const u16 noiseTable[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+static const u16 dmcTable[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+};
+
+/*
+ * Frame counter steps, in CPU cycles from the start of the sequence, for
+ * the 4-step and 5-step modes. The last entry is the sequence length.
+ */
+static const ulong frameSteps[2][6] = {
+    { 7457, 14913, 22371, 29829, 29830, 0 },
+    { 7457, 14913, 22371, 29829, 37281, 37282 },
+};
+
+/* Nonlinear mixer outputs, indexed by the sum of the pulse outputs, and by
+ * 3 * triangle + 2 * noise + dmc. */
+static int pulseMix[31];
+static int tndMix[203];
+
+static void initMixer(void) __attribute__((constructor));
+static void initMixer(void)
+{
+    pulseMix[0] = 0;
+    for (int i = 1; i < 31; i++)
+        pulseMix[i] = MIXER_AMPLITUDE * 95.52 / (8128. / i + 100.);
+    tndMix[0] = 0;
+    for (int i = 1; i < 203; i++)
+        tndMix[i] = MIXER_AMPLITUDE * 163.67 / (24329. / i + 100.);
+}
+
+State::State()
+{
+    clear();
+}
+
+void State::clear()
+{
+    memset(pulse, 0, sizeof(pulse));
+    memset(&triangle, 0, sizeof(triangle));
+    memset(&noise, 0, sizeof(noise));
+    memset(&dmc, 0, sizeof(dmc));
+    pulse[0].timer = 2;
+    pulse[1].timer = 2;
+    triangle.timer = 1;
+    noise.period = noiseTable[0];
+    noise.timer = noiseTable[0];
+    noise.shift = 1;
+    dmc.period = dmcTable[0];
+    dmc.timer = dmcTable[0];
+    dmc.bitsRemaining = 8;
+    dmc.silence = true;
+
+    fiveStep = false;
+    irqInhibit = false;
+    frameIrq = false;
+    dmcIrq = false;
+    frameStep = 0;
+    frameSequence = 0;
+    sync = 0;
+    deadline = frameSteps[0][3];
+    frameStart = 0;
+    output = 0;
+}
+
+static inline u8 getVolume(const Envelope &envelope)
+{
+    return envelope.constant ? envelope.volume : envelope.decay;
+}
+
+static inline u16 getSweepTarget(const Pulse &pulse, int channel)
+{
+    u16 change = pulse.period >> pulse.sweepShift;
+    if (!pulse.sweepNegate)
+        return pulse.period + change;
+    /* The first pulse channel negates with the ones' complement. */
+    return pulse.period - change - (channel == 0);
+}
+
+/**
+ * @brief Return true if the channel output can change: channels muted by
+ *  their counters are not clocked until they are enabled again.
+ */
+static inline bool isPulseActive(const Pulse &pulse, int channel)
+{
+    return pulse.length > 0 && pulse.period >= 8 &&
+        getSweepTarget(pulse, channel) <= 0x7ff;
+}
+
+static inline bool isTriangleActive(const Triangle &triangle)
+{
+    /* Ultrasonic periods are silenced, the output is held. */
+    return triangle.length > 0 && triangle.linearCounter > 0 &&
+        triangle.period >= 2;
+}
+
+static inline bool isNoiseActive(const Noise &noise)
+{
+    return noise.length > 0;
+}
+
+static inline bool isDmcActive(const Dmc &dmc)
+{
+    return !dmc.silence || dmc.bufferFull || dmc.bytesRemaining > 0;
+}
+
+static inline u8 getPulseOutput(const Pulse &pulse, int channel)
+{
+    if (!isPulseActive(pulse, channel) || !dutyTable[pulse.duty][pulse.step])
+        return 0;
+    return getVolume(pulse.envelope);
+}
+
+static inline u8 getNoiseOutput(const Noise &noise)
+{
+    if (!isNoiseActive(noise) || (noise.shift & 0x1))
+        return 0;
+    return getVolume(noise.envelope);
+}
+
+/**
+ * @brief Mix the channel outputs, and add the change of the output level
+ *  to the sample buffer.
+ */
+static inline void mix(ulong time)
+{
+    int output =
+        pulseMix[getPulseOutput(state->pulse[0], 0) +
+                 getPulseOutput(state->pulse[1], 1)] +
+        tndMix[3 * triangleTable[state->triangle.step] +
+               2 * getNoiseOutput(state->noise) +
+               state->dmc.output];
+    if (output == state->output)
+        return;
+    if (context->outputEnabled)
+        context->blip.addDelta(time - state->frameStart,
+                               output - state->output);
+    state->output = output;
+}
+
+static void clockEnvelope(Envelope &envelope)
+{
+    if (envelope.start) {
+        envelope.start = false;
+        envelope.decay = 15;
+        envelope.divider = envelope.volume;
+    } else if (envelope.divider == 0) {
+        envelope.divider = envelope.volume;
+        if (envelope.decay > 0)
+            envelope.decay--;
+        else if (envelope.loop)
+            envelope.decay = 15;
+    } else
+        envelope.divider--;
+}
+
+static void clockSweep(Pulse &pulse, int channel)
+{
+    if (pulse.sweepDivider == 0 && pulse.sweepEnabled &&
+        pulse.sweepShift > 0 && isPulseActive(pulse, channel))
+        pulse.period = getSweepTarget(pulse, channel);
+    if (pulse.sweepDivider == 0 || pulse.sweepReload) {
+        pulse.sweepDivider = pulse.sweepPeriod;
+        pulse.sweepReload = false;
+    } else
+        pulse.sweepDivider--;
+}
+
+static void clockQuarterFrame()
+{
+    clockEnvelope(state->pulse[0].envelope);
+    clockEnvelope(state->pulse[1].envelope);
+    clockEnvelope(state->noise.envelope);
+
+    Triangle &triangle = state->triangle;
+    if (triangle.linearReload)
+        triangle.linearCounter = triangle.linearLoad;
+    else if (triangle.linearCounter > 0)
+        triangle.linearCounter--;
+    if (!triangle.control)
+        triangle.linearReload = false;
+}
+
+static void clockHalfFrame()
+{
+    for (int i = 0; i < 2; i++) {
+        Pulse &pulse = state->pulse[i];
+        if (!pulse.envelope.loop && pulse.length > 0)
+            pulse.length--;
+        clockSweep(pulse, i);
+    }
+    if (!state->triangle.control && state->triangle.length > 0)
+        state->triangle.length--;
+    if (!state->noise.envelope.loop && state->noise.length > 0)
+        state->noise.length--;
+}
+
+/**
+ * @brief Run the frame counter step due at this time.
+ */
+static void clockFrameCounter()
+{
+    u8 step = state->frameStep;
+
+    if (!state->fiveStep) {
+        clockQuarterFrame();
+        if (step == 1 || step == 3)
+            clockHalfFrame();
+        if (step == 3 && !state->irqInhibit) {
+            state->frameIrq = true;
+            M6502::raiseIrq(M6502::IRQ_FRAME);
+        }
+    } else if (step != 3) {
+        clockQuarterFrame();
+        if (step == 1 || step == 4)
+            clockHalfFrame();
+    }
+
+    uint last = state->fiveStep ? 4 : 3;
+    if (step < last) {
+        state->frameStep++;
+    } else {
+        state->frameStep = 0;
+        state->frameSequence += frameSteps[state->fiveStep][last + 1];
+    }
+}
+
+/**
+ * @brief Fill the sample buffer of the DMC memory reader.
+ */
+static void fetchDmc()
+{
+    Dmc &dmc = state->dmc;
+    if (dmc.bufferFull || dmc.bytesRemaining == 0)
+        return;
+
+    dmc.buffer = Memory::load(dmc.address);
+    dmc.bufferFull = true;
+    dmc.address = dmc.address == 0xffff ? 0x8000 : dmc.address + 1;
+    if (--dmc.bytesRemaining == 0) {
+        if (dmc.loop) {
+            dmc.address = dmc.sampleAddress;
+            dmc.bytesRemaining = dmc.sampleLength;
+        } else if (dmc.irqEnabled) {
+            state->dmcIrq = true;
+            M6502::raiseIrq(M6502::IRQ_DMC);
+        }
+    }
+}
+
+static void clockDmc()
+{
+    Dmc &dmc = state->dmc;
+    if (!dmc.silence) {
+        if (dmc.shift & 0x1) {
+            if (dmc.output <= 125)
+                dmc.output += 2;
+        } else if (dmc.output >= 2)
+            dmc.output -= 2;
+    }
+    dmc.shift >>= 1;
+    if (--dmc.bitsRemaining == 0) {
+        dmc.bitsRemaining = 8;
+        dmc.silence = !dmc.bufferFull;
+        if (dmc.bufferFull) {
+            dmc.shift = dmc.buffer;
+            dmc.bufferFull = false;
+            fetchDmc();
+        }
+    }
+}
+
+/**
+ * @brief Advance the active channel timers by \p elapsed cycles,
+ *  clocking the channels whose timer expires.
+ */
+static inline void clockTimers(ulong elapsed, bool p0, bool p1, bool t,
+                               bool n, bool d)
+{
+    for (int i = 0; i < 2; i++) {
+        Pulse &pulse = state->pulse[i];
+        if (!(i ? p1 : p0) || (pulse.timer -= elapsed) > 0)
+            continue;
+        pulse.step = (pulse.step + 1) & 0x7;
+        pulse.timer = (pulse.period + 1) * 2;
+    }
+    Triangle &triangle = state->triangle;
+    if (t && (triangle.timer -= elapsed) == 0) {
+        triangle.step = (triangle.step + 1) & 0x1f;
+        triangle.timer = triangle.period + 1;
+    }
+    Noise &noise = state->noise;
+    if (n && (noise.timer -= elapsed) == 0) {
+        u16 tap = noise.mode ? (noise.shift >> 6) : (noise.shift >> 1);
+        u16 feedback = (noise.shift ^ tap) & 0x1;
+        noise.shift = (noise.shift >> 1) | (feedback << 14);
+        noise.timer = noise.period;
+    }
+    Dmc &dmc = state->dmc;
+    if (d && (dmc.timer -= elapsed) == 0) {
+        clockDmc();
+        dmc.timer = dmc.period;
+    }
+}
+
+/**
+ * @brief Run the APU until the CPU cycle \p target. The time advances from
+ *  one event (a timer or frame counter clock) to the next, the output is
+ *  only mixed when a channel was clocked.
+ */
+static void run(ulong target)
+{
+    ulong time = state->sync;
+
+    while (time < target) {
+        bool p0 = isPulseActive(state->pulse[0], 0);
+        bool p1 = isPulseActive(state->pulse[1], 1);
+        bool t = isTriangleActive(state->triangle);
+        bool n = isNoiseActive(state->noise);
+        bool d = isDmcActive(state->dmc);
+
+        ulong frame = state->frameSequence +
+            frameSteps[state->fiveStep][state->frameStep];
+        ulong elapsed = target - time;
+        if (frame - time < elapsed)
+            elapsed = frame - time;
+        if (p0 && state->pulse[0].timer < elapsed)
+            elapsed = state->pulse[0].timer;
+        if (p1 && state->pulse[1].timer < elapsed)
+            elapsed = state->pulse[1].timer;
+        if (t && state->triangle.timer < elapsed)
+            elapsed = state->triangle.timer;
+        if (n && state->noise.timer < elapsed)
+            elapsed = state->noise.timer;
+        if (d && state->dmc.timer < elapsed)
+            elapsed = state->dmc.timer;
+
+        time += elapsed;
+        clockTimers(elapsed, p0, p1, t, n, d);
+        if (time == frame)
+            clockFrameCounter();
+        mix(time);
+    }
+    state->sync = target;
+}
+
+/**
+ * @brief Compute the next CPU cycle at which an interrupt can be raised.
+ *  The DMC estimate is a lower bound: the deadline is computed again when
+ *  it is reached.
+ */
+static void updateDeadline()
+{
+    ulong deadline = ULONG_MAX;
+    if (!state->fiveStep && !state->irqInhibit)
+        deadline = state->frameSequence + frameSteps[0][3];
+
+    Dmc &dmc = state->dmc;
+    if (dmc.irqEnabled && !dmc.loop && dmc.bytesRemaining > 0) {
+        ulong end = state->sync + dmc.timer +
+            (ulong)(dmc.bytesRemaining - 1) * 8 * dmc.period;
+        if (end < deadline)
+            deadline = end;
+    }
+    state->deadline = deadline;
+}
+
+u8 State::readRegister(u16 addr, long quantum)
+{
+    if (addr != 0x4015)
+        return 0x0;
+
+    RP2A03::sync(quantum);
+    u8 val =
+        (pulse[0].length > 0 ? 0x01 : 0) |
+        (pulse[1].length > 0 ? 0x02 : 0) |
+        (triangle.length > 0 ? 0x04 : 0) |
+        (noise.length > 0 ? 0x08 : 0) |
+        (dmc.bytesRemaining > 0 ? 0x10 : 0) |
+        (frameIrq ? 0x40 : 0) |
+        (dmcIrq ? 0x80 : 0);
+    frameIrq = false;
+    M6502::clearIrq(M6502::IRQ_FRAME);
+    return val;
+}
+
+static void writePulse(Pulse &pulse, u16 reg, u8 val)
+{
+    switch (reg) {
+        case 0:
+            pulse.duty = val >> 6;
+            pulse.envelope.loop = val & 0x20;
+            pulse.envelope.constant = val & 0x10;
+            pulse.envelope.volume = val & 0xf;
+            break;
+        case 1:
+            pulse.sweepEnabled = val & 0x80;
+            pulse.sweepPeriod = (val >> 4) & 0x7;
+            pulse.sweepNegate = val & 0x8;
+            pulse.sweepShift = val & 0x7;
+            pulse.sweepReload = true;
+            break;
+        case 2:
+            pulse.period = (pulse.period & 0x700) | val;
+            break;
+        case 3:
+            pulse.period = (pulse.period & 0xff) | ((u16)(val & 0x7) << 8);
+            if (pulse.enabled)
+                pulse.length = lengthTable[val >> 3];
+            pulse.step = 0;
+            pulse.envelope.start = true;
+            break;
+    }
+}
+
+void State::writeRegister(u16 addr, u8 val, long quantum)
+{
+    RP2A03::sync(quantum);
+
+    switch (addr) {
+        case 0x4000: case 0x4001: case 0x4002: case 0x4003:
+            writePulse(pulse[0], addr & 0x3, val);
+            break;
+        case 0x4004: case 0x4005: case 0x4006: case 0x4007:
+            writePulse(pulse[1], addr & 0x3, val);
+            break;
+        case 0x4008:
+            triangle.control = val & 0x80;
+            triangle.linearLoad = val & 0x7f;
+            break;
+        case 0x400a:
+            triangle.period = (triangle.period & 0x700) | val;
+            break;
+        case 0x400b:
+            triangle.period =
+                (triangle.period & 0xff) | ((u16)(val & 0x7) << 8);
+            if (triangle.enabled)
+                triangle.length = lengthTable[val >> 3];
+            triangle.linearReload = true;
+            break;
+        case 0x400c:
+            noise.envelope.loop = val & 0x20;
+            noise.envelope.constant = val & 0x10;
+            noise.envelope.volume = val & 0xf;
+            break;
+        case 0x400e:
+            noise.mode = val & 0x80;
+            noise.period = noiseTable[val & 0xf];
+            break;
+        case 0x400f:
+            if (noise.enabled)
+                noise.length = lengthTable[val >> 3];
+            noise.envelope.start = true;
+            break;
+        case 0x4010:
+            dmc.irqEnabled = val & 0x80;
+            dmc.loop = val & 0x40;
+            dmc.period = dmcTable[val & 0xf];
+            if (!dmc.irqEnabled) {
+                dmcIrq = false;
+                M6502::clearIrq(M6502::IRQ_DMC);
+            }
+            break;
+        case 0x4011:
+            dmc.output = val & 0x7f;
+            break;
+        case 0x4012:
+            dmc.sampleAddress = 0xc000 + ((u16)val << 6);
+            break;
+        case 0x4013:
+            dmc.sampleLength = ((u16)val << 4) + 1;
+            break;
+        case 0x4015:
+            pulse[0].enabled = val & 0x01;
+            pulse[1].enabled = val & 0x02;
+            triangle.enabled = val & 0x04;
+            noise.enabled = val & 0x08;
+            if (!pulse[0].enabled)
+                pulse[0].length = 0;
+            if (!pulse[1].enabled)
+                pulse[1].length = 0;
+            if (!triangle.enabled)
+                triangle.length = 0;
+            if (!noise.enabled)
+                noise.length = 0;
+            if (!(val & 0x10))
+                dmc.bytesRemaining = 0;
+            else if (dmc.bytesRemaining == 0) {
+                dmc.address = dmc.sampleAddress;
+                dmc.bytesRemaining = dmc.sampleLength;
+                fetchDmc();
+            }
+            dmcIrq = false;
+            M6502::clearIrq(M6502::IRQ_DMC);
+            break;
+        case 0x4017:
+            fiveStep = val & 0x80;
+            irqInhibit = val & 0x40;
+            if (irqInhibit) {
+                frameIrq = false;
+                M6502::clearIrq(M6502::IRQ_FRAME);
+            }
+            frameStep = 0;
+            frameSequence = sync;
+            if (fiveStep) {
+                clockQuarterFrame();
+                clockHalfFrame();
+            }
+            break;
+        default:
+            break;
+    }
+
+    /* The register changes take effect at the current cycle. */
+    mix(sync);
+    updateDeadline();
+}
+
+Context *createContext()
+{
+    Context *context = new Context();
+    context->blip.setRates(RP2A03_CLOCK_RATE, 44100.);
+    context->outputEnabled = true;
+    return context;
+}
+
+void destroyContext(Context *context)
+{
+    delete context;
+}
+
+void makeCurrent(State *apuState, Context *apuContext)
+{
+    state = apuState;
+    context = apuContext;
+}
+
+void sync(long quantum)
+{
+    ulong cpu = M6502::state->cycles + quantum;
+    if (cpu > state->sync)
+        run(cpu);
+    updateDeadline();
+}
+
+void endFrame()
+{
+    sync(0);
+    if (context->outputEnabled)
+        context->blip.endFrame(state->sync - state->frameStart);
+    state->frameStart = state->sync;
+}
+
+void setSampleRate(double rate)
+{
+    context->blip.setRates(RP2A03_CLOCK_RATE, rate);
+}
+
+void adjustSampleRate(double rate)
+{
+    context->blip.adjustRates(RP2A03_CLOCK_RATE, rate);
+}
+
+void setOutputEnabled(bool enabled)
+{
+    context->outputEnabled = enabled;
+}
+
+size_t getSamplesAvailable()
+{
+    return context->blip.getAvailable();
+}
+
+size_t readSamples(i16 *out, size_t count)
+{
+    return context->blip.readSamples(out, count);
+}
+
+};
@@ -0,0 +1,197 @@
+
+#ifndef _RP2A03STATE_H_INCLUDED_
+#define _RP2A03STATE_H_INCLUDED_
+
+#include <cstddef>
+
+#include "type.h"
+
+/*
+ * NTSC CPU clock: 236.25 / 132 MHz, the APU is clocked by the CPU cycles.
+ */
+#define RP2A03_CLOCK_RATE       (236250000. / 132.)
+
+namespace RP2A03 {
+
+/**
+ * Volume envelope of the pulse and noise channels.
+ */
+struct Envelope {
+    bool start;
+    bool loop;
+    bool constant;
+    u8 volume;
+    u8 divider;
+    u8 decay;
+};
+
+struct Pulse {
+    bool enabled;
+    u8 duty;
+    u8 step;
+    /* Timer period (11 bits) and countdown, in CPU cycles. */
+    u16 period;
+    u32 timer;
+    u8 length;
+    Envelope envelope;
+    bool sweepEnabled;
+    bool sweepNegate;
+    bool sweepReload;
+    u8 sweepPeriod;
+    u8 sweepShift;
+    u8 sweepDivider;
+};
+
+struct Triangle {
+    bool enabled;
+    u8 step;
+    u16 period;
+    u32 timer;
+    u8 length;
+    /* Length counter halt, and linear counter control. */
+    bool control;
+    bool linearReload;
+    u8 linearLoad;
+    u8 linearCounter;
+};
+
+struct Noise {
+    bool enabled;
+    /* Short sequence mode. */
+    bool mode;
+    u16 period;
+    u32 timer;
+    /* Linear feedback shift register (15 bits). */
+    u16 shift;
+    u8 length;
+    Envelope envelope;
+};
+
+/**
+ * Delta modulation channel: plays 1-bit delta encoded samples read from
+ * the CPU memory.
+ */
+struct Dmc {
+    bool irqEnabled;
+    bool loop;
+    u16 period;
+    u32 timer;
+    /* Output level (7 bits). */
+    u8 output;
+    u16 sampleAddress;
+    u16 sampleLength;
+    /* Memory reader. */
+    u16 address;
+    u16 bytesRemaining;
+    u8 buffer;
+    bool bufferFull;
+    /* Output unit. */
+    u8 shift;
+    u8 bitsRemaining;
+    bool silence;
+};
+
+/**
+ * APU registers and internal state. The channels are only updated when
+ * the CPU accesses the APU registers, at the end of each frame, and before
+ * the next interrupt (see \ref deadline).
+ */
+class State
+{
+public:
+    State();
+    /* Trivial destructor: the state is saved and restored by copy. */
+    ~State() = default;
+
+    void clear();
+
+    Pulse pulse[2];
+    Triangle triangle;
+    Noise noise;
+    Dmc dmc;
+
+    /* Frame counter. */
+    bool fiveStep;
+    bool irqInhibit;
+    bool frameIrq;
+    bool dmcIrq;
+    u8 frameStep;
+    /* CPU cycle of the start of the frame counter sequence. */
+    ulong frameSequence;
+
+    /* CPU cycle count at the last time the APU was updated. */
+    ulong sync;
+    /*
+     * CPU cycle count before which no interrupt can be raised: the APU must
+     * be updated when the CPU reaches it.
+     */
+    ulong deadline;
+    /* CPU cycle count of the start of the current audio frame. */
+    ulong frameStart;
+    /* Last mixer output. */
+    int output;
+
+    u8 readRegister(u16 addr, long quantum = 0);
+    void writeRegister(u16 addr, u8 val, long quantum = 0);
+};
+
+/**
+ * Audio output of an emulator instance.
+ */
+struct Context;
+
+Context *createContext();
+void destroyContext(Context *context);
+
+/**
+ * @brief Select the APU state and context of the emulator instance
+ *  running on the calling thread.
+ */
+void makeCurrent(State *state, Context *context);
+
+/**
+ * @brief APU state of the current instance.
+ */
+extern thread_local State *state;
+
+/**
+ * @brief Catch up with the CPU.
+ */
+void sync(long quantum);
+
+/**
+ * @brief Catch up with the CPU, and make the samples of the elapsed time
+ *  available to \ref readSamples.
+ */
+void endFrame();
+
+/**
+ * @brief Set the sample rate of the current instance (44100 by default).
+ *  Drops the buffered samples.
+ */
+void setSampleRate(double rate);
+
+/**
+ * @brief Change the sample rate of the current instance, keeping the
+ *  buffered samples: small adjustments of the resampling ratio, applied
+ *  from the next frame.
+ */
+void adjustSampleRate(double rate);
+
+/**
+ * @brief Enable or disable the generation of samples. The channels are
+ *  emulated regardless.
+ */
+void setOutputEnabled(bool enabled);
+
+size_t getSamplesAvailable();
+
+/**
+ * @brief Read up to \p count signed 16-bit mono samples.
+ * @return              the number of samples read
+ */
+size_t readSamples(i16 *out, size_t count);
+
+};
+
+#endif /* _RP2A03STATE_H_INCLUDED_ */
@@ -0,0 +1,526 @@
+
+/*
+ * ROM corpus scanner: loads every cartridge found in the given directories,
+ * runs each one headless for a number of frames on a pool of threads, and
+ * reports one JSON line per cartridge followed by a summary of the
+ * mappers, failures and performance of the whole corpus.
+ *
+ * Each cartridge runs in a child process, the scanner executed again with
+ * the internal option -c: emulation errors (unsupported or jamming
+ * instructions, mapper errors) are reported by the child, and hard faults
+ * of the emulator (e.g. a segmentation fault in recompiled code) are
+ * recorded as crashes without stopping the scan.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Emulator.h"
+#include "Core.h"
+#include "Rom.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "exception.h"
+#include "M6502State.h"
+#include "N2C02State.h"
+
+/**
+ * Outcome of the scan of one cartridge.
+ */
+struct ScanResult {
+    std::string file;
+    /** ok, invalid, unsupported-mapper, unsupported-instruction, jam,
+     * error, crash */
+    const char *status;
+    std::string error;
+    /** Faulting instruction, -1 if none. */
+    int opcode;
+    u16 address;
+    /** Configuration, -1 if the header could not be decoded. */
+    int mapper;
+    u8 submapper;
+    bool nes2;
+    bool battery;
+    size_t prgRomSize;
+    size_t chrRomSize;
+    /** Emulation metrics. */
+    ulong frames;
+    uint64_t cycles;
+    double elapsed;
+    double jitCycleRatio;
+    uint64_t blocksCompiled;
+};
+
+/**
+ * Result of a cartridge, as written by the child process to the scanner:
+ * both run the same executable, the structure is copied as is.
+ */
+struct ScanRecord {
+    char status[32];
+    char error[256];
+    int opcode;
+    u16 address;
+    int mapper;
+    u8 submapper;
+    bool nes2;
+    bool battery;
+    size_t prgRomSize;
+    size_t chrRomSize;
+    ulong frames;
+    uint64_t cycles;
+    double elapsed;
+    double jitCycleRatio;
+    uint64_t blocksCompiled;
+};
+
+/** File descriptor of the child process receiving the record. */
+#define SCAN_RECORD_FD      3
+
+static const char *const statuses[] = {
+    "ok", "invalid", "unsupported-mapper", "unsupported-instruction", "jam",
+    "error", "crash",
+};
+
+static int usage()
+{
+    std::cerr << "usage: nes-scan [-i] [-j threads] [-f frames] <dir|rom>...";
+    std::cerr << std::endl;
+    return 1;
+}
+
+static bool hasRomExtension(const std::string &name)
+{
+    if (name.size() < 4)
+        return false;
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".nes";
+}
+
+/**
+ * @brief Append the cartridge files of the directory tree \p path (or
+ *  \p path itself if it is a file) to \p files.
+ */
+static void listRoms(const std::string &path, std::vector<std::string> &files)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0)
+        return;
+    if (!S_ISDIR(st.st_mode)) {
+        files.push_back(path);
+        return;
+    }
+
+    DIR *dir = opendir(path.c_str());
+    if (dir == NULL)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name(entry->d_name);
+        if (name == "." || name == "..")
+            continue;
+        std::string child = path + "/" + name;
+        if (stat(child.c_str(), &st) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            listRoms(child, files);
+        else if (hasRomExtension(name))
+            files.push_back(child);
+    }
+    closedir(dir);
+}
+
+/**
+ * @brief Load and run the cartridge \p result.file for \p frames frames,
+ *  on the calling worker thread.
+ */
+static void scanRom(ScanResult &result, ulong frames)
+{
+    result.status = "ok";
+    result.opcode = -1;
+    result.address = 0;
+    result.mapper = -1;
+    result.submapper = 0;
+    result.nes2 = false;
+    result.battery = false;
+    result.prgRomSize = 0;
+    result.chrRomSize = 0;
+    result.frames = 0;
+    result.cycles = 0;
+    result.elapsed = 0.;
+    result.jitCycleRatio = 0.;
+    result.blocksCompiled = 0;
+
+    Emulator *emulator;
+    try {
+        emulator = new Emulator(result.file.c_str());
+    } catch (const UnsupportedMapper &exc) {
+        result.status = "unsupported-mapper";
+        result.mapper = exc.mapper;
+        return;
+    } catch (const std::exception &exc) {
+        result.status = "invalid";
+        result.error = exc.what();
+        return;
+    } catch (const char *msg) {
+        result.status = "invalid";
+        result.error = msg;
+        return;
+    }
+
+    const RomConfig &config = emulator->rom->config;
+    result.mapper = config.mapper;
+    result.submapper = config.submapper;
+    result.nes2 = config.nes2;
+    result.battery = config.battery;
+    result.prgRomSize = config.prgRomSize;
+    result.chrRomSize = config.chrRomSize;
+
+    memset(&Stats::counters, 0, sizeof(Stats::counters));
+    Core::reset();
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    try {
+        while (N2C02::state->frame < frames)
+            Core::runFrame();
+    } catch (const UnsupportedInstruction &exc) {
+        result.status = "unsupported-instruction";
+        result.opcode = exc.opcode;
+        result.address = exc.address;
+    } catch (const JammingInstruction &exc) {
+        result.status = "jam";
+        result.opcode = exc.opcode;
+        result.address = exc.address;
+    } catch (const std::exception &exc) {
+        result.status = "error";
+        result.error = exc.what();
+    } catch (const char *msg) {
+        result.status = "error";
+        result.error = msg;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    result.frames = N2C02::state->frame;
+    result.cycles = M6502::state->cycles;
+    result.elapsed = elapsed.count();
+    result.jitCycleRatio = result.cycles ?
+        (double)Stats::counters.jitCycles / result.cycles : 0.;
+    result.blocksCompiled = Stats::counters.blocksCompiled;
+    delete emulator;
+}
+
+static void writeRecord(int fd, const ScanResult &result)
+{
+    ScanRecord record;
+    memset(&record, 0, sizeof(record));
+    strncpy(record.status, result.status, sizeof(record.status) - 1);
+    strncpy(record.error, result.error.c_str(), sizeof(record.error) - 1);
+    record.opcode = result.opcode;
+    record.address = result.address;
+    record.mapper = result.mapper;
+    record.submapper = result.submapper;
+    record.nes2 = result.nes2;
+    record.battery = result.battery;
+    record.prgRomSize = result.prgRomSize;
+    record.chrRomSize = result.chrRomSize;
+    record.frames = result.frames;
+    record.cycles = result.cycles;
+    record.elapsed = result.elapsed;
+    record.jitCycleRatio = result.jitCycleRatio;
+    record.blocksCompiled = result.blocksCompiled;
+
+    const char *buf = (const char *)&record;
+    size_t done = 0;
+    while (done < sizeof(record)) {
+        ssize_t n = write(fd, buf + done, sizeof(record) - done);
+        if (n <= 0)
+            return;
+        done += n;
+    }
+}
+
+static void readRecord(const ScanRecord &record, ScanResult &result)
+{
+    result.status = "error";
+    for (const char *status : statuses)
+        if (strncmp(record.status, status, sizeof(record.status)) == 0)
+            result.status = status;
+    result.error.assign(record.error, strnlen(record.error,
+                                               sizeof(record.error)));
+    result.opcode = record.opcode;
+    result.address = record.address;
+    result.mapper = record.mapper;
+    result.submapper = record.submapper;
+    result.nes2 = record.nes2;
+    result.battery = record.battery;
+    result.prgRomSize = record.prgRomSize;
+    result.chrRomSize = record.chrRomSize;
+    result.frames = record.frames;
+    result.cycles = record.cycles;
+    result.elapsed = record.elapsed;
+    result.jitCycleRatio = record.jitCycleRatio;
+    result.blocksCompiled = record.blocksCompiled;
+}
+
+/**
+ * @brief Scan the cartridge \p result.file in a child process: the scanner
+ *  \p self is executed again with the option -c, and writes its record to
+ *  a pipe. A child killed by a signal is recorded as a crash.
+ */
+static void scanRomIsolated(ScanResult &result, ulong frames, bool jit,
+                            const char *self)
+{
+    result.status = "error";
+    result.opcode = -1;
+    result.address = 0;
+    result.mapper = -1;
+    result.frames = 0;
+    result.cycles = 0;
+
+    /* Everything the child needs is prepared before the fork. */
+    std::string framesArg = std::to_string(frames);
+    std::vector<const char *> args = { self, "-c", "-f", framesArg.c_str() };
+    if (!jit)
+        args.push_back("-i");
+    args.push_back(result.file.c_str());
+    args.push_back(NULL);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        result.error = "cannot create the pipe";
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* Only the record is written to the scanner. */
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+            dup2(null, STDOUT_FILENO);
+        if (fds[1] == SCAN_RECORD_FD)
+            fcntl(fds[1], F_SETFD, 0);
+        else
+            dup2(fds[1], SCAN_RECORD_FD);
+        execv(self, const_cast<char *const *>(args.data()));
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        result.error = "cannot fork";
+        return;
+    }
+
+    ScanRecord record;
+    size_t done = 0;
+    while (done < sizeof(record)) {
+        ssize_t n = read(fds[0], (char *)&record + done, sizeof(record) - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            break;
+
+    if (done == sizeof(record))
+        readRecord(record, result);
+    if (WIFSIGNALED(status)) {
+        int sig = WTERMSIG(status);
+        result.status = "crash";
+        result.error = sig == SIGSEGV ? "SIGSEGV" :
+                       sig == SIGILL ? "SIGILL" :
+                       sig == SIGBUS ? "SIGBUS" :
+                       sig == SIGFPE ? "SIGFPE" :
+                       sig == SIGABRT ? "SIGABRT" :
+                       "signal " + std::to_string(sig);
+    } else if (done != sizeof(record)) {
+        result.error = "scanner exited with status " +
+            std::to_string(WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+}
+
+/**
+ * @brief Write a string as a JSON string literal.
+ */
+static void dumpString(std::ostream &os, const std::string &str)
+{
+    os << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            os << '\\' << c;
+        else if ((unsigned char)c < 0x20)
+            os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+               << (int)c << std::dec;
+        else
+            os << c;
+    }
+    os << '"';
+}
+
+static void dumpResult(std::ostream &os, const ScanResult &result)
+{
+    os << std::fixed << std::setprecision(3);
+    os << "{\"rom\":";
+    dumpString(os, result.file);
+    os << ",\"status\":\"" << result.status << "\"";
+    if (!result.error.empty()) {
+        os << ",\"error\":";
+        dumpString(os, result.error);
+    }
+    if (result.opcode >= 0) {
+        os << ",\"opcode\":" << result.opcode;
+        os << ",\"address\":" << result.address;
+    }
+    if (result.mapper >= 0) {
+        os << ",\"mapper\":" << result.mapper;
+        os << ",\"submapper\":" << (int)result.submapper;
+    }
+    if (result.prgRomSize) {
+        os << ",\"nes2\":" << (result.nes2 ? "true" : "false");
+        os << ",\"battery\":" << (result.battery ? "true" : "false");
+        os << ",\"prg_rom\":" << result.prgRomSize;
+        os << ",\"chr_rom\":" << result.chrRomSize;
+    }
+    if (result.cycles) {
+        double rate = result.elapsed > 0 ? 1. / result.elapsed : 0.;
+        os << ",\"frames\":" << result.frames;
+        os << ",\"cycles\":" << result.cycles;
+        os << ",\"frames_per_second\":" << result.frames * rate;
+        os << ",\"jit_cycle_ratio\":" << result.jitCycleRatio;
+        os << ",\"blocks_compiled\":" << result.blocksCompiled;
+    }
+    os << "}" << std::endl;
+}
+
+/**
+ * @brief Dump the statistics of the corpus: cartridges per status and per
+ *  mapper, unsupported opcodes, and the frame rate distribution.
+ */
+static void dumpSummary(std::ostream &os,
+                        const std::vector<ScanResult> &results)
+{
+    std::map<std::string, size_t> statuses;
+    std::map<int, size_t> mappers;
+    std::map<int, size_t> opcodes;
+    std::vector<double> fps;
+    double jitCycleRatio = 0.;
+
+    for (const ScanResult &result : results) {
+        statuses[result.status]++;
+        if (result.mapper >= 0)
+            mappers[result.mapper]++;
+        if (result.opcode >= 0)
+            opcodes[result.opcode]++;
+        if (result.cycles && result.elapsed > 0) {
+            fps.push_back(result.frames / result.elapsed);
+            jitCycleRatio += result.jitCycleRatio;
+        }
+    }
+    std::sort(fps.begin(), fps.end());
+
+    os << std::fixed << std::setprecision(3);
+    os << "{\"summary\":{\"roms\":" << results.size();
+    os << ",\"status\":{";
+    for (auto it = statuses.begin(); it != statuses.end(); it++)
+        os << (it == statuses.begin() ? "" : ",")
+           << "\"" << it->first << "\":" << it->second;
+    os << "},\"mappers\":{";
+    for (auto it = mappers.begin(); it != mappers.end(); it++)
+        os << (it == mappers.begin() ? "" : ",")
+           << "\"" << it->first << "\":" << it->second;
+    os << "},\"opcodes\":{";
+    for (auto it = opcodes.begin(); it != opcodes.end(); it++)
+        os << (it == opcodes.begin() ? "" : ",")
+           << "\"" << it->first << "\":" << it->second;
+    os << "}";
+    if (!fps.empty()) {
+        os << ",\"fps_min\":" << fps.front();
+        os << ",\"fps_median\":" << fps[fps.size() / 2];
+        os << ",\"fps_max\":" << fps.back();
+        os << ",\"jit_cycle_ratio\":" << jitCycleRatio / fps.size();
+    }
+    os << "}}" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    unsigned int threads = 0;
+    ulong frames = 300;
+    bool jit = true;
+    bool child = false;
+
+    while ((opt = getopt(argc, argv, "cij:f:")) != -1) {
+        switch (opt) {
+            case 'c':
+                /* Child process, scanning a single cartridge. */
+                child = true;
+                break;
+            case 'i':
+                /* Interpreter only. */
+                jit = false;
+                break;
+            case 'j':
+                /* Worker threads, one per hardware thread by default. */
+                threads = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                /* Frames emulated per cartridge. */
+                frames = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                return usage();
+        }
+    }
+    if (optind >= argc)
+        return usage();
+
+    Rom::setVerbose(false);
+    Core::setJit(jit);
+    if (child) {
+        ScanResult result;
+        result.file = argv[optind];
+        scanRom(result, frames);
+        writeRecord(SCAN_RECORD_FD, result);
+        return 0;
+    }
+
+    std::vector<std::string> files;
+    for (int i = optind; i < argc; i++)
+        listRoms(argv[i], files);
+    std::sort(files.begin(), files.end());
+
+    std::vector<ScanResult> results(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+        results[i].file = files[i];
+
+    /* The results are printed as they complete. */
+    std::mutex outputLock;
+    ThreadPool pool(threads);
+    pool.run(results.size(), [&] (size_t i) {
+        scanRomIsolated(results[i], frames, jit, "/proc/self/exe");
+        std::lock_guard<std::mutex> lock(outputLock);
+        dumpResult(std::cout, results[i]);
+    });
+
+    dumpSummary(std::cout, results);
+    return 0;
+}
@@ -0,0 +1,65 @@
+
+#include <iostream>
+
+#include "SDLBackend.h"
+
+SDLAudio::SDLAudio()
+    : _device(0)
+{
+}
+
+SDLAudio::~SDLAudio()
+{
+    quit();
+}
+
+/**
+ * @brief Open the default audio device for signed 16-bit mono samples at
+ *  \p rate Hz, and start the playback. The device buffer is kept small,
+ *  the latency is set by the sample queue.
+ */
+int SDLAudio::init(unsigned int rate)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        std::cerr << "failed to initialise SDL audio: " << SDL_GetError();
+        std::cerr << std::endl;
+        return -1;
+    }
+
+    SDL_AudioSpec spec = {};
+    spec.freq = rate;
+    spec.format = AUDIO_S16SYS;
+    spec.channels = 1;
+    spec.samples = 512;
+    spec.callback = &SDLAudio::callback;
+    spec.userdata = this;
+
+    open(rate);
+    _device = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
+    if (_device == 0) {
+        std::cerr << "failed to open SDL audio device: " << SDL_GetError();
+        std::cerr << std::endl;
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return -1;
+    }
+    SDL_PauseAudioDevice(_device, 0);
+    return 0;
+}
+
+void SDLAudio::quit()
+{
+    if (_device == 0)
+        return;
+    SDL_CloseAudioDevice(_device);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    _device = 0;
+}
+
+/**
+ * @brief Device callback, called from the SDL audio thread.
+ */
+void SDLAudio::callback(void *userdata, u8 *stream, int len)
+{
+    SDLAudio *audio = (SDLAudio *)userdata;
+    audio->pull((i16 *)stream, len / sizeof(i16));
+}
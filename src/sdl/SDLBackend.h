@@ -0,0 +1,122 @@
+
+#ifndef _SDLBACKEND_H_INCLUDED_
+#define _SDLBACKEND_H_INCLUDED_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <SDL2/SDL.h>
+
+#include "Audio.h"
+#include "Video.h"
+#include "Events.h"
+#include "type.h"
+
+class SDLEvents;
+
+/**
+ * Video backend displaying the frames in an SDL window. The window belongs
+ * to the event backend ; the frames are uploaded to a streaming texture,
+ * and presented on the vertical sync.
+ */
+class SDLVideo : public Video::Backend
+{
+public:
+    /**
+     * @param events        event backend, which creates the window
+     */
+    SDLVideo(SDLEvents *events);
+    ~SDLVideo();
+
+    int init(unsigned int width, unsigned int height, unsigned int zoom);
+    void quit();
+    void present(const u32 *pixels);
+
+private:
+    SDLEvents *_events;
+    SDL_Window *_window;
+    SDL_Renderer *_renderer;
+    SDL_Texture *_texture;
+    unsigned int _width;
+    unsigned int _height;
+    unsigned int _zoom;
+};
+
+/**
+ * Audio backend playing the samples on the default SDL audio device. The
+ * device callback pulls the samples from the queue.
+ */
+class SDLAudio : public Audio::Device
+{
+public:
+    SDLAudio();
+    ~SDLAudio();
+
+    int init(unsigned int rate);
+    void quit();
+
+private:
+    static void callback(void *userdata, u8 *stream, int len);
+
+    SDL_AudioDeviceID _device;
+};
+
+/**
+ * Event backend handling the SDL window and keyboard events on a
+ * dedicated thread. The thread initialises the SDL video subsystem, and
+ * owns the window.
+ */
+class SDLEvents : public Events::Backend
+{
+public:
+    SDLEvents();
+    ~SDLEvents();
+
+    int init();
+    void quit();
+
+    /**
+     * @brief Create the window from the event thread, and wait for it.
+     *  Called from any thread, after \ref init.
+     * @return              the window, or NULL on failure
+     */
+    SDL_Window *openWindow(const char *title, int width, int height);
+
+    /**
+     * @brief Register a callback for the specified keyboard event.
+     * @param type          SDL_KEYUP or SDL_KEYDOWN
+     * @param sym           SDL key symbol
+     * @param callback      event callback
+     */
+    void bindKeyboardEvent(int type, int sym, std::function<void()> callback);
+
+private:
+    /** Requests to the event thread, codes of SDL_USEREVENT events. */
+    enum Request {
+        REQUEST_OPEN_WINDOW,
+        REQUEST_QUIT,
+    };
+
+    void handleEvents();
+    bool pushRequest(Request request);
+
+    std::thread *_thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    int _status;
+    bool _started;
+
+    /** Window, and the parameters of the pending creation request. */
+    SDL_Window *_window;
+    const char *_title;
+    int _width;
+    int _height;
+    bool _opened;
+
+    /** Keyboard handlers, indexed by scancode. */
+    std::function<void()> _keyDownHandlers[SDL_NUM_SCANCODES];
+    std::function<void()> _keyUpHandlers[SDL_NUM_SCANCODES];
+};
+
+#endif /* _SDLBACKEND_H_INCLUDED_ */
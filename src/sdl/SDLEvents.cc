@@ -0,0 +1,206 @@
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "SDLBackend.h"
+#include "Joypad.h"
+
+using namespace Joypad;
+
+/**
+ * Default keyboard layout for the first joypad.
+ */
+static const struct {
+    int sym;
+    JoypadButton button;
+} joypadKeys[] = {
+    { SDLK_w,       JOYPAD_BUTTON_A },
+    { SDLK_x,       JOYPAD_BUTTON_B },
+    { SDLK_SPACE,   JOYPAD_BUTTON_SELECT },
+    { SDLK_RETURN,  JOYPAD_BUTTON_START },
+    { SDLK_UP,      JOYPAD_BUTTON_UP },
+    { SDLK_DOWN,    JOYPAD_BUTTON_DOWN },
+    { SDLK_LEFT,    JOYPAD_BUTTON_LEFT },
+    { SDLK_RIGHT,   JOYPAD_BUTTON_RIGHT },
+};
+
+SDLEvents::SDLEvents()
+    : _thread(NULL), _status(0), _started(false), _window(NULL),
+      _title(NULL), _width(0), _height(0), _opened(false)
+{
+}
+
+SDLEvents::~SDLEvents()
+{
+    quit();
+}
+
+void SDLEvents::bindKeyboardEvent(
+    int type, int sym, std::function<void()> callback)
+{
+    SDL_Scancode code = SDL_GetScancodeFromKey(sym);
+    if (code == SDL_SCANCODE_UNKNOWN)
+        return;
+    if (type == SDL_KEYDOWN)
+        _keyDownHandlers[code] = callback;
+    else
+        _keyUpHandlers[code] = callback;
+}
+
+/**
+ * @brief Bind the joypad buttons and start a thread exclusively to
+ *  handle events, and wait for the initialisation of SDL on this thread.
+ *  The buttons are queued, and applied to the joypad by the emulation
+ *  thread.
+ */
+int SDLEvents::init()
+{
+    for (auto &key : joypadKeys) {
+        bindKeyboardEvent(SDL_KEYDOWN, key.sym,
+            std::bind(Events::pushButton, key.button, true));
+        bindKeyboardEvent(SDL_KEYUP, key.sym,
+            std::bind(Events::pushButton, key.button, false));
+    }
+    bindKeyboardEvent(SDL_KEYUP, SDLK_p, Events::pause);
+    bindKeyboardEvent(SDL_KEYDOWN, SDLK_BACKSPACE,
+        std::bind(Events::rewind, true));
+    bindKeyboardEvent(SDL_KEYUP, SDLK_BACKSPACE,
+        std::bind(Events::rewind, false));
+
+    if (_thread != NULL)
+        return -1;
+    _started = false;
+    _thread = new std::thread(&SDLEvents::handleEvents, this);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cond.wait(lock, [this] { return _started; });
+    return _status;
+}
+
+/**
+ * @brief Stop and join the event thread, which destroys the window and
+ *  shuts SDL down.
+ */
+void SDLEvents::quit()
+{
+    if (_thread == NULL)
+        return;
+    if (_status == 0)
+        pushRequest(REQUEST_QUIT);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+SDL_Window *SDLEvents::openWindow(const char *title, int width, int height)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_thread == NULL || _status < 0)
+        return NULL;
+    _title = title;
+    _width = width;
+    _height = height;
+    _opened = false;
+    if (!pushRequest(REQUEST_OPEN_WINDOW))
+        return NULL;
+    _cond.wait(lock, [this] { return _opened; });
+    return _window;
+}
+
+bool SDLEvents::pushRequest(Request request)
+{
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = SDL_USEREVENT;
+    event.user.code = request;
+    if (SDL_PushEvent(&event) < 0) {
+        std::cerr << "failed to push SDL event: " << SDL_GetError();
+        std::cerr << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Initialise the SDL video subsystem, then wait for (and handle)
+ *  SDL keyboard events and the requests of the other threads. SDL is shut
+ *  down when the thread is asked to quit.
+ */
+void SDLEvents::handleEvents()
+{
+    int status = 0;
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        std::cerr << "failed to initialise SDL: " << SDL_GetError();
+        std::cerr << std::endl;
+        status = -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _status = status;
+        _started = true;
+    }
+    _cond.notify_all();
+
+    std::cerr << "Event thread started" << std::endl;
+    /* Check for joypad events. */
+    SDL_Event event;
+    bool running = status == 0;
+    while (running)
+    {
+        int ret = SDL_WaitEvent(&event);
+        if (ret == 0) {
+            std::cerr << "Error waiting for SDL events (";
+            std::cerr << SDL_GetError() << ")" << std::endl;
+            continue;
+        }
+
+        switch (event.type) {
+            case SDL_KEYDOWN:
+                if (event.key.repeat != 0)
+                    break;
+                /* Fallthrough */
+            case SDL_KEYUP: {
+                SDL_Scancode code = event.key.keysym.scancode;
+                if (code < 0 || code >= SDL_NUM_SCANCODES)
+                    break;
+                std::function<void()> &handler = event.type == SDL_KEYDOWN ?
+                    _keyDownHandlers[code] : _keyUpHandlers[code];
+                if (handler)
+                    handler();
+                break;
+            }
+            case SDL_QUIT:
+                /* The window is kept until the thread is asked to quit. */
+                std::cerr << "Quitting..." << std::endl;
+                Events::quit();
+                break;
+            case SDL_USEREVENT:
+                if (event.user.code == REQUEST_QUIT) {
+                    running = false;
+                    break;
+                }
+                if (event.user.code == REQUEST_OPEN_WINDOW) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _window = SDL_CreateWindow(_title,
+                        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                        _width, _height, SDL_WINDOW_SHOWN);
+                    if (!_window) {
+                        std::cerr << "failed to create SDL window: ";
+                        std::cerr << SDL_GetError() << std::endl;
+                    }
+                    _opened = true;
+                    _cond.notify_all();
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (_window) {
+        SDL_DestroyWindow(_window);
+        _window = NULL;
+    }
+    SDL_Quit();
+}
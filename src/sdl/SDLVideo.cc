@@ -0,0 +1,93 @@
+
+#include <cstring>
+#include <iostream>
+
+#include "SDLBackend.h"
+
+SDLVideo::SDLVideo(SDLEvents *events)
+    : _events(events), _window(NULL), _renderer(NULL), _texture(NULL),
+      _width(0), _height(0), _zoom(1)
+{
+}
+
+SDLVideo::~SDLVideo()
+{
+    quit();
+}
+
+/**
+ * @brief Open a window large enough to display the frames scaled by
+ *  \p zoom, and create the renderer and the texture the frames are
+ *  uploaded to. Called from the presentation thread.
+ */
+int SDLVideo::init(unsigned int width, unsigned int height, unsigned int zoom)
+{
+    _width = width;
+    _height = height;
+    _zoom = zoom ? zoom : 1;
+
+    _window = _events->openWindow("cnes 0.1", _width * _zoom, _height * _zoom);
+    if (!_window)
+        return -1;
+
+    /* The presentation waits for the vertical sync. */
+    _renderer = SDL_CreateRenderer(_window, -1, SDL_RENDERER_PRESENTVSYNC);
+    if (!_renderer) {
+        std::cerr << "failed to create SDL renderer: " << SDL_GetError();
+        std::cerr << std::endl;
+        quit();
+        return -1;
+    }
+
+    _texture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING, _width, _height);
+    if (!_texture) {
+        std::cerr << "failed to create SDL texture: " << SDL_GetError();
+        std::cerr << std::endl;
+        quit();
+        return -1;
+    }
+    /* Paint it blaaack. */
+    SDL_SetRenderDrawColor(_renderer, 0, 0, 0, 255);
+    SDL_RenderClear(_renderer);
+    SDL_RenderPresent(_renderer);
+    return 0;
+}
+
+/**
+ * @brief Destroy the renderer. The window is destroyed by the event
+ *  backend.
+ */
+void SDLVideo::quit()
+{
+    if (_texture) {
+        SDL_DestroyTexture(_texture);
+        _texture = NULL;
+    }
+    if (_renderer) {
+        SDL_DestroyRenderer(_renderer);
+        _renderer = NULL;
+    }
+    _window = NULL;
+}
+
+/**
+ * @brief Upload the frame to the texture, and present it scaled to the
+ *  window. Blocks until the vertical sync.
+ */
+void SDLVideo::present(const u32 *pixels)
+{
+    if (!_texture)
+        return;
+
+    void *dst;
+    int pitch;
+    if (SDL_LockTexture(_texture, NULL, &dst, &pitch) < 0)
+        return;
+    for (unsigned int y = 0; y < _height; y++, pixels += _width)
+        memcpy((u8 *)dst + y * pitch, pixels, _width * sizeof(u32));
+    SDL_UnlockTexture(_texture);
+
+    SDL_RenderCopy(_renderer, _texture, NULL, NULL);
+    SDL_RenderPresent(_renderer);
+}
@@ -38,10 +38,10 @@ public:
     Reg(u8 code) : code(code) {}
     ~Reg() {}
 
-    Mem operator()() {
+    Mem operator()() const {
         return Mem(code);
     }
-    Mem operator()(i32 d) {
+    Mem operator()(i32 d) const {
         return Mem(code, d);
     }
     bool operator==(const Reg<T> &other) const {
@@ -94,6 +94,7 @@ public:
 
     const u8 *getPtr() const { return _buffer->getPtr(); }
     size_t getSize() const { return _buffer->getLength(); }
+    size_t getCapacity() const { return _buffer->getCapacity(); }
     void dump(const u8 *start = NULL) const;
 
     u32 *CALL(const u8 *loc = NULL) { return jumpAbs(0xe8, loc); }
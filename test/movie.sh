@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# Record the same scripted input with both CPU backends, and compare the
+# ram hashes of every frame: the recompiler must stop on the instruction
+# boundaries where the interpreter sees the interrupts and the frame end.
+#
+# usage: movie.sh [-f frames] [-r seed] <nes-headless> <rom...>
+
+FRAMES=600
+SEED=1
+
+while getopts "f:r:" opt; do
+    case $opt in
+        f) FRAMES=$OPTARG ;;
+        r) SEED=$OPTARG ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 [-f frames] [-r seed] <nes-headless> <rom...>" >&2
+    exit 2
+fi
+EMU=$1
+shift
+
+# Size of Movie::Header, followed by the 5 byte frame records.
+HEADER=32
+RECORD=5
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+status=0
+for rom in "$@"; do
+    name=$(basename "$rom" .nes)
+    "$EMU" -i -r "$SEED" -m "$DIR/interpreter.nesm" "$rom" "$FRAMES" \
+        >/dev/null 2>&1
+    "$EMU" -r "$SEED" -m "$DIR/jit.nesm" "$rom" "$FRAMES" >/dev/null 2>&1
+    if [ ! -s "$DIR/interpreter.nesm" ] || [ ! -s "$DIR/jit.nesm" ]; then
+        echo "$name: recording failed" >&2
+        status=1
+        continue
+    fi
+    # The first differing byte gives the first desynchronized frame.
+    diff=$(cmp -i "$HEADER" "$DIR/interpreter.nesm" "$DIR/jit.nesm" 2>&1 |
+           sed -n 's/.* differ: [a-z]* \([0-9]*\).*/\1/p')
+    if [ -n "$diff" ]; then
+        echo "$name: DIVERGED at frame $(((diff - 1) / RECORD))"
+        status=1
+    elif ! cmp -s -i "$HEADER" "$DIR/interpreter.nesm" "$DIR/jit.nesm"; then
+        echo "$name: DIVERGED (length)"
+        status=1
+    else
+        echo "$name: ok"
+    fi
+    rm -f "$DIR/interpreter.nesm" "$DIR/jit.nesm"
+done
+exit $status
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/**
+ * Runs batches of tasks back to back, each with a different function
+ * bound to a buffer released as soon as the batch returns, and checks that
+ * every task of every batch ran exactly once with the function of its own
+ * batch. A worker running late with the function of the previous batch
+ * writes to a released buffer or misses a task of the current one.
+ */
+
+int main()
+{
+    const size_t batches = 20000;
+    ThreadPool pool(4);
+    std::vector<size_t> runs;
+    int status = 0;
+
+    for (size_t batch = 0; batch < batches && status == 0; batch++) {
+        size_t count = 1 + batch % 13;
+        std::unique_ptr<std::vector<size_t>> marks(
+            new std::vector<size_t>(count, 0));
+        std::vector<size_t> *buffer = marks.get();
+
+        pool.run(count, [buffer, batch] (size_t i) {
+            (*buffer)[i] += batch + 1;
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            if ((*marks)[i] != batch + 1) {
+                std::cerr << "batch " << batch << ": task " << i;
+                std::cerr << " ran " << (*marks)[i] << std::endl;
+                status = 1;
+            }
+        }
+    }
+
+    std::cout << (status ? "FAILED" : "ok") << std::endl;
+    return status;
+}